@@ -0,0 +1,194 @@
+//
+// Created by 98302 on 2023/10/14.
+//
+
+#include <chrono>
+#include <cstdio>
+#include <string>
+#include <string_view>
+#include <regex>
+#include <algorithm>
+#include <unordered_map>
+#include <vector>
+#include "../src/http/HttpParser.h"
+
+/*
+ * 请求解析微基准
+ * 对比原正则解析（逐行拷贝为std::string，每行构造std::regex）与HttpParser（原地扫描，string_view）
+ * 分片场景：请求按kFragment字节分多次到达，对比每次从头解析与增量续扫
+ * 用法：http_parse_bench [iterations]，正则解析每次约数百微秒，只执行iterations / kRegexScale次
+ */
+
+using namespace std;
+
+/// 原HttpRequest::Parse的解析逻辑（不含Buffer与日志），作为对照组
+class RegexParser {
+public:
+    bool Parse(const char *begin, const char *end) {
+        const char CRLF[] = "\r\n";
+        method_ = path_ = version_ = body_ = "";
+        header_.clear();
+        state_ = kRequestLine;
+        const char *p = begin;
+        while(p < end && state_ != kFinish){
+            const char *line_end = search(p, end, CRLF, CRLF+2);
+            string line(p, line_end);
+            switch(state_){
+                case kRequestLine:{
+                    regex pattern("^([^ ]*) ([^ ]*) HTTP/([^ ]*)$");
+                    smatch sub_match;
+                    if(!regex_match(line, sub_match, pattern)){
+                        return false;
+                    }
+                    method_ = sub_match[1];
+                    path_ = sub_match[2];
+                    version_ = sub_match[3];
+                    state_ = kHeaders;
+                    break;
+                }
+                case kHeaders:{
+                    regex pattern("^([^:]*): ?(.*)$");
+                    smatch sub_match;
+                    if(regex_match(line, sub_match, pattern)){
+                        header_[sub_match[1]] = sub_match[2];
+                    }else{
+                        state_ = kBody;
+                    }
+                    if(end - line_end <= 2){
+                        state_ = kFinish;
+                    }
+                    break;
+                }
+                case kBody:
+                    body_ = line;
+                    state_ = kFinish;
+                    break;
+                default:
+                    break;
+            }
+            if(line_end == end){
+                break;
+            }
+            p = line_end + 2;
+        }
+        return true;
+    }
+    string method_, path_, version_, body_;
+private:
+    enum State{kRequestLine, kHeaders, kBody, kFinish};
+    State state_ = kRequestLine;
+    unordered_map<string, string> header_;
+};
+
+static const vector<pair<const char*, string>> kRequests = {
+        {"short GET",
+         "GET /index.html HTTP/1.1\r\n"
+         "Host: localhost:1316\r\n"
+         "Connection: keep-alive\r\n"
+         "\r\n"},
+        {"browser GET",
+         "GET /images/profile-image.jpg HTTP/1.1\r\n"
+         "Host: localhost:1316\r\n"
+         "Connection: keep-alive\r\n"
+         "User-Agent: Mozilla/5.0 (X11; Linux x86_64) AppleWebKit/537.36 (KHTML, like Gecko) Chrome/117.0 Safari/537.36\r\n"
+         "Accept: image/avif,image/webp,image/apng,image/svg+xml,image/*,*/*;q=0.8\r\n"
+         "Referer: http://localhost:1316/picture\r\n"
+         "Accept-Encoding: gzip, deflate, br\r\n"
+         "Accept-Language: zh-CN,zh;q=0.9,en;q=0.8\r\n"
+         "Cache-Control: no-cache\r\n"
+         "Pragma: no-cache\r\n"
+         "Sec-Fetch-Dest: image\r\n"
+         "Sec-Fetch-Mode: no-cors\r\n"
+         "\r\n"},
+        {"login POST",
+         "POST /login.html HTTP/1.1\r\n"
+         "Host: localhost:1316\r\n"
+         "Connection: keep-alive\r\n"
+         "Content-Type: application/x-www-form-urlencoded\r\n"
+         "Content-Length: 31\r\n"
+         "Origin: http://localhost:1316\r\n"
+         "Referer: http://localhost:1316/login\r\n"
+         "\r\n"
+         "username=zhangsan&password=1234"},
+};
+
+static constexpr size_t kFragment = 16;
+static constexpr int kRegexScale = 1000;  // 正则解析的迭代次数缩小倍数
+
+/// 模拟请求分片到达，每到达kFragment字节解析一次
+/// \param resume true：保留解析进度；false：每次Reset后从头解析
+static HttpParser::Status ParseFragmented(HttpParser &parser, const string &request, bool resume) {
+    const char *begin = request.data();
+    HttpParser::Status status = HttpParser::kIncomplete;
+    parser.Reset();
+    for(size_t n = kFragment; status == HttpParser::kIncomplete; n += kFragment){
+        n = min(n, request.size());
+        if(!resume){
+            parser.Reset();
+        }
+        status = parser.Parse(begin, begin + n);
+    }
+    return status;
+}
+
+template<typename F>
+static double NsPerOp(int iterations, F &&f) {
+    auto start = chrono::steady_clock::now();
+    for(int i=0; i<iterations; ++i){
+        f();
+    }
+    auto cost = chrono::steady_clock::now() - start;
+    return static_cast<double>(chrono::duration_cast<chrono::nanoseconds>(cost).count()) / iterations;
+}
+
+int main(int argc, char **argv) {
+    int iterations = argc > 1 ? atoi(argv[1]) : 200000;
+    int regex_iterations = max(1, iterations / kRegexScale);
+    printf("parser %d iterations, regex %d iterations (1/%d)\n", iterations, regex_iterations, kRegexScale);
+    printf("%-14s %14s %14s %10s\n", "request", "regex ns/op", "parser ns/op", "speedup");
+    for(auto &[name, request]: kRequests){
+        const char *begin = request.data();
+        const char *end = begin + request.size();
+        RegexParser regex_parser;
+        HttpParser parser;
+        // 结果一致性检查
+        if(!regex_parser.Parse(begin, end) || parser.Parse(begin, end) != HttpParser::kComplete ||
+           regex_parser.method_ != parser.MethodName() || regex_parser.path_ != parser.Path() ||
+           regex_parser.version_ != parser.Version()){
+            fprintf(stderr, "%s: parse result mismatch\n", name);
+            return 1;
+        }
+        size_t sink = 0;
+        // 正则解析每次构造regex，迭代次数缩小以控制耗时
+        double regex_ns = NsPerOp(regex_iterations, [&]{
+            regex_parser.Parse(begin, end);
+            sink += regex_parser.path_.size();
+        });
+        double parser_ns = NsPerOp(iterations, [&]{
+            parser.Reset();
+            parser.Parse(begin, end);
+            sink += parser.Path().size();
+        });
+        printf("%-14s %14.1f %14.1f %9.1fx%s\n", name, regex_ns, parser_ns, regex_ns / parser_ns,
+               sink == 0 ? "?" : "");
+    }
+
+    printf("\nfragmented, %zu bytes per read\n", kFragment);
+    printf("%-14s %14s %14s %10s\n", "request", "restart ns/op", "resume ns/op", "speedup");
+    for(auto &[name, request]: kRequests){
+        HttpParser parser;
+        if(ParseFragmented(parser, request, true) != HttpParser::kComplete ||
+           ParseFragmented(parser, request, false) != HttpParser::kComplete){
+            fprintf(stderr, "%s: fragmented parse failed\n", name);
+            return 1;
+        }
+        double restart_ns = NsPerOp(iterations, [&]{
+            ParseFragmented(parser, request, false);
+        });
+        double resume_ns = NsPerOp(iterations, [&]{
+            ParseFragmented(parser, request, true);
+        });
+        printf("%-14s %14.1f %14.1f %9.1fx\n", name, restart_ns, resume_ns, restart_ns / resume_ns);
+    }
+    return 0;
+}
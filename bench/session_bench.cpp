@@ -0,0 +1,142 @@
+//
+// Created by 98302 on 2023/10/27.
+//
+
+#include <array>
+#include <atomic>
+#include <chrono>
+#include <cstdio>
+#include <cstdlib>
+#include <cstring>
+#include <random>
+#include <string>
+#include <thread>
+#include <vector>
+#include <algorithm>
+#include <malloc.h>
+#include "../src/pool/SessionTable.h"
+
+/*
+ * 会话表基准，依次：
+ *      create   签发n个会话（用户名user<i>，短字符串不另占堆）
+ *      memory   签发前后的堆增量/会话
+ *      validate 单线程随机查找有效令牌、MAC错误的令牌，每kSampleEvery次计时一次，取p50/p99
+ *      parallel threads个线程随机查找有效令牌的总吞吐（锁分段）
+ *      sweep    ttl为3秒时签发n个会话，到期后一次Sweep删除全部的耗时
+ * 用法：session_bench [sessions] [threads]
+ */
+
+using namespace std;
+
+static constexpr size_t kSampleEvery = 16;
+static constexpr size_t kLookups = 2000000;
+
+using Token = array<char, SessionTable::kTokenLen>;
+
+static int64_t NowNs() {
+    return chrono::duration_cast<chrono::nanoseconds>(Clock::now().time_since_epoch()).count();
+}
+
+static size_t HeapBytes() {
+    return mallinfo2().uordblks;
+}
+
+static double Percentile(vector<double> &values, double p) {
+    if(values.empty()){
+        return 0;
+    }
+    size_t k = min(values.size() - 1, static_cast<size_t>(values.size() * p));
+    nth_element(values.begin(), values.begin() + k, values.end());
+    return values[k];
+}
+
+/// 单线程随机查找，返回p50/p99纳秒
+static pair<double, double> Lookup(const vector<Token> &tokens, bool expect, uint64_t seed) {
+    SessionTable *table = SessionTable::Instance();
+    mt19937_64 rng(seed);
+    vector<double> samples;
+    samples.reserve(kLookups / kSampleEvery);
+    size_t wrong = 0;
+    for(size_t i = 0; i < kLookups; ++i){
+        const Token &token = tokens[rng() % tokens.size()];
+        string_view view(token.data(), token.size());
+        if(i % kSampleEvery == 0){
+            int64_t begin = NowNs();
+            bool valid = table->Validate(view);
+            samples.push_back(static_cast<double>(NowNs() - begin));
+            wrong += valid != expect;
+        }else{
+            wrong += table->Validate(view) != expect;
+        }
+    }
+    if(wrong){
+        printf("!! %zu unexpected results\n", wrong);
+    }
+    return {Percentile(samples, 0.5), Percentile(samples, 0.99)};
+}
+
+int main(int argc, char **argv) {
+    size_t n = argc > 1 ? strtoul(argv[1], nullptr, 10) : 1000000;
+    int threads = argc > 2 ? atoi(argv[2]) : static_cast<int>(thread::hardware_concurrency());
+    SessionTable *table = SessionTable::Instance();
+    table->Init(3600, n + n / 8, false);  // 分片容量留余量，各分片会话数不均时不淘汰
+
+    vector<Token> tokens(n);  // 在计量之前分配
+    size_t heap_begin = HeapBytes();
+    int64_t begin = NowNs();
+    for(size_t i = 0; i < n; ++i){
+        string token = table->Create("user" + to_string(i));
+        memcpy(tokens[i].data(), token.data(), token.size());
+    }
+    double create_s = (NowNs() - begin) / 1e9;
+    size_t heap = HeapBytes() - heap_begin;
+    printf("sessions:%zu (table size %zu), shards:%zu\n", n, table->Size(), SessionTable::kShardCount);
+    printf("create   %.0f op/s\n", n / create_s);
+    printf("memory   %.1f MB, %.1f B/session\n", heap / 1048576.0, static_cast<double>(heap) / n);
+
+    auto valid = Lookup(tokens, true, 1);
+    vector<Token> forged = tokens;  // 改动MAC的最后一位
+    for(Token &token: forged){
+        token.back() = token.back() == '0' ? '1' : '0';
+    }
+    auto bad_mac = Lookup(forged, false, 2);
+    printf("validate valid p50 %.0f ns, p99 %.0f ns | forged p50 %.0f ns, p99 %.0f ns\n",
+           valid.first, valid.second, bad_mac.first, bad_mac.second);
+
+    atomic<size_t> hits{0};
+    vector<thread> workers;
+    begin = NowNs();
+    for(int t = 0; t < threads; ++t){
+        workers.emplace_back([&, t]{
+            mt19937_64 rng(100 + t);
+            size_t local = 0;
+            for(size_t i = 0; i < kLookups; ++i){
+                const Token &token = tokens[rng() % n];
+                local += table->Validate(string_view(token.data(), token.size()));
+            }
+            hits += local;
+        });
+    }
+    for(auto &worker: workers){
+        worker.join();
+    }
+    double parallel_s = (NowNs() - begin) / 1e9;
+    printf("parallel %d threads, %.0f op/s, %zu/%zu valid\n", threads, threads * kLookups / parallel_s,
+           hits.load(), threads * kLookups);
+
+    table->Init(3, n + n / 8, false);  // 新密钥，之前的令牌全部失效
+    size_t stale = 0;
+    for(size_t i = 0; i < 1000; ++i){
+        stale += table->Validate(string_view(tokens[i].data(), tokens[i].size()));
+    }
+    for(size_t i = 0; i < n; ++i){
+        table->Create("user" + to_string(i));
+    }
+    this_thread::sleep_for(chrono::milliseconds(4100));  // 签发耗时小于ttl，到期前不会在Create中删除
+    begin = NowNs();
+    size_t removed = table->Sweep();
+    printf("sweep    %zu expired in %.1f ms, %zu left, %zu stale tokens accepted after re-Init\n",
+           removed, (NowNs() - begin) / 1e6, table->Size(), stale);
+    table->Close();
+    return 0;
+}
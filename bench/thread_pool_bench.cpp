@@ -0,0 +1,302 @@
+//
+// Created by 98302 on 2023/10/17.
+//
+
+#include <chrono>
+#include <cstdio>
+#include <cstdlib>
+#include <atomic>
+#include <thread>
+#include <vector>
+#include <mutex>
+#include <condition_variable>
+#include <queue>
+#include <functional>
+#include <cstring>
+#include <linux/perf_event.h>
+#include <sys/ioctl.h>
+#include <sys/syscall.h>
+#include <unistd.h>
+#include "../src/pool/ThreadPool.h"
+
+/*
+ * 线程池基准
+ * kProducers个线程（模拟event loop）并发提交小任务，统计全部执行完的吞吐
+ * 对比原单锁线程池（LegacyThreadPool）与工作窃取线程池，工作线程数1~64
+ * batch列为工作窃取线程池按kBatch个一批AddTasks提交，模拟event loop一轮就绪事件一起提交
+ * 连接亲和：kConns个连接各有kConnStateBytes字节状态（模拟Buffer/请求/响应），任务读写所属连接的全部状态，
+ * 对比Steal、Affine、Affine+绑核三种调度的吞吐与每任务cache miss
+ * cache miss由perf_event_open统计（inherit，包含所有子线程）：L1D读miss与末级cache读miss；
+ * 内核没有通用的L2事件，末级cache在多数机器上是L3，L2 miss需按CPU型号用raw事件另测；
+ * 无权限（perf_event_paranoid）或虚拟机不支持时显示n/a
+ * 用法：thread_pool_bench [tasks] [producers]
+ */
+
+using namespace std;
+
+/// 原ThreadPool实现：一把锁、一个条件变量、一个std::queue<std::function>
+/// 仅修正is_closed_未初始化，并让线程持有Pool而不是this，以便析构后安全退出
+class LegacyThreadPool {
+public:
+    explicit LegacyThreadPool(int thread_count = 8): pool_(std::make_shared<Pool>()){
+        assert(thread_count > 0);
+        for(int i=0; i<thread_count; ++i){
+            std::thread([pool = pool_](){
+                std::unique_lock<std::mutex> locker(pool->mtx_);
+                while(true){
+                    if(!pool->tasks_.empty()){
+                        auto task = std::move(pool->tasks_.front());
+                        pool->tasks_.pop();
+                        locker.unlock();
+                        task();
+                        locker.lock();
+                    }else if(pool->is_closed_){
+                        break;
+                    }else{
+                        pool->cv_.wait(locker);
+                    }
+                }
+            }).detach();
+        }
+    }
+    ~LegacyThreadPool(){
+        if(pool_){
+            std::unique_lock<std::mutex> locker(pool_->mtx_);
+            pool_->is_closed_ = true;
+        }
+        pool_->cv_.notify_all();
+    }
+
+    template<typename T>
+    void AddTask(T&& task){
+        std::unique_lock<std::mutex> locker(pool_->mtx_);
+        pool_->tasks_.emplace(std::forward<T>(task));
+        pool_->cv_.notify_one();
+    }
+private:
+    struct Pool{
+        std::mutex mtx_;
+        std::condition_variable cv_;
+        bool is_closed_ = false;
+        std::queue<std::function<void()>> tasks_;
+    };
+    std::shared_ptr<Pool> pool_;
+};
+
+/// 模拟一次请求处理中的少量计算
+static void Work(atomic<size_t> &done) {
+    volatile uint64_t x = 0;
+    for(int i=0; i<64; ++i){
+        x = x + i;
+    }
+    done.fetch_add(1, memory_order_relaxed);
+}
+
+static constexpr size_t kBatch = 64;
+
+/// \return 每秒完成的任务数
+static double RunBatch(int threads, size_t tasks, int producers) {
+    atomic<size_t> done{0};
+    ThreadPool pool(threads);
+    auto start = chrono::steady_clock::now();
+    vector<thread> submitters;
+    for(int p=0; p<producers; ++p){
+        submitters.emplace_back([&, p]{
+            size_t begin = tasks * p / producers, end = tasks * (p + 1) / producers;
+            vector<ThreadPool::Task> batch;
+            batch.reserve(kBatch);
+            for(size_t i=begin; i<end; ++i){
+                batch.emplace_back([&done]{ Work(done);});
+                if(batch.size() == kBatch || i + 1 == end){
+                    pool.AddTasks(batch.data(), batch.size());
+                    batch.clear();
+                }
+            }
+        });
+    }
+    for(auto &submitter: submitters){
+        submitter.join();
+    }
+    while(done.load(memory_order_relaxed) < tasks){
+        this_thread::yield();
+    }
+    chrono::duration<double> cost = chrono::steady_clock::now() - start;
+    return tasks / cost.count();
+}
+
+/// \return 每秒完成的任务数
+template<typename Pool>
+static double Run(int threads, size_t tasks, int producers) {
+    atomic<size_t> done{0};
+    Pool pool(threads);
+    auto start = chrono::steady_clock::now();
+    vector<thread> submitters;
+    for(int p=0; p<producers; ++p){
+        submitters.emplace_back([&, p]{
+            size_t begin = tasks * p / producers, end = tasks * (p + 1) / producers;
+            for(size_t i=begin; i<end; ++i){
+                pool.AddTask([&done]{ Work(done);});
+            }
+        });
+    }
+    for(auto &submitter: submitters){
+        submitter.join();
+    }
+    while(done.load(memory_order_relaxed) < tasks){
+        this_thread::yield();
+    }
+    chrono::duration<double> cost = chrono::steady_clock::now() - start;
+    return tasks / cost.count();
+}
+
+/// 一组cache miss计数器，计数包括之后创建的线程
+class CacheCounters {
+public:
+    CacheCounters() {
+        fds_[0] = Open_(PERF_COUNT_HW_CACHE_L1D);
+        fds_[1] = Open_(PERF_COUNT_HW_CACHE_LL);
+    }
+    ~CacheCounters() {
+        for(int fd: fds_){
+            if(fd >= 0){
+                close(fd);
+            }
+        }
+    }
+    void Start() {
+        for(int fd: fds_){
+            if(fd >= 0){
+                ioctl(fd, PERF_EVENT_IOC_RESET, 0);
+                ioctl(fd, PERF_EVENT_IOC_ENABLE, 0);
+            }
+        }
+    }
+    /// 子线程退出后计数才并入，需在线程join之后调用
+    void Stop(int64_t *l1d, int64_t *llc) {
+        int64_t *out[2] = {l1d, llc};
+        for(int i=0; i<2; ++i){
+            uint64_t value = 0;
+            if(fds_[i] < 0 || ioctl(fds_[i], PERF_EVENT_IOC_DISABLE, 0) != 0 ||
+               read(fds_[i], &value, sizeof(value)) != sizeof(value)){
+                *out[i] = -1;
+            }else{
+                *out[i] = static_cast<int64_t>(value);
+            }
+        }
+    }
+private:
+    static int Open_(uint64_t cache) {
+        perf_event_attr attr;
+        memset(&attr, 0, sizeof(attr));
+        attr.size = sizeof(attr);
+        attr.type = PERF_TYPE_HW_CACHE;
+        attr.config = cache | (PERF_COUNT_HW_CACHE_OP_READ << 8) | (PERF_COUNT_HW_CACHE_RESULT_MISS << 16);
+        attr.disabled = 1;
+        attr.inherit = 1;
+        attr.exclude_kernel = 1;
+        attr.exclude_hv = 1;
+        return static_cast<int>(syscall(SYS_perf_event_open, &attr, 0, -1, -1, 0));
+    }
+
+    int fds_[2];
+};
+
+static constexpr size_t kConns = 256;
+static constexpr size_t kConnStateBytes = 8192;
+
+struct AffinityResult{
+    double rate;
+    int64_t l1d_miss;
+    int64_t llc_miss;
+};
+
+/// 模拟处理一个连接的读/写：读写该连接的每条cache line
+/// 同一连接可能被两个线程同时处理（Steal），用relaxed原子访问避免数据竞争
+static void TouchConn(uint64_t *state, atomic<size_t> &done) {
+    for(size_t i=0; i<kConnStateBytes / sizeof(uint64_t); i+=8){
+        atomic_ref<uint64_t> word(state[i]);
+        word.store(word.load(memory_order_relaxed) + 1, memory_order_relaxed);
+    }
+    done.fetch_add(1, memory_order_relaxed);
+}
+
+/// 各producer负责一部分连接，按kBatch个一批提交，key为连接号
+static AffinityResult RunAffinity(int threads, size_t tasks, int producers, SchedType sched_type, bool pin_cpu) {
+    vector<uint64_t> states(kConns * kConnStateBytes / sizeof(uint64_t));
+    atomic<size_t> done{0};
+    CacheCounters counters;
+    counters.Start();
+    auto start = chrono::steady_clock::now();
+    {
+        ThreadPool pool(threads, sched_type, pin_cpu);
+        vector<thread> submitters;
+        for(int p=0; p<producers; ++p){
+            submitters.emplace_back([&, p]{
+                size_t begin = tasks * p / producers, end = tasks * (p + 1) / producers;
+                vector<ThreadPool::Task> batch;
+                vector<size_t> keys;
+                batch.reserve(kBatch);
+                keys.reserve(kBatch);
+                for(size_t i=begin; i<end; ++i){
+                    size_t conn = (i * 7919) % kConns;  // 打散，相邻任务不属于同一连接
+                    uint64_t *state = &states[conn * kConnStateBytes / sizeof(uint64_t)];
+                    batch.emplace_back([state, &done]{ TouchConn(state, done);});
+                    keys.push_back(conn);
+                    if(batch.size() == kBatch || i + 1 == end){
+                        pool.AddTasks(batch.data(), keys.data(), batch.size());
+                        batch.clear();
+                        keys.clear();
+                    }
+                }
+            });
+        }
+        for(auto &submitter: submitters){
+            submitter.join();
+        }
+        while(done.load(memory_order_relaxed) < tasks){
+            this_thread::yield();
+        }
+    }  // 工作线程退出后计数并入
+    chrono::duration<double> cost = chrono::steady_clock::now() - start;
+    AffinityResult result{tasks / cost.count(), 0, 0};
+    counters.Stop(&result.l1d_miss, &result.llc_miss);
+    return result;
+}
+
+static void PrintMiss(int64_t miss, size_t tasks) {
+    if(miss < 0){
+        printf(" %14s", "n/a");
+    }else{
+        printf(" %14.1f", static_cast<double>(miss) / tasks);
+    }
+}
+
+int main(int argc, char **argv) {
+    size_t tasks = argc > 1 ? strtoul(argv[1], nullptr, 10) : 500000;
+    int producers = argc > 2 ? atoi(argv[2]) : 2;
+    printf("%zu tasks, %d producers, %u cpus\n", tasks, producers, thread::hardware_concurrency());
+    printf("%8s %16s %16s %16s %10s\n", "threads", "legacy task/s", "stealing task/s", "batch task/s", "speedup");
+    for(int threads: {1, 2, 4, 8, 16, 32, 64}){
+        double legacy = Run<LegacyThreadPool>(threads, tasks, producers);
+        double stealing = Run<ThreadPool>(threads, tasks, producers);
+        double batch = RunBatch(threads, tasks, producers);
+        printf("%8d %16.0f %16.0f %16.0f %9.2fx\n", threads, legacy, stealing, batch, batch / legacy);
+    }
+
+    int threads = max(2, static_cast<int>(thread::hardware_concurrency()));
+    printf("\nconnection affinity: %d threads, %zu conns x %zu bytes\n", threads, kConns, kConnStateBytes);
+    printf("%12s %14s %14s %14s\n", "sched", "task/s", "L1D miss/task", "LLC miss/task");
+    struct {const char *name; SchedType sched_type; bool pin_cpu;} modes[] = {
+        {"steal", SchedType::Steal, false},
+        {"affine", SchedType::Affine, false},
+        {"affine+pin", SchedType::Affine, true},
+    };
+    for(auto &mode: modes){
+        AffinityResult result = RunAffinity(threads, tasks, producers, mode.sched_type, mode.pin_cpu);
+        printf("%12s %14.0f", mode.name, result.rate);
+        PrintMiss(result.l1d_miss, tasks);
+        PrintMiss(result.llc_miss, tasks);
+        printf("\n");
+    }
+    return 0;
+}
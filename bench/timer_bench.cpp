@@ -0,0 +1,239 @@
+//
+// Created by 98302 on 2023/10/20.
+//
+
+#include <chrono>
+#include <cstdio>
+#include <cstdlib>
+#include <memory>
+#include <random>
+#include <vector>
+#include <algorithm>
+#include <malloc.h>
+#include <poll.h>
+#include <time.h>
+#include "../src/timer/HeapTimer.h"
+#include "../src/timer/LoopTimer.h"
+#include "../src/timer/WheelTimer.h"
+
+/*
+ * 定时器基准与压力测试，通过Timer接口驱动HeapTimer、LoopTimer、WheelTimer
+ * 每种定时器、每个规模（10^3 ~ max_timers）依次：
+ *      add     添加n个定时器，超时在[timeout, 2*timeout)毫秒内均匀分布（模拟新连接）
+ *      churn   n次操作：90% Adjust（keep-alive请求续期），10% Cancel+Add（连接关闭，fd被新连接复用）
+ *      expire  按event loop的方式 GetNextTick → poll等待 → 处理，直到全部到期或超过最晚到期时间1秒
+ * 输出：
+ *      吞吐：add与churn阶段每秒操作数（不计时的操作）
+ *      延迟：每kSampleEvery个操作单独计时一次，取p50/p99（已扣除计时本身的开销）
+ *      内存：add与churn之后的堆增量/定时器数；WheelTimer的节点在使用方（连接槽）中，另加sizeof(WheelNode)
+ *      精度：实际触发时刻 - 要求的到期时刻，p50/p99/max，提前触发计数，到期阶段结束时的触发比例
+ *      空闲开销：到期阶段的唤醒次数与CPU时间
+ * 用法：timer_bench [max_timers] [timeout_ms]
+ */
+
+using namespace std;
+
+static constexpr size_t kSampleEvery = 16;
+
+static int64_t NowNs() {
+    return chrono::duration_cast<chrono::nanoseconds>(Clock::now().time_since_epoch()).count();
+}
+
+static double CpuMs() {
+    timespec ts{};
+    clock_gettime(CLOCK_PROCESS_CPUTIME_ID, &ts);
+    return ts.tv_sec * 1e3 + ts.tv_nsec / 1e6;
+}
+
+static size_t HeapBytes() {
+    return mallinfo2().uordblks;
+}
+
+static double Percentile(vector<double> &values, double p) {
+    if(values.empty()){
+        return 0;
+    }
+    size_t k = min(values.size() - 1, static_cast<size_t>(values.size() * p));
+    nth_element(values.begin(), values.begin() + k, values.end());
+    return values[k];
+}
+
+/// 一次Clock::now()的开销，从单次计时中扣除
+static double TimingOverheadNs() {
+    vector<double> samples;
+    for(int i=0; i<10000; ++i){
+        int64_t begin = NowNs();
+        samples.push_back(NowNs() - begin);
+    }
+    return Percentile(samples, 0.5);
+}
+
+/// 定时器回调写入的状态，回调只捕获指针与id，std::function不分配
+struct Context{
+    vector<int64_t> due_ns;  // 要求的到期时刻
+    vector<int64_t> fire_ns;  // 实际触发时刻，0为未触发
+    vector<char> live;  // 已添加、未取消、未触发
+    bool recording = true;  // 析构定时器时触发的回调不计入
+};
+
+struct Result{
+    double add_rate, add_p50, add_p99;
+    double churn_rate, adjust_p50, adjust_p99;
+    double add_bytes, churn_bytes;
+    double fired_ratio, late_p50, late_p99, late_max;
+    size_t early;
+    size_t wakeups;
+    double expire_cpu_ms;
+};
+
+static unique_ptr<Timer> MakeTimer(TimerType type, vector<WheelNode> &nodes) {
+    switch(type){
+        case TimerType::Heap:
+            return make_unique<HeapTimer>();
+        case TimerType::Loop:
+            return make_unique<LoopTimer>();
+        case TimerType::Wheel:
+        default:
+            return make_unique<WheelTimer>([&nodes](int id){ return &nodes[id];});
+    }
+}
+
+static Result Run(TimerType type, size_t n, int timeout_ms, double overhead_ns) {
+    Result result{};
+    Context ctx;
+    ctx.due_ns.assign(n, 0);
+    ctx.fire_ns.assign(n, 0);
+    ctx.live.assign(n, 0);
+    vector<WheelNode> nodes(type == TimerType::Wheel ? n : 0, WheelNode{{nullptr, nullptr}, 0, nullptr});
+    mt19937 rng(12345);
+    vector<int> timeouts(n);
+    for(auto &t: timeouts){
+        t = timeout_ms + static_cast<int>(rng() % timeout_ms);
+    }
+    Context *c = &ctx;
+    auto add = [&](Timer &timer, int id, int time_out){
+        ctx.due_ns[id] = NowNs() + time_out * 1000000LL;
+        ctx.live[id] = 1;
+        timer.Add(id, time_out, [c, id]{
+            if(c->recording){
+                c->fire_ns[id] = NowNs();
+                c->live[id] = 0;
+            }
+        });
+    };
+
+    size_t heap_before = HeapBytes();
+    auto timer = MakeTimer(type, nodes);
+    size_t intrusive = type == TimerType::Wheel ? sizeof(WheelNode) : 0;
+
+    // add
+    vector<double> samples;
+    samples.reserve(n / kSampleEvery + 1);
+    int64_t begin = NowNs();
+    for(size_t i=0; i<n; ++i){
+        if(i % kSampleEvery == 0){
+            int64_t op_begin = NowNs();
+            add(*timer, static_cast<int>(i), timeouts[i]);
+            samples.push_back(NowNs() - op_begin - overhead_ns);
+        }else{
+            add(*timer, static_cast<int>(i), timeouts[i]);
+        }
+    }
+    result.add_rate = n / ((NowNs() - begin) / 1e9);
+    result.add_p50 = Percentile(samples, 0.5);
+    result.add_p99 = Percentile(samples, 0.99);
+    result.add_bytes = static_cast<double>(HeapBytes() - heap_before) / n + intrusive;
+
+    // churn：只操作仍在计时的id（HeapTimer/LoopTimer的Adjust要求id存在）
+    samples.clear();
+    begin = NowNs();
+    for(size_t i=0; i<n; ++i){
+        int id = static_cast<int>(rng() % n);
+        if(!ctx.live[id]){
+            continue;
+        }
+        int time_out = timeout_ms + static_cast<int>(rng() % timeout_ms);
+        bool sample = i % kSampleEvery == 0;
+        int64_t op_begin = sample ? NowNs() : 0;
+        if(rng() % 10 == 0){  // 连接关闭，同一fd接入新连接
+            timer->Cancel(id);
+            add(*timer, id, time_out);
+        }else{
+            ctx.due_ns[id] = NowNs() + time_out * 1000000LL;
+            timer->Adjust(id, time_out);
+        }
+        if(sample){
+            samples.push_back(NowNs() - op_begin - overhead_ns);
+        }
+    }
+    result.churn_rate = n / ((NowNs() - begin) / 1e9);
+    result.adjust_p50 = Percentile(samples, 0.5);
+    result.adjust_p99 = Percentile(samples, 0.99);
+    result.churn_bytes = static_cast<double>(HeapBytes() - heap_before) / n + intrusive;
+
+    // expire
+    int64_t last_due = *max_element(ctx.due_ns.begin(), ctx.due_ns.end());
+    int64_t give_up = last_due + 1000000000LL;
+    double cpu_begin = CpuMs();
+    while(NowNs() < give_up){
+        int next = timer->GetNextTick();
+        if(next < 0 && all_of(ctx.live.begin(), ctx.live.end(), [](char live){ return !live;})){
+            break;
+        }
+        int64_t remain_ms = (give_up - NowNs()) / 1000000 + 1;
+        poll(nullptr, 0, next < 0 ? 1 : static_cast<int>(min<int64_t>(next, remain_ms)));  // 不给出到期时刻的定时器每毫秒轮询
+        ++result.wakeups;
+    }
+    result.expire_cpu_ms = CpuMs() - cpu_begin;
+    ctx.recording = false;
+
+    vector<double> late;
+    for(size_t i=0; i<n; ++i){
+        if(ctx.fire_ns[i] == 0){
+            continue;
+        }
+        double ms = (ctx.fire_ns[i] - ctx.due_ns[i]) / 1e6;
+        result.early += ms < 0;
+        late.push_back(ms);
+    }
+    result.fired_ratio = static_cast<double>(late.size()) / n;
+    result.late_p50 = Percentile(late, 0.5);
+    result.late_p99 = Percentile(late, 0.99);
+    result.late_max = late.empty() ? 0 : *max_element(late.begin(), late.end());
+    timer.reset();
+    return result;
+}
+
+int main(int argc, char **argv) {
+    size_t max_timers = argc > 1 ? strtoul(argv[1], nullptr, 10) : 1000000;
+    int timeout_ms = argc > 2 ? atoi(argv[2]) : 500;
+    double overhead = TimingOverheadNs();
+    printf("timeouts in [%d, %d) ms, clock overhead %.0f ns subtracted from per-op samples\n",
+           timeout_ms, 2 * timeout_ms, overhead);
+    printf("%6s %8s | %9s %7s %7s | %9s %7s %7s | %8s %8s | %6s %7s %7s %8s %6s | %7s %8s\n",
+           "timer", "timers",
+           "add op/s", "p50 ns", "p99 ns",
+           "churn/s", "p50 ns", "p99 ns",
+           "B/timer", "B/churn",
+           "fired", "p50 ms", "p99 ms", "max ms", "early",
+           "wakeups", "cpu ms");
+    struct {const char *name; TimerType type;} timers[] = {
+        {"heap", TimerType::Heap},
+        {"loop", TimerType::Loop},
+        {"wheel", TimerType::Wheel},
+    };
+    for(size_t n=1000; n<=max_timers; n*=10){
+        for(auto &timer: timers){
+            Result r = Run(timer.type, n, timeout_ms, overhead);
+            printf("%6s %8zu | %9.0f %7.0f %7.0f | %9.0f %7.0f %7.0f | %8.1f %8.1f | %5.1f%% %7.2f %7.2f %8.2f %6zu | %7zu %8.1f\n",
+                   timer.name, n,
+                   r.add_rate, r.add_p50, r.add_p99,
+                   r.churn_rate, r.adjust_p50, r.adjust_p99,
+                   r.add_bytes, r.churn_bytes,
+                   r.fired_ratio * 100, r.late_p50, r.late_p99, r.late_max, r.early,
+                   r.wakeups, r.expire_cpu_ms);
+            fflush(stdout);
+        }
+    }
+    return 0;
+}
@@ -5,8 +5,10 @@ create database webserver;
 USE webserver;
 CREATE TABLE user(
                      username char(50) NULL,
-                     password char(50) NULL
+                     password char(50) NULL,
+                     UNIQUE KEY uk_username(username)
 )ENGINE=InnoDB;
+// 已有的表：ALTER TABLE user ADD UNIQUE KEY uk_username(username);
 
 // 添加数据
 INSERT INTO user(username, password) VALUES('name', 'password');
\ No newline at end of file
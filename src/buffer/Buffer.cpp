@@ -149,7 +149,7 @@ const char *Buffer::BeginPtr_() const {
 /// 扩容
 /// \param len
 void Buffer::MakeSpace_(size_t len) {
-    if(ReadableBytes() + PrependableBytes() < len){  // 预留空间不足
+    if(WritableBytes() + PrependableBytes() < len){  // 预留空间不足
         buffer_.resize(write_pos_+len+1);
     }else{  // 使用预留空间
         size_t readable = ReadableBytes();
@@ -0,0 +1,317 @@
+//
+// Created by 98302 on 2023/10/16.
+//
+
+#include "FileCache.h"
+#include <sys/mman.h>
+#include <sys/inotify.h>
+#include <sys/eventfd.h>
+#include <fcntl.h>
+#include <unistd.h>
+#include <dirent.h>
+#include <poll.h>
+#include <cstring>
+#include "../log/Log.h"
+
+using namespace std;
+
+FileEntry::~FileEntry() {
+    for(auto &block: header_blocks){
+        delete block.load(memory_order_relaxed);
+    }
+    if(data){
+        munmap(data, size);
+    }
+    if(fd >= 0){
+        close(fd);
+    }
+}
+
+FileCache::FileCache(): enabled_(false), shard_budget_(kDefaultBudget / kShardCount), hits_(0), misses_(0),
+                        inotify_fd_(-1), stop_fd_(-1) {}
+
+FileCache::~FileCache() {
+    Close();
+}
+
+FileCache *FileCache::Instance() {
+    static FileCache cache;
+    return &cache;
+}
+
+/// 启动对root的监视，开始缓存
+/// \param root 静态资源根目录
+/// \param budget 映射字节数上限
+void FileCache::Init(const std::string &root, size_t budget) {
+    Close();
+    root_ = Normalize_(root + "/");
+    shard_budget_ = budget / kShardCount;
+    inotify_fd_ = inotify_init1(IN_NONBLOCK | IN_CLOEXEC);
+    stop_fd_ = eventfd(0, EFD_NONBLOCK | EFD_CLOEXEC);
+    if(inotify_fd_ < 0 || stop_fd_ < 0){
+        LOG_ERROR("FileCache inotify init error! caching disabled");
+        Close();
+        return;
+    }
+    AddWatch_(root_);
+    InvalidateAll();
+    watch_thread_ = make_unique<thread>(&FileCache::WatchThread_, this);
+    enabled_ = true;
+    LOG_INFO("FileCache: root %s, budget %zu bytes, %zu dirs watched", root_.c_str(), budget, watch_dirs_.size());
+}
+
+/// 停止监视并清空缓存，已被引用的项在引用释放后回收
+void FileCache::Close() {
+    enabled_ = false;
+    if(watch_thread_){
+        uint64_t one = 1;
+        ssize_t ret = write(stop_fd_, &one, sizeof(one));
+        (void)ret;
+        watch_thread_->join();
+        watch_thread_ = nullptr;
+    }
+    if(inotify_fd_ >= 0){
+        close(inotify_fd_);
+        inotify_fd_ = -1;
+    }
+    if(stop_fd_ >= 0){
+        close(stop_fd_);
+        stop_fd_ = -1;
+    }
+    watch_dirs_.clear();
+    InvalidateAll();
+}
+
+/// 取文件，未命中时stat/open/mmap并放入缓存
+/// \param path 完整路径
+/// \return 不存在、不是普通文件、打开失败或在根目录之外时为nullptr
+FileEntryPtr FileCache::Get(const std::string &path) {
+    string key = Normalize_(path);
+    if(key.empty() || (!root_.empty() && !key.starts_with(root_))){  // 越出根目录
+        return nullptr;
+    }
+    if(!enabled_.load(memory_order_relaxed)){
+        return Load_(key);
+    }
+    Shard &shard = ShardOf_(key);
+    uint64_t generation;
+    {
+        lock_guard<mutex> locker(shard.mtx);
+        auto it = shard.index.find(key);
+        if(it != shard.index.end()){
+            shard.lru.splice(shard.lru.begin(), shard.lru, it->second);
+            hits_.fetch_add(1, memory_order_relaxed);
+            return it->second->second;
+        }
+        generation = shard.generation;
+    }
+    misses_.fetch_add(1, memory_order_relaxed);
+    FileEntryPtr entry = Load_(key);
+    if(!entry || entry->size > shard_budget_){
+        return entry;
+    }
+    lock_guard<mutex> locker(shard.mtx);
+    if(shard.generation != generation){  // 加载期间有失效，结果可能已过期，不入缓存
+        return entry;
+    }
+    auto it = shard.index.find(key);
+    if(it != shard.index.end()){  // 其他线程已加载
+        return it->second->second;
+    }
+    shard.lru.emplace_front(key, entry);
+    shard.index.emplace(std::move(key), shard.lru.begin());
+    shard.bytes += entry->size;
+    Evict_(shard);
+    return entry;
+}
+
+void FileCache::Invalidate(const std::string &path) {
+    string key = Normalize_(path);
+    Shard &shard = ShardOf_(key);
+    lock_guard<mutex> locker(shard.mtx);
+    ++shard.generation;
+    auto it = shard.index.find(key);
+    if(it != shard.index.end()){
+        shard.bytes -= it->second->second->size;
+        shard.lru.erase(it->second);
+        shard.index.erase(it);
+    }
+}
+
+void FileCache::InvalidateAll() {
+    for(auto &shard: shards_){
+        lock_guard<mutex> locker(shard.mtx);
+        ++shard.generation;
+        shard.index.clear();
+        shard.lru.clear();
+        shard.bytes = 0;
+    }
+}
+
+size_t FileCache::Bytes() const {
+    size_t bytes = 0;
+    for(auto &shard: shards_){
+        lock_guard<mutex> locker(shard.mtx);
+        bytes += shard.bytes;
+    }
+    return bytes;
+}
+
+/// 从LRU尾部淘汰，直到不超过分片预算
+/// \param shard 调用方已加锁
+void FileCache::Evict_(FileCache::Shard &shard) {
+    while(shard.bytes > shard_budget_ && !shard.lru.empty()){
+        auto &victim = shard.lru.back();
+        shard.bytes -= victim.second->size;
+        shard.index.erase(victim.first);
+        shard.lru.pop_back();
+    }
+}
+
+FileEntryPtr FileCache::Load_(const std::string &path) {
+    auto entry = make_shared<FileEntry>();
+    if(stat(path.data(), &entry->st) < 0 || !S_ISREG(entry->st.st_mode)){
+        return nullptr;
+    }
+    if(!(entry->st.st_mode & S_IROTH)){  // 不可读，只保存stat结果
+        return entry;
+    }
+    entry->fd = open(path.data(), O_RDONLY | O_CLOEXEC);
+    if(entry->fd < 0 || fstat(entry->fd, &entry->st) < 0){
+        return nullptr;
+    }
+    entry->size = entry->st.st_size;
+    if(entry->size > 0){
+        // 文件映射，避免内核拷贝到用户
+        void *ptr = mmap(nullptr, entry->size, PROT_READ, MAP_PRIVATE, entry->fd, 0);
+        if(ptr != MAP_FAILED){
+            entry->data = static_cast<char*>(ptr);
+        }
+    }
+    return entry;
+}
+
+/// 按字面规范化：合并重复的'/'（src_dir以'/'结尾而请求路径以'/'开头），去掉"."，".."与上一级抵消
+/// 不解析符号链接，与inotify报告的路径（监视目录 + 文件名）一致
+/// \param path
+/// \return ".."越过最上层时为空
+std::string FileCache::Normalize_(const std::string &path) {
+    if(path.find("//") == string::npos && path.find("/.") == string::npos){
+        return path;
+    }
+    string result;
+    result.reserve(path.size());
+    size_t pos = 0;
+    while(pos <= path.size()){
+        size_t end = min(path.find('/', pos), path.size());
+        string_view part(path.data() + pos, end - pos);
+        if(part == ".."){
+            size_t slash = result.find_last_of('/');
+            if(slash == string::npos || result.empty()){
+                return "";
+            }
+            result.resize(slash);
+        }else if(!part.empty() && part != "."){
+            if(!result.empty() || path[0] == '/'){
+                result.push_back('/');
+            }
+            result.append(part);
+        }
+        pos = end + 1;
+    }
+    if(path.back() == '/' || path.ends_with("/.") || path.ends_with("/..")){
+        result.push_back('/');
+    }
+    return result;
+}
+
+/// 监视dir及其子目录
+/// \param dir 以'/'结尾
+void FileCache::AddWatch_(const std::string &dir) {
+    const uint32_t mask = IN_MODIFY | IN_CLOSE_WRITE | IN_ATTRIB | IN_CREATE | IN_DELETE |
+                          IN_MOVED_FROM | IN_MOVED_TO | IN_DELETE_SELF | IN_MOVE_SELF | IN_ONLYDIR;
+    int wd = inotify_add_watch(inotify_fd_, dir.c_str(), mask);
+    if(wd < 0){
+        LOG_WARN("FileCache watch %s error: %s", dir.c_str(), strerror(errno));
+        return;
+    }
+    watch_dirs_[wd] = dir;
+    DIR *dp = opendir(dir.c_str());
+    if(!dp){
+        return;
+    }
+    while(dirent *ent = readdir(dp)){
+        if(strcmp(ent->d_name, ".") == 0 || strcmp(ent->d_name, "..") == 0){
+            continue;
+        }
+        string sub = dir + ent->d_name;
+        struct stat st{};
+        if(ent->d_type == DT_DIR || (ent->d_type == DT_UNKNOWN && stat(sub.c_str(), &st) == 0 && S_ISDIR(st.st_mode))){
+            AddWatch_(sub + "/");
+        }
+    }
+    closedir(dp);
+}
+
+void FileCache::WatchThread_() {
+    struct pollfd fds[2] = {{inotify_fd_, POLLIN, 0}, {stop_fd_, POLLIN, 0}};
+    alignas(inotify_event) char events[4096];
+    while(true){
+        if(poll(fds, 2, -1) < 0){
+            if(errno == EINTR){
+                continue;
+            }
+            break;
+        }
+        if(fds[1].revents){  // Close
+            break;
+        }
+        ssize_t len = read(inotify_fd_, events, sizeof(events));
+        if(len > 0){
+            HandleEvents_(events, len);
+        }
+    }
+}
+
+/// 处理一批inotify事件
+/// 文件变化使该文件失效；目录移动/删除时其下路径全部改变，全部失效；新建目录加入监视
+/// \param events
+/// \param len
+void FileCache::HandleEvents_(const char *events, ssize_t len) {
+    for(const char *p = events; p < events + len; ){
+        auto event = reinterpret_cast<const inotify_event*>(p);
+        p += sizeof(inotify_event) + event->len;
+        if(event->mask & IN_Q_OVERFLOW){  // 事件丢失
+            InvalidateAll();
+            continue;
+        }
+        auto it = watch_dirs_.find(event->wd);
+        if(it == watch_dirs_.end()){
+            continue;
+        }
+        if(event->mask & IN_IGNORED){  // 监视已移除
+            watch_dirs_.erase(it);
+            continue;
+        }
+        if(event->mask & (IN_DELETE_SELF | IN_MOVE_SELF)){  // 监视的目录被删除/移走，旧路径作废
+            inotify_rm_watch(inotify_fd_, event->wd);
+            InvalidateAll();
+            continue;
+        }
+        if(event->len == 0){
+            continue;
+        }
+        string path = it->second + event->name;
+        if(event->mask & IN_ISDIR){
+            if(event->mask & (IN_CREATE | IN_MOVED_TO)){
+                AddWatch_(path + "/");
+            }
+            if(event->mask & (IN_MOVED_FROM | IN_MOVED_TO)){
+                InvalidateAll();
+            }
+            continue;
+        }
+        LOG_DEBUG("FileCache invalidate %s", path.c_str());
+        Invalidate(path);
+    }
+}
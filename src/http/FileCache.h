@@ -0,0 +1,110 @@
+//
+// Created by 98302 on 2023/10/16.
+//
+
+#ifndef WEB_SERVER_FILECACHE_H
+#define WEB_SERVER_FILECACHE_H
+
+#include <sys/stat.h>
+#include <string>
+#include <memory>
+#include <mutex>
+#include <list>
+#include <unordered_map>
+#include <atomic>
+#include <thread>
+
+/*
+ * 预生成的响应头（状态行至空行），date_offset处为29字节的Date值，发送时按当前时间覆盖
+ */
+struct HeaderBlock{
+    std::string bytes;
+    size_t date_offset;
+};
+
+/*
+ * 静态文件缓存项，创建后只读
+ * 持有文件的stat结果、只读fd（sendfile）与只读映射（writev）
+ * 不可读（无S_IROTH）的文件只保存stat结果
+ * header_blocks由HttpResponse按(状态码, keep-alive)首次使用时生成，之后只读，随缓存项一起失效
+ * 最后一个引用释放时取消映射、关闭fd；被缓存淘汰/失效的项在仍被响应引用时继续有效
+ */
+struct FileEntry{
+    FileEntry() = default;
+    ~FileEntry();
+    FileEntry(const FileEntry&) = delete;
+    FileEntry &operator=(const FileEntry&) = delete;
+
+    static constexpr size_t kHeaderBlockSlots = 8;
+
+    struct stat st{};
+    int fd = -1;
+    char *data = nullptr;  // 空文件或映射失败时为nullptr
+    size_t size = 0;
+    mutable std::atomic<const HeaderBlock*> header_blocks[kHeaderBlockSlots]{};
+};
+using FileEntryPtr = std::shared_ptr<const FileEntry>;
+
+/*
+ * 进程级静态文件缓存
+ * 单例模式
+ * 以规范化（合并重复'/'、去掉"."与".."）后的完整路径为键，按键哈希分为kShardCount个分片，每个分片独立加锁
+ * 规范化后不在根目录之下的路径（"../"越界）直接视为不存在
+ * 每个分片按LRU淘汰，映射字节数超过分片预算时从尾部淘汰；超过分片预算的大文件不入缓存，用完即释放
+ * 监视线程通过inotify递归监视根目录，文件修改/删除/移动时使对应项失效
+ * 没有失效机制就不能缓存，Init成功启动监视前Get不缓存任何项
+ * 加载与失效并发时以分片代数判定，加载期间发生过失效的结果不入缓存
+ */
+class FileCache {
+public:
+    static FileCache *Instance();
+
+    void Init(const std::string &root, size_t budget = kDefaultBudget);
+    void Close();
+
+    FileEntryPtr Get(const std::string &path);
+    void Invalidate(const std::string &path);
+    void InvalidateAll();
+
+    size_t Hits() const {return hits_;}
+    size_t Misses() const {return misses_;}
+    size_t Bytes() const;
+
+    static constexpr size_t kDefaultBudget = 64 * 1024 * 1024;
+    static constexpr size_t kShardCount = 16;
+private:
+    FileCache();
+    ~FileCache();
+
+    struct Shard{
+        mutable std::mutex mtx;
+        std::list<std::pair<std::string, FileEntryPtr>> lru;  // 头部最近使用
+        std::unordered_map<std::string, std::list<std::pair<std::string, FileEntryPtr>>::iterator> index;
+        size_t bytes = 0;
+        uint64_t generation = 0;  // 每次失效递增
+    };
+
+    Shard &ShardOf_(const std::string &key) {return shards_[std::hash<std::string>{}(key) % kShardCount];}
+    void Evict_(Shard &shard);
+    static FileEntryPtr Load_(const std::string &path);
+    static std::string Normalize_(const std::string &path);
+
+    void WatchThread_();
+    void AddWatch_(const std::string &dir);
+    void HandleEvents_(const char *events, ssize_t len);
+
+    Shard shards_[kShardCount];
+    std::atomic<bool> enabled_;
+    size_t shard_budget_;
+    std::atomic<size_t> hits_;
+    std::atomic<size_t> misses_;
+
+    std::string root_;
+    int inotify_fd_;
+    int stop_fd_;  // eventfd，通知监视线程退出
+    std::unordered_map<int, std::string> watch_dirs_;  // wd => 目录（以'/'结尾），仅监视线程访问
+    std::unique_ptr<std::thread> watch_thread_;
+};
+
+
+#endif //WEB_SERVER_FILECACHE_H
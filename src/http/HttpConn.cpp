@@ -3,17 +3,22 @@
 //
 
 #include "HttpConn.h"
+#include <sys/sendfile.h>
 
 using namespace std;
 
 const char* HttpConn::src_dir;
 atomic<int> HttpConn::user_count;
 bool HttpConn::is_et;
+SendStrategy HttpConn::send_strategy = SendStrategy::Mmap;
 
 HttpConn::HttpConn() {
     fd_ = -1;
     addr_ = {0};
     is_closed_ = true;
+    segment_head_ = 0;
+    to_write_ = 0;
+    db_state_ = DbState::kNone;
 }
 
 HttpConn::~HttpConn() {
@@ -27,6 +32,8 @@ void HttpConn::Init(int sock_fd, const sockaddr_in &addr) {
     fd_ = sock_fd;
     write_buffer_.RetrieveAll();
     read_buffer_.RetrieveAll();
+    request_.Init();
+    db_state_ = DbState::kNone;
     is_closed_ = false;
     LOG_INFO("Client[%d](%s:%d) in, userCount:%d", fd_, GetIP(), GetPort(), (int)user_count);
 }
@@ -45,37 +52,64 @@ ssize_t HttpConn::Read(int *save_errno) {
     return len;
 }
 
-/// io向量写入socketfd
+/// 按序写出发送队列
+/// 从队首起收集响应头与映射的响应体合并为一次sendmsg，遇到sendfile响应体为止（该段响应头以MSG_MORE发送），
+/// 队首只剩sendfile响应体时sendfile发送
 /// \param save_errno
 /// \return 写入字节数，-1：没写入
 ssize_t HttpConn::Write(int *save_errno) {
     ssize_t len = -1;
     do {
-        len = writev(fd_, iov_, iov_cnt_);
-        if(len <= 0){
-            *save_errno = errno;
+        if(segment_head_ == segments_.size()){  // 无可写内容
             break;
         }
-        if(iov_[0].iov_len + iov_[1].iov_len == 0){  // 无可写内容
-            break;
-        }else if(static_cast<size_t>(len) > iov_[0].iov_len){
-            iov_[1].iov_base = (uint8_t*)iov_[1].iov_base+(len-iov_[0].iov_len);
-            iov_[1].iov_len -= (len - iov_[0].iov_len);
-            if(iov_[0].iov_len){
-                write_buffer_.RetrieveAll();
-                iov_[0].iov_len = 0;
+        Segment &front = segments_[segment_head_];
+        if(front.header_len == 0 && front.mm_sent == front.mm_len){  // 只剩sendfile响应体
+            len = sendfile(fd_, front.file->fd, &front.file_offset, front.file_remain);  // 内核从页缓存直接发送
+            if(len <= 0){
+                *save_errno = errno;
+                break;
             }
-        }else{
-            iov_[0].iov_base = (uint8_t*)iov_[0].iov_base+len;
-            iov_[0].iov_len -= len;
-            write_buffer_.Retrieve(len);
+            Consume_(len);
+            continue;
+        }
+        struct iovec iov[kMaxIov];
+        int iov_cnt = 0;
+        bool more = false;
+        const char *header = write_buffer_.Peek();
+        for(size_t i=segment_head_; i<segments_.size() && iov_cnt+2 <= kMaxIov; ++i){
+            Segment &segment = segments_[i];
+            if(segment.header_len > 0){
+                iov[iov_cnt++] = {const_cast<char*>(header), segment.header_len};
+                header += segment.header_len;
+            }
+            if(segment.mm_sent < segment.mm_len){
+                iov[iov_cnt++] = {segment.file->data + segment.mm_sent, segment.mm_len - segment.mm_sent};
+            }
+            if(segment.file_remain > 0){  // 后面紧跟sendfile，MSG_MORE避免响应头单独成包
+                more = true;
+                break;
+            }
+        }
+        struct msghdr msg{};
+        msg.msg_iov = iov;
+        msg.msg_iovlen = iov_cnt;
+        len = sendmsg(fd_, &msg, more ? MSG_MORE : 0);
+        if(len <= 0){
+            *save_errno = errno;
+            break;
         }
-    } while (is_et || ToWriteBytes() > 10240);
+        Consume_(len);
+    } while (ToWriteBytes() > 0 && (is_et || ToWriteBytes() > 10240));
     return len;
 }
 
 void HttpConn::Close() {
-    response_.UnmapFile();
+    response_.ReleaseFile();
+    segments_.clear();
+    segment_head_ = 0;
+    to_write_ = 0;
+    write_buffer_.RetrieveAll();
     if(!is_closed_){
         is_closed_ = true;
         user_count--;
@@ -84,38 +118,118 @@ void HttpConn::Close() {
     }
 }
 
-/// 读取读缓冲区，解析request，生成response，放入io向量待写入
-/// \return false:无可读内容，true：解析完成
+/// 读取读缓冲区，解析缓冲区中所有完整的request，按序生成response放入发送队列
+/// 请求分多次到达时，解析状态保留在request_中，每次只扫描新到达的数据
+/// \return false:无可读内容或请求未收全，true：至少生成了一个响应
 bool HttpConn::Process() {
-    request_.Init();
-    if(read_buffer_.ReadableBytes() <= 0){  // 无可读内容
-        return false;
-    }else if(request_.Parse(read_buffer_)){  // request解析成功
-        LOG_DEBUG("%s", request_.Path().data());
-        response_.Init(src_dir, request_.Path(), request_.IsKeepAlive(), 200);
-    }else{  // request解析失败
-        response_.Init(src_dir, request_.Path(), false, 400);
-    }
-    response_.MakeResponse(write_buffer_);
-    iov_[0].iov_base = const_cast<char*>(write_buffer_.Peek());  // 响应头
-    iov_[0].iov_len = write_buffer_.ReadableBytes();
-    iov_cnt_ = 1;
-    if(response_.FileLen() > 0 && response_.File()){  // 响应体
-        iov_[1].iov_base = response_.File();
-        iov_[1].iov_len = response_.FileLen();
-        iov_cnt_ = 2;
+    bool processed = false;
+    while(read_buffer_.ReadableBytes() > 0 && segments_.size() - segment_head_ < kMaxPipeline &&
+          db_state_ != DbState::kPending){
+        HttpParser::Status status;
+        int code = 200;
+        if(db_state_ == DbState::kNone){
+            status = request_.Parse(read_buffer_);
+            if(status == HttpParser::kComplete && request_.NeedsDb()){  // 交给调用方转入db通道，之后从这里继续
+                db_state_ = DbState::kPending;
+                break;
+            }
+        }else{  // 上次停下的请求已由db通道处理
+            status = HttpParser::kComplete;
+            code = db_state_ == DbState::kRejected ? 503 : 200;
+            db_state_ = DbState::kNone;
+        }
+        if(status == HttpParser::kIncomplete){  // 请求未收全，继续读
+            break;
+        }else if(status == HttpParser::kComplete){  // request解析成功
+            LOG_DEBUG("%s", request_.Path().data());
+            response_.Init(src_dir, request_.Path(), request_.IsKeepAlive(), code, send_strategy);
+            response_.SetCookie(request_.SetCookie());
+        }else{  // request解析失败，请求体过大时不读body直接断连
+            response_.Init(src_dir, request_.Path(), false, status == HttpParser::kTooLarge ? 413 : 400,
+                           send_strategy);
+        }
+        size_t header_begin = write_buffer_.ReadableBytes();
+        response_.MakeResponse(write_buffer_);
+        PushSegment_(write_buffer_.ReadableBytes() - header_begin);
+        processed = true;
+        // 请求处理完毕，取出已解析的请求，为下一个请求重置解析状态
+        if(status == HttpParser::kComplete){
+            read_buffer_.Retrieve(request_.Consumed());
+        }else{
+            read_buffer_.RetrieveAll();
+        }
+        request_.Init();
+        if(!response_.IsKeepAlive()){  // 响应后断连，之后的请求不再处理
+            break;
+        }
     }
-    LOG_DEBUG("filesize:%d, %d to %d", response_.FileLen(), iov_cnt_, ToWriteBytes());
-    return true;
+    LOG_DEBUG("%zu responses queued, %zu to write", segments_.size() - segment_head_, to_write_);
+    return processed;
 }
 
+/// 得出校验结果（loop线程、db或hash通道线程），以校验结果继续
+/// \param verified
+void HttpConn::ResolveDb(bool verified) {
+    assert(db_state_ == DbState::kPending);
+    request_.ResolveDb(verified);
+    db_state_ = DbState::kResolved;
+}
 
+/// db通道、hash通道或在途查询已满，数据库不可用，停下的请求响应503
+void HttpConn::RejectDb() {
+    assert(db_state_ == DbState::kPending);
+    db_state_ = DbState::kRejected;
+}
 
+/// 当前响应入队，响应体缓存项的引用转归发送队列
+/// \param header_len 本响应追加到write_buffer_的字节数
+void HttpConn::PushSegment_(size_t header_len) {
+    Segment segment{header_len, nullptr, 0, 0, 0, 0};
+    if(response_.FileLen() > 0){
+        segment.file = response_.GetFile();
+        if(send_strategy == SendStrategy::Sendfile){  // sendfile发送响应体
+            segment.file_remain = response_.FileLen();
+        }else{  // 映射的响应体
+            segment.mm_len = response_.FileLen();
+        }
+    }
+    response_.ReleaseFile();
+    to_write_ += segment.header_len + segment.mm_len + segment.file_remain;
+    segments_.push_back(segment);
+}
 
+/// 已写出len字节，按序推进发送队列
+/// \param len
+void HttpConn::Consume_(size_t len) {
+    to_write_ -= len;
+    while(len > 0){
+        Segment &front = segments_[segment_head_];
+        size_t n = min(len, front.header_len);
+        front.header_len -= n;
+        write_buffer_.Retrieve(n);
+        len -= n;
+        n = min(len, front.mm_len - front.mm_sent);
+        front.mm_sent += n;
+        len -= n;
+        if(front.file_remain > 0 && front.header_len == 0 && front.mm_sent == front.mm_len){
+            n = min(len, front.file_remain);  // sendfile已推进file_offset
+            front.file_remain -= n;
+            len -= n;
+        }
+        if(front.header_len == 0 && front.mm_sent == front.mm_len && front.file_remain == 0){
+            PopSegment_();
+        }else{
+            assert(len == 0);
+            break;
+        }
+    }
+}
 
-
-
-
-
-
-
+void HttpConn::PopSegment_() {
+    segments_[segment_head_++].file.reset();
+    if(segment_head_ == segments_.size()){  // 队列已空，复用空间
+        segments_.clear();
+        segment_head_ = 0;
+        write_buffer_.RetrieveAll();
+    }
+}
@@ -6,6 +6,7 @@
 #define WEB_SERVER_HTTPCONN_H
 
 #include <arpa/inet.h>  // sockaddr_in
+#include <vector>
 #include "../buffer/Buffer.h"
 #include "../log/Log.h"
 #include "HttpRequest.h"
@@ -14,6 +15,14 @@
 /*
  * 维护一个http连接
  * 提供读取request 写入response
+ * 支持流水线：一次读入的多个完整请求依次解析，响应按序排入发送队列，一并写出
+ * 发送队列：每个响应一段，响应头依次追加在write_buffer_中，响应体为该段持有的FileCache项引用，发送完释放
+ * 写出方式：
+ *      Mmap      连续的响应头与映射的文件合并为一次sendmsg
+ *      Sendfile  遇到sendfile响应体时，之前的内容以MSG_MORE写出，再sendfile发送文件，file_offset记录断点，EAGAIN后续传
+ * 需要数据库的请求：Process停在该请求，DbPending为true，由调用方按GetRequest的表单查询存储（db通道、AsyncSql或凭据缓存）、
+ * 在hash通道计算/比对口令哈希，得出结果后ResolveDb(verified)，之后再次Process从该请求继续，
+ * 通道已满、数据库不可用时RejectDb，该请求响应503
  */
 class HttpConn {
 public:
@@ -28,22 +37,51 @@ public:
     const char* GetIP() const{return inet_ntoa(addr_.sin_addr);}
     sockaddr_in GetAddr() const{return addr_;}
     bool Process();
+    bool DbPending() const {return db_state_ == DbState::kPending;}
+    void ResolveDb(bool verified);
+    void RejectDb();
+    const HttpRequest &GetRequest() const {return request_;}
+    void SetPwdHash(std::string pwd_hash) {request_.SetPwdHash(std::move(pwd_hash));}
 
     int ToWriteBytes(){  // 待写入内容
-        return static_cast<int>(iov_[0].iov_len+iov_[1].iov_len);
+        return static_cast<int>(to_write_);
     }
-    bool IsKeepAlive() const{
-        return request_.IsKeepAlive();
+    bool IsKeepAlive() const{  // 以已生成响应的Connection为准，请求此时可能已被取出
+        return response_.IsKeepAlive();
     }
     static bool is_et;
+    static SendStrategy send_strategy;
     static const char* src_dir;
     static std::atomic<int> user_count;  // 原子性访问
+
+    static constexpr size_t kMaxPipeline = 32;  // 单次Process最多排队的响应数
+    static constexpr int kMaxIov = 64;  // 单次sendmsg的io向量数
 private:
+    enum class DbState {
+        kNone,
+        kPending,  // 停在需要数据库的请求，等待调用方处理
+        kResolved,
+        kRejected,
+    };
+    struct Segment{  // 一个响应的待写出内容
+        size_t header_len;  // write_buffer_中剩余的响应头字节
+        FileEntryPtr file;  // 响应体
+        size_t mm_len;  // 以映射发送的响应体字节
+        size_t mm_sent;
+        off_t file_offset;  // sendfile已发送位置
+        size_t file_remain;  // sendfile剩余字节
+    };
+    void PushSegment_(size_t header_len);
+    void Consume_(size_t len);
+    void PopSegment_();
+
     int fd_;  // socket客户端fd
     struct sockaddr_in addr_;
     bool is_closed_;
-    int iov_cnt_;
-    struct iovec iov_[2];
+    std::vector<Segment> segments_;  // 发送队列，[segment_head_, size())待发送
+    size_t segment_head_;
+    size_t to_write_;
+    DbState db_state_;
 
     Buffer read_buffer_;
     Buffer write_buffer_;
@@ -0,0 +1,421 @@
+//
+// Created by 98302 on 2023/10/14.
+//
+
+#include "HttpParser.h"
+#include <cstring>
+#include <bit>
+#if defined(__x86_64__) || defined(__i386__)
+#include <immintrin.h>
+#define HTTP_PARSER_X86
+#endif
+
+using namespace std;
+
+namespace {
+
+/// token字符表（RFC 7230 tchar），方法名与请求头名只能由tchar组成
+constexpr array<bool, 256> MakeTokenTable() {
+    array<bool, 256> table{};
+    for(int c = '0'; c <= '9'; ++c) table[c] = true;
+    for(int c = 'a'; c <= 'z'; ++c) table[c] = true;
+    for(int c = 'A'; c <= 'Z'; ++c) table[c] = true;
+    for(char c: string_view("!#$%&'*+-.^_`|~")) table[static_cast<unsigned char>(c)] = true;
+    return table;
+}
+constexpr array<bool, 256> kTokenChar = MakeTokenTable();
+
+/// 路径字符表：可见字符，排除空格与控制字符
+constexpr array<bool, 256> MakePathTable() {
+    array<bool, 256> table{};
+    for(int c = 0x21; c < 0x7f; ++c) table[c] = true;
+    for(int c = 0x80; c < 0x100; ++c) table[c] = true;
+    return table;
+}
+constexpr array<bool, 256> kPathChar = MakePathTable();
+
+constexpr char ToLower(char c) {
+    return (c >= 'A' && c <= 'Z') ? static_cast<char>(c | 0x20) : c;
+}
+
+static_assert(endian::native == endian::little, "method words are packed little-endian");
+
+/// 方法名按小端打包为uint64，与请求中的前len字节一次比较
+constexpr uint64_t PackWord(string_view s) {
+    uint64_t word = 0;
+    for(size_t i=0; i<s.size() && i<8; ++i){
+        word |= static_cast<uint64_t>(static_cast<unsigned char>(s[i])) << (8*i);
+    }
+    return word;
+}
+
+struct KnownMethod{
+    uint64_t word;
+    uint8_t len;
+    HttpParser::Method method;
+};
+constexpr KnownMethod kKnownMethods[] = {
+        {PackWord("GET"), 3, HttpParser::kGet},
+        {PackWord("POST"), 4, HttpParser::kPost},
+        {PackWord("HEAD"), 4, HttpParser::kHead},
+        {PackWord("PUT"), 3, HttpParser::kPut},
+        {PackWord("DELETE"), 6, HttpParser::kDelete},
+        {PackWord("OPTIONS"), 7, HttpParser::kOptions},
+        {PackWord("PATCH"), 5, HttpParser::kPatch},
+        {PackWord("CONNECT"), 7, HttpParser::kConnect},
+        {PackWord("TRACE"), 5, HttpParser::kTrace},
+};
+
+struct KnownHeader{
+    string_view name;  // 小写
+    HttpParser::HeaderId id;
+};
+constexpr KnownHeader kKnownHeaders[] = {
+        {"host", HttpParser::kHost},
+        {"connection", HttpParser::kConnection},
+        {"content-length", HttpParser::kContentLength},
+        {"content-type", HttpParser::kContentType},
+        {"transfer-encoding", HttpParser::kTransferEncoding},
+        {"user-agent", HttpParser::kUserAgent},
+        {"accept", HttpParser::kAccept},
+        {"accept-encoding", HttpParser::kAcceptEncoding},
+        {"accept-language", HttpParser::kAcceptLanguage},
+        {"cookie", HttpParser::kCookie},
+        {"referer", HttpParser::kReferer},
+        {"origin", HttpParser::kOrigin},
+        {"pragma", HttpParser::kPragma},
+        {"cache-control", HttpParser::kCacheControl},
+        {"if-modified-since", HttpParser::kIfModifiedSince},
+        {"if-none-match", HttpParser::kIfNoneMatch},
+        {"range", HttpParser::kRange},
+        {"upgrade-insecure-requests", HttpParser::kUpgradeInsecureRequests},
+};
+
+/*
+ * 请求头名按(长度, 首字母)分桶，查找时只与同桶的候选逐字节比较
+ * 桶内最多kBucketSize个候选，编译期检查
+ */
+constexpr size_t kMaxKnownLen = 32;
+constexpr size_t kBucketSize = 2;
+struct HeaderTable{
+    array<array<array<uint8_t, kBucketSize>, 26>, kMaxKnownLen> bucket{};  // 存kKnownHeaders下标+1
+};
+constexpr HeaderTable MakeHeaderTable() {
+    HeaderTable table{};
+    for(size_t i=0; i<size(kKnownHeaders); ++i){
+        string_view name = kKnownHeaders[i].name;
+        auto &slot = table.bucket[name.size()][name[0]-'a'];
+        size_t j = 0;
+        while(slot[j] != 0) ++j;  // 超出kBucketSize时越界，编译期报错
+        slot[j] = static_cast<uint8_t>(i+1);
+    }
+    return table;
+}
+constexpr HeaderTable kHeaderTable = MakeHeaderTable();
+
+const char *SkipOws(const char *p, const char *end) {
+    while(p < end && (*p == ' ' || *p == '\t')) ++p;
+    return p;
+}
+
+/*
+ * 查找'\n'，未找到返回end
+ * x86：SSE2（x86-64必有）每次比较16字节，CPU支持AVX2时运行期切换为32字节版本
+ * 其他平台：memchr
+ */
+const char *FindNewlineScalar(const char *p, const char *end) {
+    auto found = static_cast<const char*>(memchr(p, '\n', end - p));
+    return found ? found : end;
+}
+
+#ifdef HTTP_PARSER_X86
+const char *FindNewlineSse2(const char *p, const char *end) {
+    const __m128i newline = _mm_set1_epi8('\n');
+    for(; end - p >= 16; p += 16){
+        __m128i chunk = _mm_loadu_si128(reinterpret_cast<const __m128i*>(p));
+        auto mask = static_cast<uint32_t>(_mm_movemask_epi8(_mm_cmpeq_epi8(chunk, newline)));
+        if(mask != 0){
+            return p + countr_zero(mask);
+        }
+    }
+    return FindNewlineScalar(p, end);
+}
+
+__attribute__((target("avx2")))
+const char *FindNewlineAvx2(const char *p, const char *end) {
+    const __m256i newline = _mm256_set1_epi8('\n');
+    for(; end - p >= 32; p += 32){
+        __m256i chunk = _mm256_loadu_si256(reinterpret_cast<const __m256i*>(p));
+        auto mask = static_cast<uint32_t>(_mm256_movemask_epi8(_mm256_cmpeq_epi8(chunk, newline)));
+        if(mask != 0){
+            return p + countr_zero(mask);
+        }
+    }
+    return FindNewlineSse2(p, end);
+}
+#endif
+
+using FindNewlineFunc = const char *(*)(const char*, const char*);
+
+FindNewlineFunc SelectFindNewline() {
+#ifdef HTTP_PARSER_X86
+    __builtin_cpu_init();
+    return __builtin_cpu_supports("avx2") ? FindNewlineAvx2 : FindNewlineSse2;
+#else
+    return FindNewlineScalar;
+#endif
+}
+const FindNewlineFunc kFindNewline = SelectFindNewline();
+
+}  // namespace
+
+const char *HttpParser::FindNewline(const char *begin, const char *end) {
+    return kFindNewline(begin, end);
+}
+
+void HttpParser::Reset() {
+    state_ = kExpectHeaders;
+    result_ = kIncomplete;
+    base_ = nullptr;
+    scanned_ = 0;
+    header_len_ = 0;
+    method_ = kMethodUnknown;
+    method_name_ = path_ = version_ = {};
+    content_length_ = 0;
+    header_count_ = 0;
+    header_index_.fill(0);
+}
+
+/// 增量解析一个请求，begin为请求起点，[begin, end)为目前已收到的全部数据
+/// 两次调用之间数据可以整体移动（begin变化），但已传入的内容不能改变
+/// \param begin
+/// \param end
+/// \return kIncomplete时调用方应在收到更多数据后再次调用
+HttpParser::Status HttpParser::Parse(const char *begin, const char *end) {
+    base_ = begin;
+    if(state_ == kDone){
+        return result_;
+    }
+    auto size = static_cast<size_t>(end - begin);
+    if(state_ == kExpectHeaders){
+        header_len_ = FindHeaderEnd_(end);
+        if(header_len_ == 0){
+            if(size > kMaxHeaderBytes){
+                state_ = kDone;
+                result_ = kError;
+            }
+            return result_;
+        }
+        if(header_len_ > kMaxHeaderBytes || !ParseHeaders_()){
+            state_ = kDone;
+            result_ = kError;
+            return result_;
+        }
+        if(content_length_ > kMaxBodyBytes){  // 不等待body，避免读缓冲区无限增长
+            state_ = kDone;
+            result_ = kTooLarge;
+            return result_;
+        }
+        state_ = kExpectBody;
+    }
+    if(size - header_len_ < content_length_){  // body未收全
+        return kIncomplete;
+    }
+    state_ = kDone;
+    result_ = kComplete;
+    return result_;
+}
+
+/// 从上次扫描结束处继续查找空行（\n\n或\n\r\n），跨两次到达的空行通过回看已扫描字节识别
+/// \param end
+/// \return 请求头（含空行）长度，未找到返回0
+size_t HttpParser::FindHeaderEnd_(const char *end) {
+    const char *p = base_ + scanned_;
+    while(true){
+        p = FindNewline(p, end);
+        if(p == end){
+            scanned_ = end - base_;
+            return 0;
+        }
+        size_t i = p - base_;
+        if((i >= 1 && p[-1] == '\n') || (i >= 2 && p[-1] == '\r' && p[-2] == '\n')){
+            scanned_ = i + 1;
+            return scanned_;
+        }
+        ++p;
+    }
+}
+
+/// 请求头已完整，逐行解析一次
+/// \return
+bool HttpParser::ParseHeaders_() {
+    const char *p = base_;
+    const char *end = base_ + header_len_;
+    bool request_line = true;
+    while(p < end){
+        const char *line_end = FindNewline(p, end);
+        const char *content_end = (line_end > p && line_end[-1] == '\r') ? line_end - 1 : line_end;  // 兼容裸LF
+        if(request_line){
+            if(!ParseRequestLine_(p, content_end)){
+                return false;
+            }
+            request_line = false;
+        }else if(content_end == p){  // 空行，请求头结束
+            break;
+        }else if(!ParseHeaderLine_(p, content_end)){
+            return false;
+        }
+        p = line_end + 1;
+    }
+    return ParseContentLength_();
+}
+
+/// method SP path SP HTTP/version
+/// \param begin
+/// \param end 不含CRLF
+/// \return
+bool HttpParser::ParseRequestLine_(const char *begin, const char *end) {
+    const char *p = begin;
+    while(p < end && kTokenChar[static_cast<unsigned char>(*p)]) ++p;
+    if(p == begin || p == end || *p != ' '){
+        return false;
+    }
+    method_name_ = MakeSpan_(begin, p);
+    method_ = LookupMethod(begin, p - begin);
+    const char *path_begin = ++p;
+    while(p < end && kPathChar[static_cast<unsigned char>(*p)]) ++p;
+    if(p == path_begin || p == end || *p != ' '){
+        return false;
+    }
+    path_ = MakeSpan_(path_begin, p);
+    ++p;
+    if(end - p < 6 || memcmp(p, "HTTP/", 5) != 0){
+        return false;
+    }
+    version_ = MakeSpan_(p + 5, end);
+    return true;
+}
+
+/// name ":" OWS value OWS
+/// \param begin
+/// \param end 不含CRLF
+/// \return
+bool HttpParser::ParseHeaderLine_(const char *begin, const char *end) {
+    if(header_count_ >= kMaxHeaders){
+        return false;
+    }
+    const char *p = begin;
+    while(p < end && kTokenChar[static_cast<unsigned char>(*p)]) ++p;
+    if(p == begin || p == end || *p != ':'){
+        return false;
+    }
+    Header &header = headers_[header_count_];
+    header.name = MakeSpan_(begin, p);
+    header.id = LookupHeader(begin, p - begin);
+    const char *value_begin = SkipOws(p + 1, end);
+    const char *value_end = end;
+    while(value_end > value_begin && (value_end[-1] == ' ' || value_end[-1] == '\t')) --value_end;
+    header.value = MakeSpan_(value_begin, value_end);
+    ++header_count_;
+    if(header.id == kHeaderOther){
+        return true;
+    }
+    if(header_index_[header.id] == 0){
+        header_index_[header.id] = static_cast<uint8_t>(header_count_);
+    }else if(header.id == kContentLength && View_(header.value) != GetHeader(kContentLength)){
+        return false;  // 多个不同的Content-Length无法确定body边界（请求走私）
+    }
+    return true;  // 其他重复的已知头以第一个为准
+}
+
+bool HttpParser::ParseContentLength_() {
+    if(!GetHeader(kTransferEncoding).empty()){  // 不支持分块请求体
+        return false;
+    }
+    if(header_index_[kContentLength] == 0){  // 没有Content-Length，无请求体
+        content_length_ = 0;
+        return true;
+    }
+    string_view value = GetHeader(kContentLength);
+    if(value.empty()){  // 有头无值
+        return false;
+    }
+    size_t n = 0;
+    for(char c: value){
+        if(c < '0' || c > '9' || n > (SIZE_MAX - 9) / 10){
+            return false;
+        }
+        n = n * 10 + (c - '0');
+    }
+    content_length_ = n;
+    return true;
+}
+
+std::string_view HttpParser::GetHeader(HttpParser::HeaderId id) const {
+    if(id == kHeaderOther || header_index_[id] == 0){
+        return {};
+    }
+    return View_(headers_[header_index_[id] - 1].value);
+}
+
+/// 按名查找（忽略大小写），已知头走O(1)索引
+/// \param name
+/// \return
+std::string_view HttpParser::GetHeader(std::string_view name) const {
+    HeaderId id = LookupHeader(name.data(), name.size());
+    if(id != kHeaderOther){
+        return GetHeader(id);
+    }
+    for(size_t i=0; i<header_count_; ++i){
+        if(EqualsIgnoreCase(HeaderName(i), name)){
+            return HeaderValue(i);
+        }
+    }
+    return {};
+}
+
+bool HttpParser::EqualsIgnoreCase(std::string_view a, std::string_view b) {
+    if(a.size() != b.size()){
+        return false;
+    }
+    for(size_t i=0; i<a.size(); ++i){
+        if(ToLower(a[i]) != ToLower(b[i])){
+            return false;
+        }
+    }
+    return true;
+}
+
+HttpParser::Method HttpParser::LookupMethod(const char *name, size_t len) {
+    if(len == 0 || len > 7){
+        return kMethodUnknown;
+    }
+    uint64_t word = 0;
+    memcpy(&word, name, len);  // 小端，与PackWord一致
+    for(auto &known: kKnownMethods){
+        if(known.len == len && known.word == word){
+            return known.method;
+        }
+    }
+    return kMethodUnknown;
+}
+
+HttpParser::HeaderId HttpParser::LookupHeader(const char *name, size_t len) {
+    if(len == 0 || len >= kMaxKnownLen){
+        return kHeaderOther;
+    }
+    char first = ToLower(name[0]);
+    if(first < 'a' || first > 'z'){
+        return kHeaderOther;
+    }
+    for(uint8_t idx: kHeaderTable.bucket[len][first-'a']){
+        if(idx == 0){
+            break;
+        }
+        const KnownHeader &known = kKnownHeaders[idx-1];
+        if(EqualsIgnoreCase(known.name, string_view(name, len))){
+            return known.id;
+        }
+    }
+    return kHeaderOther;
+}
@@ -0,0 +1,141 @@
+//
+// Created by 98302 on 2023/10/14.
+//
+
+#ifndef WEB_SERVER_HTTPPARSER_H
+#define WEB_SERVER_HTTPPARSER_H
+
+#include <string_view>
+#include <array>
+#include <cstdint>
+#include <cstddef>
+
+/*
+ * HTTP/1.x 请求解析器
+ * 手写状态机，不使用正则，不拷贝：直接扫描Buffer中的请求内存，结果以string_view返回
+ * 增量解析：同一请求分多次到达时，每次传入[请求起点, 已收数据末尾)，
+ * 解析器记住已扫描的字节数，只对新到达的字节用SIMD查找空行（请求头结束），
+ * 请求头完整后才逐行解析一次，之后只等待Content-Length字节的body
+ * 各字段记为相对请求起点的偏移，Buffer整理（前移数据）后仍然有效；
+ * string_view以最近一次Parse传入的起点为基址，调用方在请求处理完之前不得改写该段内存
+ * 返回kComplete、kError或kTooLarge后状态保持不变，处理下一个请求前需Reset
+ * Content-Length超过kMaxBodyBytes时不等待body，直接返回kTooLarge；多个Content-Length的值不同时为格式错误
+ * 方法与常见请求头名通过预计算表识别，已知请求头可按HeaderId O(1)查找
+ * 格式：
+ * 1. method SP path SP HTTP/version CRLF
+ * 2. name ":" OWS value OWS CRLF
+ * 3. ...
+ * 4. CRLF
+ * 5. body（Content-Length字节）
+ */
+class HttpParser {
+public:
+    enum Status{
+        kComplete,  // 完整请求（含body）
+        kIncomplete,  // 数据不足，等待后续数据
+        kError,  // 格式错误
+        kTooLarge,  // 请求体超过kMaxBodyBytes
+    };
+    enum Method: uint8_t{
+        kMethodUnknown,
+        kGet,
+        kHead,
+        kPost,
+        kPut,
+        kDelete,
+        kConnect,
+        kOptions,
+        kTrace,
+        kPatch,
+    };
+    enum HeaderId: uint8_t{
+        kHeaderOther,
+        kHost,
+        kConnection,
+        kContentLength,
+        kContentType,
+        kTransferEncoding,
+        kUserAgent,
+        kAccept,
+        kAcceptEncoding,
+        kAcceptLanguage,
+        kCookie,
+        kReferer,
+        kOrigin,
+        kPragma,
+        kCacheControl,
+        kIfModifiedSince,
+        kIfNoneMatch,
+        kRange,
+        kUpgradeInsecureRequests,
+        kHeaderIdCount,
+    };
+    struct Span{  // 相对请求起点的偏移
+        uint32_t offset;
+        uint32_t len;
+    };
+    struct Header{
+        Span name;
+        Span value;
+        HeaderId id;
+    };
+
+    HttpParser() {Reset();}
+    void Reset();
+    Status Parse(const char *begin, const char *end);
+
+    Method GetMethod() const {return method_;}
+    std::string_view MethodName() const {return View_(method_name_);}
+    std::string_view Path() const {return View_(path_);}
+    std::string_view Version() const {return View_(version_);}
+    std::string_view Body() const {return {base_ + header_len_, content_length_};}
+    size_t HeaderCount() const {return header_count_;}
+    std::string_view HeaderName(size_t i) const {return View_(headers_[i].name);}
+    std::string_view HeaderValue(size_t i) const {return View_(headers_[i].value);}
+    std::string_view GetHeader(HeaderId id) const;
+    std::string_view GetHeader(std::string_view name) const;
+    size_t Consumed() const {return state_ == kDone ? header_len_ + content_length_ : 0;}  // 完整请求的字节数（请求头+body）
+    size_t Scanned() const {return scanned_;}  // 已扫描的请求头字节数
+
+    static bool EqualsIgnoreCase(std::string_view a, std::string_view b);
+    static Method LookupMethod(const char *name, size_t len);
+    static HeaderId LookupHeader(const char *name, size_t len);
+    static const char *FindNewline(const char *begin, const char *end);
+
+    static constexpr size_t kMaxHeaders = 64;
+    static constexpr size_t kMaxHeaderBytes = 64 * 1024;  // 请求行+请求头上限，超出视为错误
+    static constexpr size_t kMaxBodyBytes = 1024 * 1024;  // 请求体上限，body在读缓冲区中收全后才处理
+private:
+    enum State{
+        kExpectHeaders,  // 等待空行
+        kExpectBody,  // 请求头已解析，等待body
+        kDone,  // 已返回kComplete/kError/kTooLarge
+    };
+
+    size_t FindHeaderEnd_(const char *end);
+    bool ParseHeaders_();
+    bool ParseRequestLine_(const char *begin, const char *end);
+    bool ParseHeaderLine_(const char *begin, const char *end);
+    bool ParseContentLength_();
+    Span MakeSpan_(const char *begin, const char *end) const {
+        return {static_cast<uint32_t>(begin - base_), static_cast<uint32_t>(end - begin)};
+    }
+    std::string_view View_(Span span) const {return {base_ + span.offset, span.len};}
+
+    State state_;
+    Status result_;
+    const char *base_;  // 请求起点，每次Parse更新
+    size_t scanned_;  // [0, scanned_)已查找过空行
+    size_t header_len_;  // 请求行+请求头+空行的字节数
+    Method method_;
+    Span method_name_;
+    Span path_;
+    Span version_;
+    size_t content_length_;
+    size_t header_count_;
+    std::array<Header, kMaxHeaders> headers_;
+    std::array<uint8_t, kHeaderIdCount> header_index_;  // HeaderId => headers_下标+1，0为不存在
+};
+
+
+#endif //WEB_SERVER_HTTPPARSER_H
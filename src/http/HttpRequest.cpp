@@ -17,57 +17,47 @@ const unordered_map<string, int> HttpRequest::DEFAULT_HTML_TAG{
         {"/register.html", 0},
         {"/login.html", 1}
 };
+const unordered_set<string> HttpRequest::PROTECTED_HTML{
+        "/welcome.html",
+        "/video.html",
+        "/picture.html"
+};
 
 /// 初始化请求
 void HttpRequest::Init() {
-    method_ = path_ = version_ = body_ = "";
-    state_ = REQUEST_LINE;
-    header_.clear();
+    path_ = body_ = set_cookie_ = pwd_hash_ = "";
+    db_tag_ = -1;
+    parser_.Reset();
     post_.clear();
 }
 
 /// 解析报文
 /// \param buffer
-/// \return
-bool HttpRequest::Parse(Buffer &buffer) {
-    const char CRLF[] = "\r\n";  // 行结束符
+/// \return kIncomplete：请求未收全（进度保留），kError：格式错误，kTooLarge：请求体过大
+HttpParser::Status HttpRequest::Parse(Buffer &buffer) {
     if(buffer.ReadableBytes() <= 0){  // 无可读内容
-        return false;
-    }
-    while (buffer.ReadableBytes() && state_ != FINISH){
-        // 从buffer的读指针开始到读指针结束，查找CRLF出现的位置
-        const char *line_end = search(buffer.Peek(), buffer.BeginWriteConst(), CRLF, CRLF+2);
-        string line(buffer.Peek(), line_end);
-        // 有限状态机
-        switch (state_) {
-            case REQUEST_LINE:
-                if(!ParseRequestLine_(line)){  // 解析失败终止
-                    return false;
-                }
-                ParsePath_();
-                break;
-            case HEADERS:
-                ParseHeader_(line);
-                if(buffer.ReadableBytes() <= 2){  // 无body
-                    state_ = FINISH;
-                }
-                break;
-            case BODY:
-                ParseBody_(line);
-                break;
-            default:
-                break;
-        }
-        if(line_end == buffer.BeginWrite()){  // 无可读内容
-            break;
-        }
-        buffer.RetrieveUntil(line_end+2);
-    }
-    LOG_DEBUG("[%s], [%s], [%s]",
-              method_.c_str(),
+        return HttpParser::kIncomplete;
+    }
+    HttpParser::Status status = parser_.Parse(buffer.Peek(), buffer.BeginWriteConst());
+    if(status == HttpParser::kError || status == HttpParser::kTooLarge){
+        LOG_ERROR("Request error!");
+        return status;
+    }else if(status == HttpParser::kIncomplete){
+        return status;
+    }
+    path_ = parser_.Path();
+    ParsePath_();
+    CheckSession_();
+    if(parser_.GetMethod() == HttpParser::kPost){
+        body_ = parser_.Body();
+        ParsePost_();
+        LOG_DEBUG("Body:%s, len:%d", body_.c_str(), body_.size());
+    }
+    LOG_DEBUG("[%.*s], [%s], [%.*s]",
+              static_cast<int>(Method().size()), Method().data(),
               path_.c_str(),
-              version_.c_str());
-    return true;
+              static_cast<int>(Version().size()), Version().data());
+    return status;
 }
 
 std::string HttpRequest::Path() const {
@@ -78,12 +68,16 @@ std::string &HttpRequest::Path() {
     return path_;
 }
 
-std::string HttpRequest::Method() const {
-    return method_;
+std::string_view HttpRequest::Method() const {
+    return parser_.MethodName();
 }
 
-std::string HttpRequest::Version() const {
-    return version_;
+std::string_view HttpRequest::Version() const {
+    return parser_.Version();
+}
+
+std::string_view HttpRequest::GetHeader(std::string_view name) const {
+    return parser_.GetHeader(name);
 }
 
 std::string HttpRequest::GetPost(const std::string &key) const {
@@ -103,60 +97,8 @@ std::string HttpRequest::GetPost(const char *key) const {
 }
 
 bool HttpRequest::IsKeepAlive() const {
-    if (header_.count("Connection") == 1) {
-        return header_.find("Connection")->second == "keep-alive" &&
-               version_ == "1.1";
-    }
-    return false;
-}
-
-/// 解析第一行
-/// ^ 限定开头
-/// () 视为整体
-/// [] 限定匹配括号内字符
-/// [^ ] 限定匹配括号内字符以外的内容
-/// * 出现0次或多次
-/// . 除换行符以外的字符
-/// (.*) 除换行符以外的任意字符出现0次或多次
-/// ? 匹配任意数量的重复
-/// ?(.*) 匹配任意字符串直到换行
-/// $ 匹配行尾
-/// \param line
-/// \return
-bool HttpRequest::ParseRequestLine_(const std::string &line) {
-    //
-    regex pattern("^([^ ]*) ([^ ]*) HTTP/([^ ]*)$");  // “GET / HTTP/1.1” 匹配除空格外的任意内容
-    smatch sub_match;
-    if(regex_match(line, sub_match, pattern)){  // sub_match[0]表示整体
-        method_ = sub_match[1];
-        path_ = sub_match[2];  // "" => 路径
-        version_ = sub_match[3];
-        state_ = HEADERS;  // 状态转换
-        return true;
-    }
-    LOG_ERROR("RequestLine error!");
-    return false;
-}
-
-/// 解析请求头
-/// \param line
-void HttpRequest::ParseHeader_(const std::string &line) {
-    regex pattern("^([^:]*): ?(.*)$");  // 匹配冒号键值对，key匹配到第一个冒号，value匹配剩余内容
-    smatch sub_match;
-    if(regex_match(line, sub_match, pattern)){
-        header_[sub_match[1]] = sub_match[2];
-    }else{  // 未匹配到键值对则结束请求头
-        state_ = BODY;  // 状态转换
-    }
-}
-
-/// 解析请求体
-/// \param line
-void HttpRequest::ParseBody_(const std::string &line) {
-    body_ = line;
-    ParsePost_();
-    state_ = FINISH;
-    LOG_DEBUG("Body:%s, len:%d", line.c_str(), line.size());
+    return HttpParser::EqualsIgnoreCase(parser_.GetHeader(HttpParser::kConnection), "keep-alive") &&
+           Version() == "1.1";
 }
 
 /// 解析路径 路径 => html文件名
@@ -173,28 +115,57 @@ void HttpRequest::ParsePath_() {
     }
 }
 
+/// 需要登录的页面凭会话访问，无有效会话时改为登录页
+void HttpRequest::CheckSession_() {
+    if(PROTECTED_HTML.count(path_) == 0){
+        return;
+    }
+    string_view token = SessionTable::FromCookie(parser_.GetHeader("Cookie"));
+    if(!SessionTable::Instance()->Validate(token)){
+        LOG_DEBUG("No session for %s", path_.c_str());
+        path_ = "/login.html";
+    }
+}
+
 /// 处理POST请求
 void HttpRequest::ParsePost_() {
-    if(method_ == "POST" &&
-       header_["Content-Type"] == "application/x-www-form-urlencoded"){  // 检查method和content-type是否为post请求，带有表单数据
+    if(parser_.GetMethod() == HttpParser::kPost &&
+       parser_.GetHeader(HttpParser::kContentType) == "application/x-www-form-urlencoded"){  // 检查method和content-type是否为post请求，带有表单数据
         ParseFromUrlEncoded_();
         if (DEFAULT_HTML_TAG.count(path_)){
             int tag = DEFAULT_HTML_TAG.find(path_)->second;
             LOG_DEBUG("Tag:%d", tag);
-            if(tag == 0 || tag == 1){
-                bool is_login = (tag == 1);  // 用户登录/注册
-                if(UserVerify(post_["username"],
-                              post_["password"],
-                              is_login)){
-                    path_ = "/welcome.html";
-                }else{
+            if(tag == 0 || tag == 1){  // 用户登录/注册
+                if(post_["username"].empty() || post_["password"].empty()){  // 无需查询即可判定失败
                     path_ = "/error.html";
+                }else{
+                    db_tag_ = tag;  // 交给db通道校验
                 }
             }
         }
     }
 }
 
+/// 按校验结果确定响应页面，登录成功时签发会话；注册成功不签发，需再登录
+/// \param verified
+void HttpRequest::ResolveDb(bool verified) {
+    assert(NeedsDb());
+    if(verified){
+        path_ = "/welcome.html";
+    }else{
+        path_ = "/error.html";
+    }
+    if(verified && IsLogin()){
+        string token = SessionTable::Instance()->Create(post_["username"]);
+        if(!token.empty()){
+            set_cookie_ = string(SessionTable::kCookieName) + "=" + token +
+                          "; Max-Age=" + to_string(SessionTable::Instance()->TtlSeconds()) +
+                          "; Path=/; HttpOnly; SameSite=Lax";
+        }
+    }
+    db_tag_ = -1;
+}
+
 /// 解析url
 void HttpRequest::ParseFromUrlEncoded_() {
     if(body_.empty()){
@@ -237,78 +208,6 @@ void HttpRequest::ParseFromUrlEncoded_() {
     }
 }
 
-/// 用户登录
-/// \param name
-/// \param pwd
-/// \param is_login
-/// \return
-bool HttpRequest::UserVerify(const std::string &name, const std::string &pwd, bool is_login) {
-    if(name.empty() || pwd.empty()){
-        return false;
-    }
-    LOG_INFO("Verify name:%s pwd:%s", name.c_str(), pwd.c_str());
-    MYSQL *sql;
-    SqlConnRAII conn(&sql, SqlConnPool::Instance());
-    assert(sql);
-
-    bool flag = false;
-    uint j = 0;
-    char order[256] = {0};
-    MYSQL_FIELD *fields = nullptr;
-    MYSQL_RES *res = nullptr;
-    if(!is_login){
-        flag = true;
-    }
-    snprintf(order,
-             256,
-             "SELECT username, password FROM user WHERE username='%s' LIMIT 1",
-             name.c_str());
-    LOG_DEBUG("%s", order);
-
-    if(mysql_query(sql, order)){
-        mysql_free_result(res);
-        return false;
-    }
-    res = mysql_store_result(sql);
-    j = mysql_num_fields(res);
-    fields = mysql_fetch_field(res);
-    while(MYSQL_ROW row = mysql_fetch_row(res)){
-        LOG_DEBUG("MySQL row:%s %s", row[0], row[1]);
-        string password(row[1]);
-        if(is_login){
-            if(pwd == password){
-                flag = true;
-            }else{
-                flag = false;
-                LOG_INFO("pwd error!");
-            }
-        }else{
-            flag = false;
-            LOG_INFO("user used!");
-        }
-    }
-    mysql_free_result(res);
-
-    // 注册
-    if(!is_login && flag){
-        LOG_DEBUG("register!");
-        bzero(order, 256);  // 清空指令
-        snprintf(order,
-                 256,
-                 "INSERT INTO user(username, password) VALUES('%s','%s')",
-                 name.c_str(),
-                 pwd.c_str());
-        LOG_DEBUG("%s", order);
-        if(mysql_query(sql, order)){
-            LOG_DEBUG("Insert error!");
-            flag = false;
-        }
-        flag = true;
-    }
-    LOG_DEBUG("User verify success!");
-    return flag;  // sql&conn 离开作用域自动析构
-}
-
 /// 16进制转10进制
 /// \param ch
 /// \return
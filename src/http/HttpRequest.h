@@ -8,15 +8,22 @@
 #include <string>
 #include <unordered_map>
 #include <unordered_set>
-#include <regex>
+#include <string_view>
+#include <optional>
 #include "../buffer/Buffer.h"
+#include "HttpParser.h"
 #include "../log/Log.h"
-#include "../pool/SqlConnPool.h"
+#include "../pool/SessionTable.h"
 
 /*
  * http请求类
- * 按行读取buffer并解析单个http请求
- * TODO： format
+ * 由HttpParser在buffer上原地解析单个http请求，方法、版本、请求头为指向buffer的string_view
+ * 请求未收全时Parse返回kIncomplete并保留解析进度，收到新数据后再次Parse只处理新增部分
+ * 请求处理完之前buffer中的请求数据不可取出，处理完后由调用方Retrieve(Consumed())并Init
+ * 解析时分类：登录/注册表单需要查询数据库，Parse只记录，NeedsDb为true，由调用方以GetPost取出用户名、密码，
+ * 查询存储、在hash通道计算/比对口令哈希（注册时PwdHash记录算好的哈希），得出结果后ResolveDb(verified)
+ * 会话：登录/注册成功时在SessionTable签发会话，SetCookie为响应需要带上的Set-Cookie值
+ * 访问PROTECTED_HTML中的页面时以Cookie中的令牌查SessionTable，不查询数据库，无有效会话时改为登录页
  * HTTP request：
  * 1. method path version\r\n
  * 2. key: value\r\n
@@ -25,44 +32,43 @@
  */
 class HttpRequest {
 public:
-    enum PARSE_STATE{
-        REQUEST_LINE,
-        HEADERS,
-        BODY,
-        FINISH,
-    };
     HttpRequest(){Init();}
     ~HttpRequest() = default;
     void Init();
-    bool Parse(Buffer &buffer);
+    HttpParser::Status Parse(Buffer &buffer);
+    size_t Consumed() const {return parser_.Consumed();}
 
     std::string Path() const;
     std::string &Path();
-    std::string Method() const;
-    std::string Version() const;
+    std::string_view Method() const;
+    std::string_view Version() const;
+    std::string_view GetHeader(std::string_view name) const;
     std::string GetPost(const std::string &key) const;
     std::string GetPost(const char *key) const;
 
     bool IsKeepAlive() const;
+    bool NeedsDb() const {return db_tag_ >= 0;}
+    bool IsLogin() const {return db_tag_ == 1;}
+    void ResolveDb(bool verified);
+    const std::string &PwdHash() const {return pwd_hash_;}
+    void SetPwdHash(std::string pwd_hash) {pwd_hash_ = std::move(pwd_hash);}
+    const std::string &SetCookie() const {return set_cookie_;}
 private:
-    bool ParseRequestLine_(const std::string &line);
-    void ParseHeader_(const std::string &line);
-    void ParseBody_(const std::string &line);
-
     void ParsePath_();
+    void CheckSession_();
     void ParsePost_();
     void ParseFromUrlEncoded_();
 
-    static bool UserVerify(const std::string &name,
-                           const std::string &pwd,
-                           bool is_login);
-    PARSE_STATE state_;
-    std::string method_, path_, version_, body_;
-    std::unordered_map<std::string, std::string> header_;
+    HttpParser parser_;
+    std::string path_, body_;
     std::unordered_map<std::string, std::string> post_;
+    int db_tag_;  // 待数据库校验的表单，DEFAULT_HTML_TAG中的值，-1为无
+    std::string set_cookie_;  // 本次签发的会话，空为无
+    std::string pwd_hash_;  // 注册：算好的口令哈希，待写入
 
     static const std::unordered_set<std::string> DEFAULT_HTML;
     static const std::unordered_map<std::string, int> DEFAULT_HTML_TAG;
+    static const std::unordered_set<std::string> PROTECTED_HTML;  // 需要登录的页面
     static int ConvertHex_(char ch);  // 16进制转10进制
 };
 
@@ -3,6 +3,7 @@
 //
 
 #include "HttpResponse.h"
+#include <ctime>
 using namespace std;
 
 const unordered_map<string, string> HttpResponse::MIME_TYPE = {
@@ -30,7 +31,9 @@ const unordered_map<int, string> HttpResponse::CODE_STATUS = {
         {200, "OK"},
         {400, "Bad Request"},
         {403, "Forbidden"},
-        {404, "Not Found"}
+        {404, "Not Found"},
+        {413, "Payload Too Large"},
+        {503, "Service Unavailable"}
 };
 const unordered_map<int, string> HttpResponse::CODE_PATH = {
         {400, "/400.html"},
@@ -42,12 +45,11 @@ HttpResponse::HttpResponse() {
     code_ = -1;
     path_ = src_dir_ = "";
     is_keep_alive_ = false;
-    mm_file_ = nullptr;
-    mm_file_stat_ = {0};
+    strategy_ = SendStrategy::Mmap;
 }
 
 HttpResponse::~HttpResponse() {
-    UnmapFile();
+    ReleaseFile();
 }
 
 /// 初始化响应报文
@@ -55,49 +57,130 @@ HttpResponse::~HttpResponse() {
 /// \param path
 /// \param is_keep_alive
 /// \param code
-void HttpResponse::Init(const std::string &src_dir, std::string &path, bool is_keep_alive, int code) {
+/// \param strategy 响应体发送方式
+void HttpResponse::Init(const std::string &src_dir, std::string &path, bool is_keep_alive, int code,
+                        SendStrategy strategy) {
     assert(!src_dir.empty());
-    if(mm_file_){
-        UnmapFile();
-    }
+    ReleaseFile();
     code_ = code;
     is_keep_alive_ = is_keep_alive;
     path_ = path;
     src_dir_ = src_dir;
-    mm_file_ = nullptr;
-    mm_file_stat_ = {0};
+    set_cookie_.clear();
+    strategy_ = strategy;
 }
 
 void HttpResponse::MakeResponse(Buffer &buffer) {
-    if (stat((src_dir_ + path_).data(), &mm_file_stat_) < 0 ||
-            S_ISDIR(mm_file_stat_.st_mode)){
-        code_ = 404;
-    }else if(!(mm_file_stat_.st_mode & S_IROTH)){
-        code_ = 403;
-    }else if(code_ == -1){
-        code_ = 200;
+    if(code_ == 503 || code_ == 413){  // 过载或请求体过大，不读文件
+        file_.reset();
+        AddStateLine_(buffer);
+        AddHeader_(buffer);
+        if(code_ == 503){
+            buffer.Append("Retry-After: 1\r\n");
+            ErrorContent(buffer, "Server busy, please retry later.");
+        }else{
+            ErrorContent(buffer, "Request body too large.");
+        }
+        return;
+    }
+    if(code_ != 400){  // 解析失败的请求没有可用的路径，直接响应400页面
+        file_ = FileCache::Instance()->Get(src_dir_ + path_);
+        if(!file_){  // 不存在或不是普通文件
+            code_ = 404;
+        }else if(!(file_->st.st_mode & S_IROTH)){
+            code_ = 403;
+        }else if(code_ == -1){
+            code_ = 200;
+        }
     }
 
     ErrorHtml_();
+    if(set_cookie_.empty() && AddCachedHeader_(buffer)){
+        return;
+    }
     AddStateLine_(buffer);
     AddHeader_(buffer);
     AddContent_(buffer);
 }
 
-/// 取消文件映射
-void HttpResponse::UnmapFile() {
-    if(mm_file_){
-        munmap(mm_file_, mm_file_stat_.st_size);  // 取消映射
-        mm_file_ = nullptr;
+/// 拷贝缓存项中预生成的响应头，首次使用时生成
+/// \param buffer
+/// \return false：无文件响应体或状态码无对应槽，走逐项生成
+bool HttpResponse::AddCachedHeader_(Buffer &buffer) {
+    int slot = HeaderBlockSlot_(code_, is_keep_alive_);
+    if(slot < 0 || !HasFileBody_()){
+        return false;
+    }
+    auto &cached = file_->header_blocks[slot];
+    const HeaderBlock *block = cached.load(memory_order_acquire);
+    if(!block){
+        Buffer header;
+        AddStateLine_(header);
+        AddHeader_(header);
+        auto rendered = new HeaderBlock{"", header.ReadableBytes() - kDateLen - 2};  // AddHeader_以Date结尾
+        AddContent_(header);
+        rendered->bytes = header.RetrieveAllToStr();
+        if(cached.compare_exchange_strong(block, rendered, memory_order_acq_rel)){
+            block = rendered;
+        }else{  // 其他线程已生成
+            delete rendered;
+        }
+    }
+    buffer.Append(block->bytes);
+    memcpy(buffer.BeginWrite() - block->bytes.size() + block->date_offset, HttpDate_(), kDateLen);
+    return true;
+}
+
+/// 状态码与keep-alive对应的预生成响应头槽位
+/// \param code
+/// \param is_keep_alive
+/// \return 无对应槽位时为-1
+int HttpResponse::HeaderBlockSlot_(int code, bool is_keep_alive) {
+    static_assert(FileEntry::kHeaderBlockSlots >= 8, "one slot per (code, keep-alive)");
+    int index;
+    switch(code){
+        case 200: index = 0; break;
+        case 400: index = 1; break;
+        case 403: index = 2; break;
+        case 404: index = 3; break;
+        default: return -1;
+    }
+    return index * 2 + (is_keep_alive ? 1 : 0);
+}
+
+/// 文件能否作为响应体发送：Sendfile需要fd，Mmap需要映射（空文件除外）
+/// \return
+bool HttpResponse::HasFileBody_() const {
+    return file_ && file_->fd >= 0 &&
+           !(strategy_ == SendStrategy::Mmap && file_->size > 0 && !file_->data);
+}
+
+/// 当前时间的HTTP-date，每个线程每秒格式化一次
+/// \return kDateLen字节
+const char *HttpResponse::HttpDate_() {
+    thread_local time_t cached_sec = -1;
+    thread_local char cached[kDateLen + 1];
+    time_t now = time(nullptr);
+    if(now != cached_sec){
+        struct tm tm{};
+        gmtime_r(&now, &tm);
+        strftime(cached, sizeof(cached), "%a, %d %b %Y %H:%M:%S GMT", &tm);
+        cached_sec = now;
     }
+    return cached;
+}
+
+/// 释放对缓存项的引用，映射与fd由缓存项在最后一个引用释放时回收
+void HttpResponse::ReleaseFile() {
+    file_.reset();
 }
 
 char *HttpResponse::File() {
-    return mm_file_;
+    return file_ ? file_->data : nullptr;
 }
 
 size_t HttpResponse::FileLen() const {
-    return mm_file_stat_.st_size;
+    return file_ ? file_->size : 0;
 }
 
 /// 静态异常页面
@@ -139,36 +222,30 @@ void HttpResponse::AddHeader_(Buffer &buffer) {
         buffer.Append("close\r\n");
     }
     buffer.Append("Content-type: " + GetContentType_() + "\r\n");
+    if(!set_cookie_.empty()){
+        buffer.Append("Set-Cookie: " + set_cookie_ + "\r\n");
+    }
+    buffer.Append("Date: ");
+    buffer.Append(HttpDate_(), kDateLen);
+    buffer.Append("\r\n");
 }
 
 void HttpResponse::AddContent_(Buffer &buffer) {
-    int src_fd = open((src_dir_+path_).data(), O_RDONLY);
-    if(src_fd < 0){
+    // Sendfile方式发送缓存项的fd，Mmap方式发送缓存项的映射
+    if(!HasFileBody_()){
+        file_.reset();
         ErrorContent(buffer, "File does not exist!");
         return;
     }
-    // 文件映射，避免内核拷贝到用户
     LOG_DEBUG("file path %s", (src_dir_+path_).data());
-    int *mm_ret = (int*) mmap(0,
-                              mm_file_stat_.st_size,
-                              PROT_READ,
-                              MAP_PRIVATE,  // 写入时拷贝的私有映射
-                              src_fd,
-                              0);
-    if(*mm_ret == -1){
-        ErrorContent(buffer, "File does not exist!");
-        return;
-    }
-    mm_file_ = (char*)mm_ret;
-    close(src_fd);
-    buffer.Append("Content-length: "+ to_string(mm_file_stat_.st_size)+"\r\n\r\n");  // 结束header，末尾增加空行
+    buffer.Append("Content-length: "+ to_string(file_->size)+"\r\n\r\n");  // 结束header，末尾增加空行
 }
 
 /// 转到异常页面
 void HttpResponse::ErrorHtml_() {
     if(CODE_PATH.count(code_) == 1){
         path_ = CODE_PATH.find(code_)->second;
-        stat((src_dir_+path_).data(), &mm_file_stat_);
+        file_ = FileCache::Instance()->Get(src_dir_ + path_);
     }
 }
 
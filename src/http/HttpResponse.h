@@ -11,9 +11,23 @@
 #include <unordered_map>
 #include "../buffer/Buffer.h"
 #include "../log/Log.h"
+#include "FileCache.h"
+
+/*
+ * 响应体发送方式
+ * Mmap：文件映射到用户空间，与响应头一起writev
+ * Sendfile：保留文件fd，响应头写出后由sendfile从页缓存直接发送，不经过用户空间
+ */
+enum SendStrategy{
+    Mmap,
+    Sendfile
+};
 
 /*
  * http响应报文
+ * 响应体文件取自FileCache，响应只持有缓存项的引用，不自行打开/映射文件
+ * 文件响应的响应头按(状态码, keep-alive)预生成在缓存项中，命中时整段拷贝，只覆盖Date值
+ * 带Set-Cookie的响应（签发会话）逐项生成，不使用也不写入预生成的响应头
  * 格式：
  * 1. version code status\r\n
  * 2. key: value\r\n
@@ -29,26 +43,38 @@ public:
     void Init(const std::string &src_dir,
               std::string &path,
               bool is_keep_alive = false,
-              int code = -1);
+              int code = -1,
+              SendStrategy strategy = SendStrategy::Mmap);
+    void SetCookie(const std::string &cookie) {set_cookie_ = cookie;}
     void MakeResponse(Buffer &buffer);
-    void UnmapFile();
+    void ReleaseFile();
+    const FileEntryPtr &GetFile() const {return file_;}
     char *File();
+    int FileFd() const {return file_ ? file_->fd : -1;}
     size_t FileLen() const;
     void ErrorContent(Buffer &buffer, const std::string& message) const;
     int Code() const { return code_;}
+    bool IsKeepAlive() const {return is_keep_alive_;}
 private:
+    bool AddCachedHeader_(Buffer &buffer);
+    bool HasFileBody_() const;
     void AddStateLine_(Buffer &buffer);
     void AddHeader_(Buffer &buffer);
     void AddContent_(Buffer &buffer);
     void ErrorHtml_();
     std::string GetContentType_();
+    static int HeaderBlockSlot_(int code, bool is_keep_alive);
+    static const char *HttpDate_();
+
+    static constexpr size_t kDateLen = 29;  // IMF-fixdate: Sun, 06 Nov 1994 08:49:37 GMT
 
     int code_;
     bool is_keep_alive_;
     std::string path_;
     std::string src_dir_;
-    char *mm_file_;
-    struct stat mm_file_stat_;
+    std::string set_cookie_;  // Set-Cookie值，空为不设置
+    SendStrategy strategy_;
+    FileEntryPtr file_;  // 响应体文件，nullptr表示无文件响应体
 
     static const std::unordered_map<std::string, std::string> MIME_TYPE;  // 后缀类型集
     static const std::unordered_map<int, std::string> CODE_STATUS;  // 编码状态集
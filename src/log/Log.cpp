@@ -201,11 +201,13 @@ void Log::AppendLogLevelTitle_(int level) {
 }
 
 Log::~Log() {
-    while(!deque_->empty()){  // 队列非空，唤醒线程处理
-        deque_->flush();
+    if(deque_ && write_thread_){  // 未Init或同步模式时没有写线程
+        while(!deque_->empty()){  // 队列非空，唤醒线程处理
+            deque_->flush();
+        }
+        deque_->close();  // 关闭队列
+        write_thread_->join();  // 等待写入线程结束
     }
-    deque_->close();  // 关闭队列
-    write_thread_->join();  // 等待写入线程结束
     if(fp_){
         lock_guard<mutex> locker(mtx_);
         Flush();
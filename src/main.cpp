@@ -3,15 +3,26 @@
 int main() {
     WebServer server(1316,
                      3,
-                     TimerType::Loop,
+                     TimerType::Wheel,
+                     PollerType::Epoll,
+                     SendStrategy::Mmap,
                      10000,
+                     true,
                      false,
                      3306,
                      "root",
                      "123456",
                      "webserver",
                      12,
+                     SqlMode::Async,
                      6,
+                     SchedType::Steal,
+                     false,
+                     4,
+                     64,
+                     2,
+                     64,
+                     1,
                      false,
                      0,
                      1024);
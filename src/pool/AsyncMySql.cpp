@@ -0,0 +1,324 @@
+//
+// Created by 98302 on 2023/10/21.
+//
+
+#include "AsyncMySql.h"
+#include <sys/epoll.h>
+#include <cassert>
+#include <cstring>
+#include "../log/Log.h"
+#include "CredCache.h"
+#include "UserBloom.h"
+#ifdef ASYNC_MYSQL_SUPPORTED
+#include <mysql/errmsg.h>
+#include <mysql/mysqld_error.h>
+#endif
+
+using namespace std;
+
+AsyncMySql::AsyncMySql(const char *host, int port, const char *user, const char *pwd, const char *db_name,
+                       int conn_num, size_t max_inflight):
+                       AsyncSql(max_inflight), host_(host), user_(user), pwd_(pwd), db_name_(db_name), port_(port) {
+    assert(conn_num > 0);
+    for(int i=0; i<conn_num; ++i){
+        conns_.emplace_back(make_unique<Conn>());
+    }
+}
+
+#ifdef ASYNC_MYSQL_SUPPORTED
+
+/// loop已退出，在途查询不再回调
+AsyncMySql::~AsyncMySql() {
+    for(auto &conn: conns_){
+        Close_(conn.get());
+    }
+}
+
+/// 所有连接同时开始连接，连上后即可接收查询
+bool AsyncMySql::Open_() {
+    for(auto &conn: conns_){
+        Continue_(conn.get(), Connect_(conn.get()));
+    }
+    return true;
+}
+
+/// 交给空闲连接；没有空闲连接时排队，有已关闭的连接则重连，连上后取走
+void AsyncMySql::Start_(AsyncSql::Query &&query) {
+    waiting_.push_back(std::move(query));
+    for(auto &conn: conns_){
+        if(conn->step == Step::kIdle){
+            Continue_(conn.get(), Dispatch_(conn.get()));
+            return;
+        }
+    }
+    for(auto &conn: conns_){
+        if(conn->step == Step::kClosed){
+            Continue_(conn.get(), Connect_(conn.get()));
+            return;
+        }
+    }
+}
+
+/// 连接的socket就绪，继续当前一步
+void AsyncMySql::OnSocket_(int fd, uint32_t events) {
+    Conn *conn = Find_(fd);
+    if(!conn){  // 已关闭的socket的残留事件
+        return;
+    }
+    if(conn->step == Step::kIdle){  // 空闲连接只监听挂断，服务端关闭了连接，下次需要时重连
+        LOG_WARN("MySQL idle conn[%d] closed by server", fd);
+        Close_(conn);
+        return;
+    }
+    int ready = 0;
+    if(events & (EPOLLIN | EPOLLHUP | EPOLLERR)){  // 挂断与错误交给客户端库读出错误
+        ready |= MYSQL_WAIT_READ;
+    }
+    if(events & EPOLLOUT){
+        ready |= MYSQL_WAIT_WRITE;
+    }
+    if(events & EPOLLPRI){
+        ready |= MYSQL_WAIT_EXCEPT;
+    }
+    int status;
+    switch(conn->step){
+        case Step::kConnect:
+            status = mysql_real_connect_cont(&conn->connected, &conn->mysql, ready);
+            break;
+        case Step::kSelect:
+        case Step::kInsert:
+            status = mysql_real_query_cont(&conn->error, &conn->mysql, ready);
+            break;
+        case Step::kStore:
+            status = mysql_store_result_cont(&conn->result, &conn->mysql, ready);
+            break;
+        default:
+            return;
+    }
+    Continue_(conn, status);
+}
+
+/// 开始连接
+/// \param conn
+/// \return mysql_real_connect_start的等待位，0为已完成
+int AsyncMySql::Connect_(AsyncMySql::Conn *conn) {
+    mysql_init(&conn->mysql);
+    mysql_options(&conn->mysql, MYSQL_OPT_NONBLOCK, nullptr);
+    conn->step = Step::kConnect;
+    conn->connected = nullptr;
+    return mysql_real_connect_start(&conn->connected, &conn->mysql, host_.c_str(), user_.c_str(), pwd_.c_str(),
+                                    db_name_.c_str(), port_, nullptr, 0);
+}
+
+/// 一步完成（status为0）时开始下一步，直到某一步需要等待socket，按等待位监听
+/// \param conn
+/// \param status 当前一步的等待位，0为已完成，-1为没有进行中的操作
+void AsyncMySql::Continue_(AsyncMySql::Conn *conn, int status) {
+    while(status == 0){
+        status = Next_(conn);
+    }
+    if(status > 0){
+        Watch_(conn, status);
+    }
+}
+
+/// 当前一步已完成，处理结果并开始下一步
+/// \param conn
+/// \return 下一步的等待位，0为下一步也已完成，-1为没有下一步（连接空闲或已关闭）
+int AsyncMySql::Next_(AsyncMySql::Conn *conn) {
+    switch(conn->step){
+        case Step::kConnect:
+            if(!conn->connected){
+                LOG_ERROR("MySQL connect error: %s", mysql_error(&conn->mysql));
+                Close_(conn);
+                bool alive = false;
+                for(auto &other: conns_){
+                    alive = alive || other->step != Step::kClosed;
+                }
+                while(!alive && !waiting_.empty()){  // 所有连接都不可用，排队的校验失败
+                    Query query = std::move(waiting_.front());
+                    waiting_.pop_front();
+                    Finish_(query, false, false);
+                }
+                return -1;
+            }
+            return Dispatch_(conn);
+        case Step::kSelect:
+            if(conn->error){
+                return Fail_(conn);
+            }
+            conn->step = Step::kStore;
+            return mysql_store_result_start(&conn->result, &conn->mysql);
+        case Step::kStore: {
+            if(!conn->result && mysql_errno(&conn->mysql)){
+                return Fail_(conn);
+            }
+            bool exists = false;
+            string pwd;
+            if(conn->result){
+                if(MYSQL_ROW row = mysql_fetch_row(conn->result)){  // 结果集已全部取回，不再读socket
+                    exists = true;
+                    if(row[1]){
+                        pwd = row[1];
+                        CredCache::Instance()->Fill(conn->query.name, true, pwd, conn->query.ticket);
+                    }
+                }else{
+                    CredCache::Instance()->Fill(conn->query.name, false, string(), conn->query.ticket);
+                }
+                mysql_free_result(conn->result);
+                conn->result = nullptr;
+            }
+            if(conn->query.is_login){
+                Finish_(conn->query, exists, true, std::move(pwd));
+                return Dispatch_(conn);
+            }
+            if(exists){
+                LOG_INFO("user used!");
+                Finish_(conn->query, false);
+                return Dispatch_(conn);
+            }
+            UserBloom::Instance()->ReportFalsePositive();
+            return Insert_(conn);
+        }
+        case Step::kInsert:
+            if(conn->error && mysql_errno(&conn->mysql) == ER_DUP_ENTRY){  // 跳过SELECT时启动后写入的用户名由唯一键拦下
+                LOG_INFO("user used!");
+                CredCache::Instance()->Invalidate(conn->query.name);
+                Finish_(conn->query, false);
+                return Dispatch_(conn);
+            }
+            if(conn->error){
+                return Fail_(conn);
+            }
+            CredCache::Instance()->Invalidate(conn->query.name);
+            Finish_(conn->query, true);
+            return Dispatch_(conn);
+        default:
+            return -1;
+    }
+}
+
+/// 从队列取下一个查询，没有则空闲，只监听挂断
+/// \param conn
+/// \return SELECT的等待位，-1为空闲
+int AsyncMySql::Dispatch_(AsyncMySql::Conn *conn) {
+    if(waiting_.empty()){
+        conn->step = Step::kIdle;
+        Watch_(conn, 0);
+        return -1;
+    }
+    conn->query = std::move(waiting_.front());
+    waiting_.pop_front();
+    UserBloom *bloom = UserBloom::Instance();
+    if(!conn->query.is_login && !bloom->MayContain(conn->query.name)){  // 用户名一定不存在，不查询直接注册
+        bloom->Add(conn->query.name);
+        return Insert_(conn);
+    }
+    conn->order = "SELECT username, password FROM user WHERE username='" + Escape_(conn, conn->query.name) +
+                  "' LIMIT 1";
+    LOG_DEBUG("%s", conn->order.c_str());
+    return Query_(conn, Step::kSelect);
+}
+
+/// 注册：插入当前查询的用户名、口令哈希
+/// \param conn
+/// \return INSERT的等待位
+int AsyncMySql::Insert_(AsyncMySql::Conn *conn) {
+    string name = Escape_(conn, conn->query.name);
+    string pwd = Escape_(conn, conn->query.pwd);
+    conn->order = "INSERT INTO user(username, password) VALUES('" + name + "','" + pwd + "')";
+    return Query_(conn, Step::kInsert);
+}
+
+int AsyncMySql::Query_(AsyncMySql::Conn *conn, AsyncMySql::Step step) {
+    conn->step = step;
+    conn->error = 0;
+    return mysql_real_query_start(&conn->error, &conn->mysql, conn->order.data(), conn->order.size());
+}
+
+/// 查询出错，本次校验失败；连接已断开（客户端错误码）时关闭，有排队的校验则立即重连
+/// \param conn
+/// \return 下一步的等待位
+int AsyncMySql::Fail_(AsyncMySql::Conn *conn) {
+    unsigned int err = mysql_errno(&conn->mysql);
+    LOG_ERROR("MySQL query error(%u): %s", err, mysql_error(&conn->mysql));
+    Finish_(conn->query, false, false);
+    if(err < CR_MIN_ERROR){  // 服务端错误，连接可用
+        return Dispatch_(conn);
+    }
+    Close_(conn);
+    return waiting_.empty() ? -1 : Connect_(conn);
+}
+
+/// 按等待位设置socket监听的事件，socket变化（重连）时重新注册
+/// \param conn
+/// \param status 0为只监听挂断
+void AsyncMySql::Watch_(AsyncMySql::Conn *conn, int status) {
+    uint32_t events = 0;
+    if(status & (MYSQL_WAIT_READ | MYSQL_WAIT_TIMEOUT)){  // 未设置客户端超时，单独的超时位按读处理
+        events |= EPOLLIN;
+    }
+    if(status & MYSQL_WAIT_WRITE){
+        events |= EPOLLOUT;
+    }
+    if(status & MYSQL_WAIT_EXCEPT){
+        events |= EPOLLPRI;
+    }
+    int fd = static_cast<int>(mysql_get_socket(&conn->mysql));
+    if(fd != conn->fd){
+        if(conn->fd >= 0){
+            poller_->DelFd(conn->fd);
+        }
+        conn->fd = fd;
+        poller_->AddFd(fd, events, EventData(fd));
+    }else{
+        poller_->ModFd(fd, events, EventData(fd));
+    }
+}
+
+void AsyncMySql::Close_(AsyncMySql::Conn *conn) {
+    if(conn->fd >= 0){
+        poller_->DelFd(conn->fd);
+        conn->fd = -1;
+    }
+    if(conn->result){
+        mysql_free_result(conn->result);
+        conn->result = nullptr;
+    }
+    if(conn->step != Step::kClosed){
+        mysql_close(&conn->mysql);
+        conn->step = Step::kClosed;
+    }
+}
+
+AsyncMySql::Conn *AsyncMySql::Find_(int fd) {
+    for(auto &conn: conns_){
+        if(conn->fd == fd){
+            return conn.get();
+        }
+    }
+    return nullptr;
+}
+
+string AsyncMySql::Escape_(AsyncMySql::Conn *conn, const string &value) {
+    string escaped(value.size() * 2 + 1, '\0');
+    escaped.resize(mysql_real_escape_string(&conn->mysql, escaped.data(), value.data(), value.size()));
+    return escaped;
+}
+
+#else
+
+AsyncMySql::~AsyncMySql() = default;
+
+bool AsyncMySql::Open_() {
+    LOG_ERROR("MariaDB non-blocking client API unavailable!");
+    return false;
+}
+
+void AsyncMySql::Start_(AsyncSql::Query &&query) {
+    Finish_(query, false, false);
+}
+
+void AsyncMySql::OnSocket_(int /*fd*/, uint32_t /*events*/) {}
+
+#endif
@@ -0,0 +1,84 @@
+//
+// Created by 98302 on 2023/10/21.
+//
+
+#ifndef WEB_SERVER_ASYNCMYSQL_H
+#define WEB_SERVER_ASYNCMYSQL_H
+
+#include <deque>
+#include <memory>
+#include <string>
+#include <mysql/mysql.h>
+#include "AsyncSql.h"
+
+#if defined(MARIADB_BASE_VERSION) || defined(MARIADB_PACKAGE_VERSION)
+#define ASYNC_MYSQL_SUPPORTED 1  // MariaDB客户端库，提供mysql_*_start/_cont
+#endif
+
+/*
+ * MariaDB非阻塞客户端API实现的AsyncSql
+ * 每个loop conn_num个连接，连接的socket注册在loop的poller中，每一步用mysql_*_start发起、
+ * 返回的等待位（MYSQL_WAIT_READ/WRITE）决定监听的事件，就绪后mysql_*_cont继续，直到返回0
+ * 一次查询：SELECT（store_result）→ 登录交回存储的口令，注册且用户名不存在时INSERT口令哈希，与AuthStore的语义一致；
+ * 注册且UserBloom判定用户名一定不存在时跳过SELECT
+ * 没有空闲连接时查询在waiting_中排队；连接断开或查询出错时本次校验失败，连接随后重连
+ * 非阻塞API只有MariaDB客户端库（libmariadb / MariaDB Connector/C）提供，
+ * 链接MySQL官方客户端库时kSupported为false，WebServer退回SqlMode::Blocking
+ */
+class AsyncMySql: public AsyncSql {
+public:
+    AsyncMySql(const char *host, int port,
+               const char *user, const char *pwd,
+               const char *db_name, int conn_num,
+               size_t max_inflight);
+    ~AsyncMySql() override;
+
+#ifdef ASYNC_MYSQL_SUPPORTED
+    static constexpr bool kSupported = true;
+#else
+    static constexpr bool kSupported = false;
+#endif
+protected:
+    bool Open_() override;
+    void Start_(Query &&query) override;
+    void OnSocket_(int fd, uint32_t events) override;
+private:
+    enum class Step {
+        kClosed,
+        kConnect,
+        kIdle,
+        kSelect,  // 查询用户
+        kStore,  // 取结果集
+        kInsert,  // 注册
+    };
+    struct Conn{
+        MYSQL mysql;
+        Step step = Step::kClosed;
+        int fd = -1;  // 已注册在poller中的socket
+        Query query;
+        MYSQL *connected = nullptr;  // mysql_real_connect的返回
+        int error = 0;  // mysql_real_query的返回
+        MYSQL_RES *result = nullptr;
+        std::string order;  // 执行中的语句，查询完成前不可释放
+    };
+
+    int Connect_(Conn *conn);
+    void Continue_(Conn *conn, int status);
+    int Next_(Conn *conn);
+    int Dispatch_(Conn *conn);
+    int Insert_(Conn *conn);
+    int Query_(Conn *conn, Step step);
+    int Fail_(Conn *conn);
+    void Watch_(Conn *conn, int status);
+    void Close_(Conn *conn);
+    Conn *Find_(int fd);
+    static std::string Escape_(Conn *conn, const std::string &value);
+
+    std::string host_, user_, pwd_, db_name_;
+    int port_;
+    std::vector<std::unique_ptr<Conn>> conns_;  // MYSQL不可移动
+    std::deque<Query> waiting_;  // 无空闲连接时排队
+};
+
+
+#endif //WEB_SERVER_ASYNCMYSQL_H
@@ -0,0 +1,112 @@
+//
+// Created by 98302 on 2023/10/21.
+//
+
+#include "AsyncSql.h"
+#include <sys/eventfd.h>
+#include <sys/epoll.h>
+#include <unistd.h>
+#include <cassert>
+#include "../log/Log.h"
+#include "CredCache.h"
+
+using namespace std;
+
+AsyncSql::AsyncSql(size_t max_inflight): poller_(nullptr), notify_fd_(-1), max_inflight_(max_inflight),
+                                         inflight_(0), completed_(0), failed_(0) {
+    assert(max_inflight_ > 0);
+}
+
+AsyncSql::~AsyncSql() {
+    if(notify_fd_ >= 0){
+        close(notify_fd_);
+    }
+}
+
+/// 注册收件eventfd，建立后端连接，在loop开始前调用
+/// \param poller 所属loop的poller
+/// \return
+bool AsyncSql::Attach(Poller *poller) {
+    assert(poller && !poller_);
+    poller_ = poller;
+    notify_fd_ = eventfd(0, EFD_NONBLOCK | EFD_CLOEXEC);
+    if(notify_fd_ < 0){
+        LOG_ERROR("AsyncSql eventfd error!");
+        return false;
+    }
+    if(!poller_->AddFd(notify_fd_, EPOLLIN, EventData(notify_fd_))){
+        close(notify_fd_);
+        notify_fd_ = -1;
+        return false;
+    }
+    return Open_();
+}
+
+/// 提交一个查询，可在任意线程调用，callback在loop线程执行
+/// \param name
+/// \param pwd 注册时为口令哈希
+/// \param is_login
+/// \param callback
+/// \return false：在途查询已达上限，未提交
+bool AsyncSql::Submit(std::string name, std::string pwd, bool is_login, AsyncSql::Callback callback) {
+    if(inflight_.fetch_add(1, memory_order_relaxed) >= max_inflight_){
+        inflight_.fetch_sub(1, memory_order_relaxed);
+        return false;
+    }
+    uint64_t ticket = CredCache::Instance()->Ticket(name);
+    bool notify;
+    {
+        lock_guard<mutex> locker(mtx_);
+        notify = inbox_.empty();  // 非空时已通知过，loop取出时会一并取走
+        inbox_.push_back({std::move(name), std::move(pwd), is_login, std::move(callback), ticket});
+    }
+    if(notify){
+        uint64_t one = 1;
+        ssize_t ret = write(notify_fd_, &one, sizeof(one));
+        (void)ret;
+    }
+    return true;
+}
+
+/// loop线程分发本客户端的事件
+/// \param fd 收件eventfd或后端注册的fd
+/// \param events
+void AsyncSql::OnEvent(int fd, uint32_t events) {
+    if(fd == notify_fd_){
+        Drain_();
+    }else{
+        OnSocket_(fd, events);
+    }
+}
+
+/// 查询结束，在loop线程执行回调
+/// \param query
+/// \param result 登录为用户是否存在，注册为是否写入
+/// \param ok false：数据库出错，回调得到空值
+/// \param pwd 登录时为存储的口令
+void AsyncSql::Finish_(AsyncSql::Query &query, bool result, bool ok, std::string pwd) {
+    inflight_.fetch_sub(1, memory_order_relaxed);
+    if(ok){
+        completed_.store(completed_.load(memory_order_relaxed) + 1, memory_order_relaxed);
+    }else{
+        failed_.store(failed_.load(memory_order_relaxed) + 1, memory_order_relaxed);
+    }
+    Callback callback = std::move(query.callback);
+    query.callback = nullptr;
+    callback(ok ? optional<bool>(result) : nullopt, std::move(pwd));
+}
+
+/// 先清除eventfd计数再取出收件队列，之后提交的查询会再次通知
+void AsyncSql::Drain_() {
+    uint64_t count;
+    ssize_t ret = read(notify_fd_, &count, sizeof(count));
+    (void)ret;
+    {
+        lock_guard<mutex> locker(mtx_);
+        draining_.swap(inbox_);
+    }
+    for(auto &query: draining_){
+        Start_(std::move(query));
+    }
+    draining_.clear();
+}
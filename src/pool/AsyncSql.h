@@ -0,0 +1,85 @@
+//
+// Created by 98302 on 2023/10/21.
+//
+
+#ifndef WEB_SERVER_ASYNCSQL_H
+#define WEB_SERVER_ASYNCSQL_H
+
+#include <string>
+#include <vector>
+#include <mutex>
+#include <atomic>
+#include <functional>
+#include <optional>
+#include <cstdint>
+#include "../server/Poller.h"
+
+enum class SqlMode {
+    Blocking,  // SqlConnPool同步查询，在db通道（或static通道）线程中执行
+    Async,  // MariaDB非阻塞客户端，数据库socket注册在loop的poller中
+    Local,  // 进程内替身，内存用户表，按设定延迟完成，无需mysqld
+    Embedded,  // 进程内MmapAuthStore，同步校验为微秒级，在处理请求的线程内完成，无需mysqld
+};
+
+/*
+ * 非阻塞数据库客户端，每个EventLoop一个，数据库socket注册在该loop的poller中
+ * Submit可在任意线程调用（工作线程处理请求时发现需要查询），放入收件队列并写eventfd唤醒loop，不等待结果
+ * loop线程在收件eventfd可读时取出查询开始执行，数据库socket就绪时推进，完成时在loop线程执行回调
+ * 查询期间请求挂起，不占用任何线程，一个loop线程可同时有max_inflight个查询在途（排队+执行）
+ * 超出时Submit返回false，调用方响应503
+ * poller事件数据：|63..8: fd|7..0: kEventTag|，kEventTag非0/1，低位也不会是cache line对齐的槽指针
+ */
+class AsyncSql {
+public:
+    // 登录：result为用户是否存在，pwd为存储的口令；注册：result为是否写入；数据库出错时result为空
+    using Callback = std::function<void(std::optional<bool> result, std::string pwd)>;
+
+    explicit AsyncSql(size_t max_inflight);
+    virtual ~AsyncSql();
+    AsyncSql(const AsyncSql&) = delete;
+    AsyncSql &operator=(const AsyncSql&) = delete;
+
+    bool Attach(Poller *poller);
+    bool Submit(std::string name, std::string pwd, bool is_login, Callback callback);
+    void OnEvent(int fd, uint32_t events);
+    size_t InFlight() const {return inflight_.load(std::memory_order_relaxed);}
+    size_t Completed() const {return completed_.load(std::memory_order_relaxed);}
+    size_t Failed() const {return failed_.load(std::memory_order_relaxed);}
+
+    static uint64_t EventData(int fd) {return static_cast<uint64_t>(fd) << kFdShift | kEventTag;}
+    static bool IsEvent(uint64_t data) {return (data & kTagMask) == kEventTag;}
+    static int EventFd(uint64_t data) {return static_cast<int>(data >> kFdShift);}
+protected:
+    struct Query{  // 登录查询口令/注册写入
+        std::string name;
+        std::string pwd;  // 注册时为待写入的口令哈希，登录时为空
+        bool is_login;
+        Callback callback;
+        uint64_t ticket;  // CredCache::Ticket，结果回填凭据缓存时交回
+    };
+
+    virtual bool Open_() = 0;  // 在Attach中调用，建立连接并注册socket
+    virtual void Start_(Query &&query) = 0;  // loop线程，开始执行
+    virtual void OnSocket_(int fd, uint32_t events) = 0;  // loop线程，后端注册的fd就绪
+    void Finish_(Query &query, bool result, bool ok = true, std::string pwd = std::string());
+
+    Poller *poller_;
+private:
+    void Drain_();
+
+    static constexpr int kFdShift = 8;
+    static constexpr uint64_t kTagMask = 0xff;
+    static constexpr uint64_t kEventTag = 0x2a;
+
+    int notify_fd_;  // 收件eventfd
+    size_t max_inflight_;
+    std::atomic<size_t> inflight_;
+    std::atomic<size_t> completed_;  // 只由loop线程写
+    std::atomic<size_t> failed_;  // 数据库出错（连接断开、查询失败）的查询数
+    std::mutex mtx_;
+    std::vector<Query> inbox_;
+    std::vector<Query> draining_;  // loop线程取出的一批，与inbox_交换复用容量
+};
+
+
+#endif //WEB_SERVER_ASYNCSQL_H
@@ -0,0 +1,56 @@
+//
+// Created by 98302 on 2023/10/24.
+//
+
+#ifndef WEB_SERVER_AUTHSTORE_H
+#define WEB_SERVER_AUTHSTORE_H
+
+#include <string>
+#include <memory>
+#include <optional>
+
+/*
+ * 按用户名查到的记录
+ * pwd为存储的口令：PasswordHash编码的哈希，或引入哈希之前注册的明文
+ */
+struct UserRecord{
+    bool exists = false;
+    std::string pwd;
+};
+
+/*
+ * 用户凭据存储接口，db通道（或处理请求的线程）中同步调用
+ * Find：登录时取得存储的口令，比对交给hash通道，存储不接触明文口令
+ * Register：注册要求用户名不存在，不存在时写入调用方算好的口令哈希
+ * 实现：
+ *      MySqlAuthStore  SqlConnPool + user表（预处理语句）
+ *      MmapAuthStore   进程内，内存映射的开放寻址哈希表 + 只追加的注册日志，无需mysqld
+ * 进程内只有一个生效的存储，由WebServer在loop启动前Install，停止后Install(nullptr)
+ */
+class AuthStore {
+public:
+    AuthStore() = default;
+    virtual ~AuthStore() = default;
+    AuthStore(const AuthStore&) = delete;
+    AuthStore &operator=(const AuthStore&) = delete;
+
+    /// 按用户名查询
+    /// \param name 非空
+    /// \return 存储不可用时为空
+    virtual std::optional<UserRecord> Find(const std::string &name) = 0;
+    /// 注册
+    /// \param name 非空
+    /// \param pwd_hash PasswordHash::Hash的结果
+    /// \return 是否写入（用户名已存在时为false），存储不可用时为空
+    virtual std::optional<bool> Register(const std::string &name, const std::string &pwd_hash) = 0;
+
+    static AuthStore *Instance() {return instance_.get();}
+    static void Install(std::unique_ptr<AuthStore> store) {instance_ = std::move(store);}
+
+    static constexpr size_t kMaxFieldLen = 50;  // user表username/password为char(50)，口令哈希的编码不超过此长度
+private:
+    static inline std::unique_ptr<AuthStore> instance_;
+};
+
+
+#endif //WEB_SERVER_AUTHSTORE_H
@@ -0,0 +1,182 @@
+//
+// Created by 98302 on 2023/10/23.
+//
+
+#include "CredCache.h"
+#include <cassert>
+#include "../log/Log.h"
+
+using namespace std;
+
+CredCache::CredCache(): enabled_(false), shard_capacity_(kDefaultCapacity / kShardCount),
+                        ttl_(kTtlMs), negative_ttl_(kNegativeTtlMs),
+                        hits_(0), negative_hits_(0), misses_(0), evictions_(0) {}
+
+CredCache *CredCache::Instance() {
+    static CredCache cache;
+    return &cache;
+}
+
+/// 清空并开始缓存
+/// \param capacity 总项数上限
+/// \param ttl_ms 存在的用户的有效期
+/// \param negative_ttl_ms 不存在的用户的有效期
+void CredCache::Init(size_t capacity, int ttl_ms, int negative_ttl_ms) {
+    assert(capacity > 0 && ttl_ms >= 0 && negative_ttl_ms >= 0);
+    enabled_ = false;
+    shard_capacity_ = max<size_t>(capacity / kShardCount, 1);
+    ttl_ = MS(ttl_ms);
+    negative_ttl_ = MS(negative_ttl_ms);
+    Clear();
+    enabled_ = true;
+    LOG_INFO("CredCache: capacity %zu, ttl %dms, negative ttl %dms", shard_capacity_ * kShardCount,
+             ttl_ms, negative_ttl_ms);
+}
+
+void CredCache::Clear() {
+    for(auto &shard: shards_){
+        lock_guard<mutex> locker(shard.mtx);
+        ++shard.generation;
+        shard.slots.clear();
+        shard.free_slots.clear();
+        shard.index.clear();
+        shard.hand = 0;
+    }
+}
+
+/// 按用户名查缓存的记录
+/// \param name
+/// \param is_login
+/// \return 未命中（未缓存、已过期、注册且用户名不存在需要写库）时为空
+std::optional<UserRecord> CredCache::Lookup(const std::string &name, bool is_login) {
+    if(!enabled_.load(memory_order_relaxed)){
+        return nullopt;
+    }
+    Shard &shard = ShardOf_(name);
+    {
+        lock_guard<mutex> locker(shard.mtx);
+        auto it = shard.index.find(name);
+        if(it != shard.index.end()){
+            Entry &entry = shard.slots[it->second];
+            if(entry.expires <= Clock::now()){
+                Release_(shard, it->second);
+            }else if(is_login || entry.exists){
+                entry.referenced = true;
+                hits_.fetch_add(1, memory_order_relaxed);
+                if(!entry.exists){
+                    negative_hits_.fetch_add(1, memory_order_relaxed);
+                }
+                return UserRecord{entry.exists, entry.pwd};
+            }
+        }
+    }
+    misses_.fetch_add(1, memory_order_relaxed);
+    return nullopt;
+}
+
+/// 查询数据库前取得，回填时交回
+/// \param name
+/// \return 所在分片的代数
+uint64_t CredCache::Ticket(const std::string &name) {
+    Shard &shard = ShardOf_(name);
+    lock_guard<mutex> locker(shard.mtx);
+    return shard.generation;
+}
+
+/// 回填查询结果
+/// \param name
+/// \param exists 用户是否存在
+/// \param pwd 存在时为数据库中的口令
+/// \param ticket 查询前的Ticket，之后分片发生过失效时不入缓存
+void CredCache::Fill(const std::string &name, bool exists, const std::string &pwd, uint64_t ticket) {
+    if(!enabled_.load(memory_order_relaxed) || name.empty()){
+        return;
+    }
+    Shard &shard = ShardOf_(name);
+    lock_guard<mutex> locker(shard.mtx);
+    if(shard.generation != ticket){
+        return;
+    }
+    size_t slot;
+    auto it = shard.index.find(name);
+    if(it != shard.index.end()){
+        slot = it->second;
+    }else{
+        if(!shard.free_slots.empty()){
+            slot = shard.free_slots.back();
+            shard.free_slots.pop_back();
+        }else if(shard.slots.size() < shard_capacity_){
+            slot = shard.slots.size();
+            shard.slots.emplace_back();
+        }else{
+            slot = Evict_(shard);
+        }
+        shard.slots[slot].name = name;
+        shard.slots[slot].referenced = false;
+        shard.index.emplace(name, slot);
+    }
+    Entry &entry = shard.slots[slot];
+    entry.exists = exists;
+    entry.pwd = exists ? pwd : string();
+    entry.expires = Clock::now() + (exists ? ttl_ : negative_ttl_);
+}
+
+/// 用户名对应的记录已改变（注册成功），删除缓存项并使进行中的回填作废
+/// \param name
+void CredCache::Invalidate(const std::string &name) {
+    Shard &shard = ShardOf_(name);
+    lock_guard<mutex> locker(shard.mtx);
+    ++shard.generation;
+    auto it = shard.index.find(name);
+    if(it != shard.index.end()){
+        Release_(shard, it->second);
+    }
+}
+
+size_t CredCache::Size() {
+    size_t size = 0;
+    for(auto &shard: shards_){
+        lock_guard<mutex> locker(shard.mtx);
+        size += shard.index.size();
+    }
+    return size;
+}
+
+void CredCache::LogStats() {
+    size_t hits = Hits(), misses = Misses();
+    LOG_INFO("CredCache size:%zu, hits:%zu (negative:%zu), misses:%zu, hit ratio:%.3f, evictions:%zu",
+             Size(), hits, negative_hits_.load(memory_order_relaxed), misses,
+             hits + misses ? static_cast<double>(hits) / static_cast<double>(hits + misses) : 0.0,
+             evictions_.load(memory_order_relaxed));
+}
+
+/// CLOCK：跳过并清除被引用且未过期的项，取第一个未被引用（或已过期）的项
+/// \param shard 调用方已加锁，槽已满且没有空闲槽
+/// \return 腾出的槽下标
+size_t CredCache::Evict_(CredCache::Shard &shard) {
+    TimeStamp now = Clock::now();
+    while(true){
+        size_t slot = shard.hand;
+        shard.hand = (shard.hand + 1) % shard.slots.size();
+        Entry &entry = shard.slots[slot];
+        if(entry.referenced && entry.expires > now){
+            entry.referenced = false;
+            continue;
+        }
+        shard.index.erase(entry.name);
+        evictions_.fetch_add(1, memory_order_relaxed);
+        return slot;
+    }
+}
+
+/// 删除缓存项，槽放入空闲列表
+/// \param shard 调用方已加锁
+/// \param slot
+void CredCache::Release_(CredCache::Shard &shard, size_t slot) {
+    Entry &entry = shard.slots[slot];
+    shard.index.erase(entry.name);
+    entry.name.clear();
+    entry.pwd.clear();
+    entry.referenced = false;
+    shard.free_slots.push_back(slot);
+}
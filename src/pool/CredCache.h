@@ -0,0 +1,85 @@
+//
+// Created by 98302 on 2023/10/23.
+//
+
+#ifndef WEB_SERVER_CREDCACHE_H
+#define WEB_SERVER_CREDCACHE_H
+
+#include <string>
+#include <vector>
+#include <mutex>
+#include <atomic>
+#include <optional>
+#include <unordered_map>
+#include "../timer/Timer.h"
+#include "AuthStore.h"
+
+/*
+ * 进程级用户凭据缓存，读穿透：登录/注册校验先查缓存，未命中再查数据库，查询结果回填
+ * 缓存存储的口令（哈希），命中只省去数据库往返，登录的口令比对仍交给hash通道
+ * 单例模式
+ * 以用户名为键，按键哈希分为kShardCount个分片，每个分片独立加锁
+ * 每个分片最多capacity / kShardCount项，满时按CLOCK淘汰：命中置引用位，指针扫过时清除引用位，淘汰第一个未被引用的项
+ * 存在的用户缓存密码，ttl_ms后过期；不存在的用户也缓存（负缓存），negative_ttl_ms后过期
+ * 注册成功后使该用户名失效；数据库在服务外被修改时，缓存最多滞后一个TTL
+ * 回填与失效并发时以分片代数判定：查询开始前取Ticket，查询期间分片发生过失效的结果不入缓存
+ * Init之前不缓存，Lookup总是未命中
+ */
+class CredCache {
+public:
+    static CredCache *Instance();
+
+    void Init(size_t capacity = kDefaultCapacity, int ttl_ms = kTtlMs, int negative_ttl_ms = kNegativeTtlMs);
+    void Clear();
+
+    std::optional<UserRecord> Lookup(const std::string &name, bool is_login);
+    uint64_t Ticket(const std::string &name);
+    void Fill(const std::string &name, bool exists, const std::string &pwd, uint64_t ticket);
+    void Invalidate(const std::string &name);
+
+    size_t Hits() const {return hits_.load(std::memory_order_relaxed);}
+    size_t Misses() const {return misses_.load(std::memory_order_relaxed);}
+    size_t Size();
+    void LogStats();
+
+    static constexpr size_t kDefaultCapacity = 64 * 1024;
+    static constexpr int kTtlMs = 60000;
+    static constexpr int kNegativeTtlMs = 5000;
+    static constexpr size_t kShardCount = 16;
+private:
+    CredCache();
+    ~CredCache() = default;
+
+    struct Entry{
+        std::string name;  // 空为空闲槽
+        std::string pwd;  // 存储的口令
+        TimeStamp expires;
+        bool exists = false;
+        bool referenced = false;
+    };
+    struct Shard{
+        std::mutex mtx;
+        std::vector<Entry> slots;
+        std::vector<size_t> free_slots;  // 失效腾出的槽
+        std::unordered_map<std::string, size_t> index;  // 用户名 => 槽下标
+        size_t hand = 0;  // CLOCK指针
+        uint64_t generation = 0;  // 每次失效递增
+    };
+
+    Shard &ShardOf_(const std::string &name) {return shards_[std::hash<std::string>{}(name) % kShardCount];}
+    size_t Evict_(Shard &shard);
+    static void Release_(Shard &shard, size_t slot);
+
+    Shard shards_[kShardCount];
+    std::atomic<bool> enabled_;
+    size_t shard_capacity_;
+    MS ttl_;
+    MS negative_ttl_;
+    std::atomic<size_t> hits_;
+    std::atomic<size_t> negative_hits_;  // hits_中用户不存在的
+    std::atomic<size_t> misses_;  // 未缓存、已过期或需要写库（注册）
+    std::atomic<size_t> evictions_;
+};
+
+
+#endif //WEB_SERVER_CREDCACHE_H
@@ -0,0 +1,88 @@
+//
+// Created by 98302 on 2023/10/17.
+//
+
+#ifndef WEB_SERVER_INLINETASK_H
+#define WEB_SERVER_INLINETASK_H
+
+#include <cstddef>
+#include <new>
+#include <type_traits>
+#include <utility>
+
+/*
+ * 定长任务类型，替代std::function<void()>
+ * 可调用对象就地存放在kCapacity字节的内部缓冲区，构造/移动/销毁都不分配内存
+ * 超过容量或对齐要求的可调用对象编译期报错
+ * 只可移动，不可拷贝；加上两个函数指针共56字节，与环形队列槽序号合占一个cache line
+ */
+class InlineTask {
+public:
+    static constexpr size_t kCapacity = 40;
+    static constexpr size_t kAlign = alignof(void*);
+
+    InlineTask() noexcept: invoke_(nullptr), manage_(nullptr) {}
+    InlineTask(std::nullptr_t) noexcept: InlineTask() {}
+
+    template<typename F, typename Fn = std::decay_t<F>,
+             typename = std::enable_if_t<!std::is_same_v<Fn, InlineTask> && std::is_invocable_r_v<void, Fn&>>>
+    InlineTask(F &&f) {
+        static_assert(sizeof(Fn) <= kCapacity, "callable too large for InlineTask");
+        static_assert(alignof(Fn) <= kAlign, "callable over-aligned for InlineTask");
+        static_assert(std::is_nothrow_move_constructible_v<Fn>, "callable must be nothrow movable");
+        new (storage_) Fn(std::forward<F>(f));
+        invoke_ = [](void *self){ (*static_cast<Fn*>(self))(); };
+        manage_ = [](void *dst, void *src){
+            if(dst){  // 移动构造到dst并销毁src
+                new (dst) Fn(std::move(*static_cast<Fn*>(src)));
+            }
+            static_cast<Fn*>(src)->~Fn();
+        };
+    }
+
+    InlineTask(InlineTask &&other) noexcept: invoke_(other.invoke_), manage_(other.manage_) {
+        if(manage_){
+            manage_(storage_, other.storage_);
+            other.invoke_ = nullptr;
+            other.manage_ = nullptr;
+        }
+    }
+    InlineTask &operator=(InlineTask &&other) noexcept {
+        if(this != &other){
+            Reset();
+            if(other.manage_){
+                other.manage_(storage_, other.storage_);
+                invoke_ = other.invoke_;
+                manage_ = other.manage_;
+                other.invoke_ = nullptr;
+                other.manage_ = nullptr;
+            }
+        }
+        return *this;
+    }
+    InlineTask &operator=(std::nullptr_t) noexcept {
+        Reset();
+        return *this;
+    }
+    InlineTask(const InlineTask&) = delete;
+    InlineTask &operator=(const InlineTask&) = delete;
+    ~InlineTask() {Reset();}
+
+    void operator()() {invoke_(storage_);}
+    explicit operator bool() const noexcept {return invoke_ != nullptr;}
+
+    void Reset() noexcept {
+        if(manage_){
+            manage_(nullptr, storage_);
+            invoke_ = nullptr;
+            manage_ = nullptr;
+        }
+    }
+private:
+    alignas(kAlign) unsigned char storage_[kCapacity];
+    void (*invoke_)(void*);
+    void (*manage_)(void *dst, void *src);
+};
+
+
+#endif //WEB_SERVER_INLINETASK_H
@@ -0,0 +1,99 @@
+//
+// Created by 98302 on 2023/10/21.
+//
+
+#include "LocalSql.h"
+#include <sys/timerfd.h>
+#include <sys/epoll.h>
+#include <unistd.h>
+#include <cassert>
+#include "../log/Log.h"
+#include "CredCache.h"
+
+using namespace std;
+
+int LocalSql::latency_ms = 1;
+mutex LocalSql::users_mtx_;
+unordered_map<string, string> LocalSql::users_;
+
+LocalSql::LocalSql(size_t max_inflight): AsyncSql(max_inflight), timer_fd_(-1) {}
+
+LocalSql::~LocalSql() {
+    if(timer_fd_ >= 0){
+        close(timer_fd_);
+    }
+}
+
+bool LocalSql::Open_() {
+    timer_fd_ = timerfd_create(CLOCK_MONOTONIC, TFD_NONBLOCK | TFD_CLOEXEC);
+    if(timer_fd_ < 0){
+        LOG_ERROR("LocalSql timerfd error!");
+        return false;
+    }
+    return poller_->AddFd(timer_fd_, EPOLLIN, EventData(timer_fd_));
+}
+
+void LocalSql::Start_(AsyncSql::Query &&query) {
+    if(latency_ms <= 0){
+        Execute_(query);
+        return;
+    }
+    pending_.push_back({Clock::now() + MS(latency_ms), std::move(query)});
+    if(pending_.size() == 1){
+        Arm_();
+    }
+}
+
+/// timerfd到期，完成所有到期的查询
+void LocalSql::OnSocket_(int fd, uint32_t /*events*/) {
+    assert(fd == timer_fd_);
+    (void)fd;
+    uint64_t expirations;
+    ssize_t ret = read(timer_fd_, &expirations, sizeof(expirations));
+    (void)ret;
+    TimeStamp now = Clock::now();
+    while(!pending_.empty() && pending_.front().due <= now){
+        Pending item = std::move(pending_.front());
+        pending_.pop_front();
+        Execute_(item.query);
+    }
+    if(!pending_.empty()){
+        Arm_();
+    }
+}
+
+/// 与AuthStore相同的语义：登录交回存储的口令，注册要求用户名不存在；查到的记录回填凭据缓存，注册成功后使其失效
+void LocalSql::Execute_(AsyncSql::Query &query) {
+    bool result;
+    string pwd;
+    {
+        lock_guard<mutex> locker(users_mtx_);
+        auto iter = users_.find(query.name);
+        bool exists = iter != users_.end();
+        if(exists){
+            pwd = iter->second;
+        }
+        CredCache::Instance()->Fill(query.name, exists, pwd, query.ticket);
+        if(query.is_login){
+            result = exists;
+        }else if(exists){
+            LOG_INFO("user used!");
+            result = false;
+        }else{
+            users_.emplace(query.name, query.pwd);
+            CredCache::Instance()->Invalidate(query.name);
+            result = true;
+        }
+    }
+    Finish_(query, result, true, query.is_login ? std::move(pwd) : string());
+}
+
+/// 按队首到期时刻设置timerfd
+void LocalSql::Arm_() {
+    auto remain = chrono::duration_cast<chrono::nanoseconds>(pending_.front().due - Clock::now()).count();
+    remain = max<int64_t>(remain, 1);
+    itimerspec spec{};
+    spec.it_value.tv_sec = remain / 1000000000;
+    spec.it_value.tv_nsec = remain % 1000000000;
+    timerfd_settime(timer_fd_, 0, &spec, nullptr);
+}
@@ -0,0 +1,46 @@
+//
+// Created by 98302 on 2023/10/21.
+//
+
+#ifndef WEB_SERVER_LOCALSQL_H
+#define WEB_SERVER_LOCALSQL_H
+
+#include <deque>
+#include <string>
+#include <unordered_map>
+#include "AsyncSql.h"
+#include "../timer/Timer.h"
+
+/*
+ * AsyncSql的进程内替身，无需mysqld即可测试非阻塞查询路径
+ * 用户表在内存中，所有loop共用（加锁），与user表的登录查询/注册语义一致
+ * 每个查询在latency_ms毫秒后完成，模拟数据库往返：按提交顺序排队，由注册在poller中的timerfd按队首到期时刻唤醒
+ * latency_ms为0时在取出收件队列时立即完成
+ */
+class LocalSql: public AsyncSql {
+public:
+    explicit LocalSql(size_t max_inflight);
+    ~LocalSql() override;
+
+    static int latency_ms;
+protected:
+    bool Open_() override;
+    void Start_(Query &&query) override;
+    void OnSocket_(int fd, uint32_t events) override;
+private:
+    struct Pending{
+        TimeStamp due;
+        Query query;
+    };
+    void Execute_(Query &query);
+    void Arm_();
+
+    int timer_fd_;
+    std::deque<Pending> pending_;  // 延迟相同，按到期时刻有序
+
+    static std::mutex users_mtx_;
+    static std::unordered_map<std::string, std::string> users_;
+};
+
+
+#endif //WEB_SERVER_LOCALSQL_H
@@ -0,0 +1,375 @@
+//
+// Created by 98302 on 2023/10/24.
+//
+
+#include "MmapAuthStore.h"
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include <fcntl.h>
+#include <unistd.h>
+#include <cstring>
+#include <cassert>
+#include "../log/Log.h"
+
+using namespace std;
+
+MmapAuthStore::MmapAuthStore(std::string dir, bool sync): dir_(std::move(dir)), sync_(sync), log_fd_(-1),
+                                                          table_(nullptr) {
+    static_assert(sizeof(Header) <= sizeof(Slot), "header must fit in the first slot");
+}
+
+MmapAuthStore::~MmapAuthStore() {
+    Close_();
+}
+
+/// 打开日志与哈希表，表与日志不一致时按日志重建
+/// \return
+bool MmapAuthStore::Open() {
+    assert(log_fd_ < 0);
+    mkdir(dir_.c_str(), 0755);
+    log_fd_ = open((dir_ + "/users.log").c_str(), O_RDWR | O_CREAT | O_APPEND | O_CLOEXEC, 0644);
+    if(log_fd_ < 0){
+        LOG_ERROR("MmapAuthStore open %s/users.log error: %s", dir_.c_str(), strerror(errno));
+        return false;
+    }
+    struct stat st{};
+    fstat(log_fd_, &st);
+    unique_ptr<Table> table = MapTable_(dir_ + "/users.idx", 0, false);
+    if(table && table->header->clean == 1 && table->header->log_size == static_cast<uint64_t>(st.st_size)){
+        table_.store(table.get(), memory_order_release);
+        tables_.push_back(std::move(table));
+    }else{
+        if(table){
+            LOG_WARN("MmapAuthStore index out of date, rebuild from log");
+            UnmapTable_(table.get());
+        }
+        if(!Rebuild_()){
+            Close_();
+            return false;
+        }
+    }
+    Table *current = table_.load(memory_order_relaxed);
+    current->header->clean = 0;  // 运行期间表可能领先于磁盘，崩溃后重建
+    msync(current->base, sizeof(Slot), MS_SYNC);
+    LOG_INFO("MmapAuthStore: %s, %zu users, capacity %lu", dir_.c_str(), Size(), current->header->capacity);
+    return true;
+}
+
+/// 在当前表上无锁查找
+/// \param name
+/// \return
+std::optional<UserRecord> MmapAuthStore::Find(const std::string &name) {
+    UserRecord record;
+    if(name.size() > kMaxFieldLen){
+        return record;
+    }
+    if(const Slot *slot = Find_(table_.load(memory_order_acquire), name, Hash_(name))){
+        record.exists = true;
+        record.pwd.assign(slot->pwd, slot->pwd_len);
+    }
+    return record;
+}
+
+/// 用户名不存在时加写锁写入
+/// \param name
+/// \param pwd_hash
+/// \return 是否写入，写日志失败时为空
+std::optional<bool> MmapAuthStore::Register(const std::string &name, const std::string &pwd_hash) {
+    if(name.size() > kMaxFieldLen || pwd_hash.size() > kMaxFieldLen){
+        LOG_WARN("username or password longer than %zu", kMaxFieldLen);
+        return false;
+    }
+    uint64_t hash = Hash_(name);
+    if(Find_(table_.load(memory_order_acquire), name, hash)){
+        LOG_INFO("user used!");
+        return false;
+    }
+    return Register_(name, pwd_hash, hash);
+}
+
+size_t MmapAuthStore::Size() const {
+    Table *table = table_.load(memory_order_acquire);
+    return table ? atomic_ref<uint64_t>(table->header->count).load(memory_order_relaxed) : 0;
+}
+
+/// 线性探测，遇到空槽结束
+/// \param table
+/// \param name
+/// \param hash
+/// \return 未找到时为nullptr
+const MmapAuthStore::Slot *MmapAuthStore::Find_(Table *table, std::string_view name, uint64_t hash) {
+    for(uint64_t i = hash & table->mask; ; i = (i + 1) & table->mask){
+        Slot &slot = table->slots[i];
+        uint64_t published = atomic_ref<uint64_t>(slot.hash).load(memory_order_acquire);
+        if(published == 0){
+            return nullptr;
+        }
+        if(published == hash && slot.name_len == name.size() && memcmp(slot.name, name.data(), name.size()) == 0){
+            return &slot;
+        }
+    }
+}
+
+/// 写入空槽，内容写完后发布哈希值
+/// \param table 调用方持有写锁或表尚未发布
+/// \param name
+/// \param pwd
+/// \param hash
+void MmapAuthStore::Insert_(Table *table, std::string_view name, std::string_view pwd, uint64_t hash) {
+    uint64_t i = hash & table->mask;
+    while(table->slots[i].hash != 0){
+        i = (i + 1) & table->mask;
+    }
+    Slot &slot = table->slots[i];
+    slot.name_len = static_cast<uint8_t>(name.size());
+    slot.pwd_len = static_cast<uint8_t>(pwd.size());
+    memcpy(slot.name, name.data(), name.size());
+    memcpy(slot.pwd, pwd.data(), pwd.size());
+    atomic_ref<uint64_t>(slot.hash).store(hash, memory_order_release);
+}
+
+/// 注册：持写锁再查一次，需要时扩容，追加日志后写入表
+/// \return 用户名已存在时为false，扩容或写日志失败时为空
+std::optional<bool> MmapAuthStore::Register_(const std::string &name, const std::string &pwd, uint64_t hash) {
+    lock_guard<mutex> locker(write_mtx_);
+    Table *table = table_.load(memory_order_relaxed);
+    if(Find_(table, name, hash)){  // 并发注册同一用户名
+        LOG_INFO("user used!");
+        return false;
+    }
+    if(static_cast<double>(table->header->count + 1) > static_cast<double>(table->header->capacity) * kMaxLoad){
+        if(!Grow_()){
+            return nullopt;
+        }
+        table = table_.load(memory_order_relaxed);
+    }
+    if(!Append_(name, pwd)){
+        return nullopt;
+    }
+    Insert_(table, name, pwd, hash);
+    atomic_ref<uint64_t>(table->header->count).fetch_add(1, memory_order_relaxed);
+    table->header->log_size += 2 + name.size() + pwd.size() + sizeof(uint32_t);
+    LOG_DEBUG("register!");
+    return true;
+}
+
+/// 追加一条注册记录，写失败时截回原长度
+/// \param name
+/// \param pwd
+/// \return
+bool MmapAuthStore::Append_(std::string_view name, std::string_view pwd) {
+    char record[2 + 2 * kMaxFieldLen + sizeof(uint32_t)];
+    size_t len = 0;
+    record[len++] = static_cast<char>(name.size());
+    record[len++] = static_cast<char>(pwd.size());
+    memcpy(record + len, name.data(), name.size());
+    len += name.size();
+    memcpy(record + len, pwd.data(), pwd.size());
+    len += pwd.size();
+    uint32_t checksum = Checksum_(record, len);
+    memcpy(record + len, &checksum, sizeof(checksum));
+    len += sizeof(checksum);
+    ssize_t ret = write(log_fd_, record, len);
+    if(ret != static_cast<ssize_t>(len) || (sync_ && fdatasync(log_fd_) < 0)){
+        LOG_ERROR("MmapAuthStore append log error: %s", strerror(errno));
+        int err = ftruncate(log_fd_, static_cast<off_t>(table_.load(memory_order_relaxed)->header->log_size));
+        (void)err;
+        return false;
+    }
+    return true;
+}
+
+/// 以两倍容量重建到临时文件，rename替换后发布，旧表保留映射
+/// \return
+bool MmapAuthStore::Grow_() {
+    Table *old_table = table_.load(memory_order_relaxed);
+    string path = dir_ + "/users.idx";
+    unique_ptr<Table> table = MapTable_(path + ".tmp", old_table->header->capacity * 2, true);
+    if(!table){
+        return false;
+    }
+    for(uint64_t i = 0; i <= old_table->mask; ++i){
+        const Slot &slot = old_table->slots[i];
+        if(slot.hash != 0){
+            Insert_(table.get(), string_view(slot.name, slot.name_len), string_view(slot.pwd, slot.pwd_len), slot.hash);
+        }
+    }
+    table->header->count = old_table->header->count;
+    table->header->log_size = old_table->header->log_size;
+    if(rename((path + ".tmp").c_str(), path.c_str()) < 0){
+        LOG_ERROR("MmapAuthStore rename index error: %s", strerror(errno));
+        UnmapTable_(table.get());
+        return false;
+    }
+    LOG_INFO("MmapAuthStore grow to capacity %lu", table->header->capacity);
+    table_.store(table.get(), memory_order_release);
+    tables_.push_back(std::move(table));
+    return true;
+}
+
+/// 映射哈希表文件
+/// \param path
+/// \param capacity 新建时的槽数
+/// \param create true：新建（截断）；false：打开已有文件并校验Header
+/// \return 失败时为nullptr
+std::unique_ptr<MmapAuthStore::Table> MmapAuthStore::MapTable_(const std::string &path, uint64_t capacity, bool create) {
+    int fd = open(path.c_str(), O_RDWR | O_CLOEXEC | (create ? O_CREAT | O_TRUNC : 0), 0644);
+    if(fd < 0){
+        if(create || errno != ENOENT){
+            LOG_ERROR("MmapAuthStore open %s error: %s", path.c_str(), strerror(errno));
+        }
+        return nullptr;
+    }
+    size_t bytes;
+    if(create){
+        assert(capacity > 0 && (capacity & (capacity - 1)) == 0);
+        bytes = TableBytes_(capacity);
+        if(ftruncate(fd, static_cast<off_t>(bytes)) < 0){  // 稀疏文件，槽全为0
+            LOG_ERROR("MmapAuthStore ftruncate %s error: %s", path.c_str(), strerror(errno));
+            close(fd);
+            return nullptr;
+        }
+    }else{
+        Header header{};
+        struct stat st{};
+        if(fstat(fd, &st) < 0 || pread(fd, &header, sizeof(header), 0) != sizeof(header) ||
+           header.magic != kMagic || header.version != kVersion ||
+           header.capacity == 0 || (header.capacity & (header.capacity - 1)) != 0 ||
+           static_cast<uint64_t>(st.st_size) != TableBytes_(header.capacity)){
+            LOG_WARN("MmapAuthStore %s invalid", path.c_str());
+            close(fd);
+            return nullptr;
+        }
+        capacity = header.capacity;
+        bytes = TableBytes_(capacity);
+    }
+    void *base = mmap(nullptr, bytes, PROT_READ | PROT_WRITE, MAP_SHARED, fd, 0);
+    close(fd);
+    if(base == MAP_FAILED){
+        LOG_ERROR("MmapAuthStore mmap %s error: %s", path.c_str(), strerror(errno));
+        return nullptr;
+    }
+    auto table = make_unique<Table>();
+    table->base = static_cast<char*>(base);
+    table->bytes = bytes;
+    table->header = reinterpret_cast<Header*>(base);
+    table->slots = reinterpret_cast<Slot*>(table->base + sizeof(Slot));
+    table->mask = capacity - 1;
+    if(create){
+        table->header->magic = kMagic;
+        table->header->version = kVersion;
+        table->header->clean = 0;
+        table->header->capacity = capacity;
+    }
+    return table;
+}
+
+void MmapAuthStore::UnmapTable_(MmapAuthStore::Table *table) {
+    if(table->base){
+        munmap(table->base, table->bytes);
+        table->base = nullptr;
+    }
+}
+
+/// 按日志重建哈希表，截掉不完整或校验失败的尾部
+/// \return
+bool MmapAuthStore::Rebuild_() {
+    string content;
+    char buf[64 * 1024];
+    ssize_t n;
+    off_t offset = 0;
+    while((n = pread(log_fd_, buf, sizeof(buf), offset)) > 0){
+        content.append(buf, n);
+        offset += n;
+    }
+    struct Record{
+        string_view name, pwd;
+    };
+    vector<Record> records;
+    size_t pos = 0;
+    while(pos + 2 <= content.size()){
+        size_t name_len = static_cast<uint8_t>(content[pos]), pwd_len = static_cast<uint8_t>(content[pos + 1]);
+        size_t len = 2 + name_len + pwd_len;
+        uint32_t checksum;
+        if(name_len > kMaxFieldLen || pwd_len > kMaxFieldLen || pos + len + sizeof(checksum) > content.size()){
+            break;
+        }
+        memcpy(&checksum, content.data() + pos + len, sizeof(checksum));
+        if(checksum != Checksum_(content.data() + pos, len)){
+            break;
+        }
+        records.push_back({string_view(content).substr(pos + 2, name_len), string_view(content).substr(pos + 2 + name_len, pwd_len)});
+        pos += len + sizeof(checksum);
+    }
+    if(pos < content.size()){
+        LOG_WARN("MmapAuthStore truncate log tail: %zu bytes", content.size() - pos);
+        if(ftruncate(log_fd_, static_cast<off_t>(pos)) < 0){
+            LOG_ERROR("MmapAuthStore ftruncate log error: %s", strerror(errno));
+            return false;
+        }
+    }
+    uint64_t capacity = kMinCapacity;
+    while(static_cast<double>(records.size()) > static_cast<double>(capacity) * kMaxLoad){
+        capacity *= 2;
+    }
+    string path = dir_ + "/users.idx";
+    unique_ptr<Table> table = MapTable_(path + ".tmp", capacity, true);
+    if(!table){
+        return false;
+    }
+    for(auto &record: records){
+        uint64_t hash = Hash_(record.name);
+        if(!Find_(table.get(), record.name, hash)){
+            Insert_(table.get(), record.name, record.pwd, hash);
+            ++table->header->count;
+        }
+    }
+    table->header->log_size = pos;
+    if(rename((path + ".tmp").c_str(), path.c_str()) < 0){
+        LOG_ERROR("MmapAuthStore rename index error: %s", strerror(errno));
+        UnmapTable_(table.get());
+        return false;
+    }
+    table_.store(table.get(), memory_order_release);
+    tables_.push_back(std::move(table));
+    return true;
+}
+
+/// 日志落盘、表写回后标记正常关闭，解除所有映射
+void MmapAuthStore::Close_() {
+    Table *table = table_.exchange(nullptr);
+    if(table){
+        if(log_fd_ >= 0){
+            fdatasync(log_fd_);
+        }
+        msync(table->base, table->bytes, MS_SYNC);
+        table->header->clean = 1;
+        msync(table->base, sizeof(Slot), MS_SYNC);
+    }
+    for(auto &old_table: tables_){
+        UnmapTable_(old_table.get());
+    }
+    tables_.clear();
+    if(log_fd_ >= 0){
+        close(log_fd_);
+        log_fd_ = -1;
+    }
+}
+
+/// FNV-1a，0留作空槽
+uint64_t MmapAuthStore::Hash_(std::string_view name) {
+    uint64_t hash = 0xcbf29ce484222325ULL;
+    for(unsigned char ch: name){
+        hash = (hash ^ ch) * 0x100000001b3ULL;
+    }
+    return hash ? hash : 1;
+}
+
+/// FNV-1a 32位，检测日志尾部的不完整写入
+uint32_t MmapAuthStore::Checksum_(const char *data, size_t len) {
+    uint32_t sum = 0x811c9dc5U;
+    for(size_t i = 0; i < len; ++i){
+        sum = (sum ^ static_cast<unsigned char>(data[i])) * 0x01000193U;
+    }
+    return sum;
+}
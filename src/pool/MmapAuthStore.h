@@ -0,0 +1,93 @@
+//
+// Created by 98302 on 2023/10/24.
+//
+
+#ifndef WEB_SERVER_MMAPAUTHSTORE_H
+#define WEB_SERVER_MMAPAUTHSTORE_H
+
+#include <string>
+#include <string_view>
+#include <vector>
+#include <memory>
+#include <mutex>
+#include <atomic>
+#include <cstdint>
+#include "AuthStore.h"
+
+/*
+ * 进程内用户存储，无需mysqld，登录不经过网络往返
+ * 两个文件（dir下）：
+ *      users.log  只追加的注册日志，持久化的依据：|name_len:1|pwd_len:1|name|pwd|checksum:4|，注册返回前写入（sync时fdatasync）
+ *      users.idx  开放寻址（线性探测）哈希表，整个文件MAP_SHARED映射，|Header|Slot * capacity|，由日志派生
+ * 读路径无锁：槽只追加、不删除、写入后不再修改；写入方先写好用户名、口令哈希，再以release写入哈希值发布，
+ * 读方以acquire读哈希值，非0即可读该槽，为0即探测结束
+ * 写路径（注册）由write_mtx_串行：再查一次 → 追加日志 → 写入槽 → 更新Header计数
+ * 负载超过kMaxLoad时以两倍容量重建到users.idx.tmp并rename替换，新表发布后旧表的映射保留到关闭，
+ * 进行中的读方继续在旧表上完成（最多多占一倍映射）
+ * 打开时Header::clean置0并同步到磁盘，正常关闭时msync后置1；打开时clean为0（进程崩溃）、
+ * 版本或日志长度不符则按日志重建，日志尾部不完整或校验失败的记录截掉
+ */
+class MmapAuthStore: public AuthStore {
+public:
+    explicit MmapAuthStore(std::string dir, bool sync = true);
+    ~MmapAuthStore() override;
+
+    bool Open();
+    std::optional<UserRecord> Find(const std::string &name) override;
+    std::optional<bool> Register(const std::string &name, const std::string &pwd_hash) override;
+    size_t Size() const;
+
+    static constexpr uint64_t kMinCapacity = 1024;
+    static constexpr double kMaxLoad = 0.7;
+private:
+    struct Header{
+        uint64_t magic;
+        uint32_t version;
+        uint32_t clean;  // 1：上次正常关闭，表与日志一致
+        uint64_t capacity;  // 槽数，2的幂
+        uint64_t count;
+        uint64_t log_size;  // 表中已包含的日志字节数
+    };
+    struct alignas(64) Slot{
+        uint64_t hash;  // 0为空槽，发布后不再修改
+        uint8_t name_len;
+        uint8_t pwd_len;
+        char name[kMaxFieldLen];
+        char pwd[kMaxFieldLen];
+    };
+    struct Table{
+        char *base = nullptr;
+        size_t bytes = 0;
+        Header *header = nullptr;
+        Slot *slots = nullptr;
+        uint64_t mask = 0;
+    };
+
+    static const Slot *Find_(Table *table, std::string_view name, uint64_t hash);
+    static void Insert_(Table *table, std::string_view name, std::string_view pwd, uint64_t hash);
+    std::optional<bool> Register_(const std::string &name, const std::string &pwd, uint64_t hash);
+    bool Append_(std::string_view name, std::string_view pwd);
+    bool Grow_();
+
+    std::unique_ptr<Table> MapTable_(const std::string &path, uint64_t capacity, bool create);
+    static void UnmapTable_(Table *table);
+    bool Rebuild_();
+    void Close_();
+
+    static uint64_t Hash_(std::string_view name);
+    static uint32_t Checksum_(const char *data, size_t len);
+    static size_t TableBytes_(uint64_t capacity) {return sizeof(Slot) + capacity * sizeof(Slot);}
+
+    std::string dir_;
+    bool sync_;
+    int log_fd_;
+    std::atomic<Table*> table_;  // 当前表，读方无锁取用
+    std::vector<std::unique_ptr<Table>> tables_;  // 当前表与扩容前的表，关闭时一起解除映射
+    std::mutex write_mtx_;
+
+    static constexpr uint64_t kMagic = 0x5553455253544f52;  // "USERSTOR"
+    static constexpr uint32_t kVersion = 1;
+};
+
+
+#endif //WEB_SERVER_MMAPAUTHSTORE_H
@@ -0,0 +1,140 @@
+//
+// Created by 98302 on 2023/10/17.
+//
+
+#ifndef WEB_SERVER_MPMCRING_H
+#define WEB_SERVER_MPMCRING_H
+
+#include <atomic>
+#include <memory>
+#include <new>
+#include <cstddef>
+#include <cassert>
+
+/*
+ * 有界无锁多生产者多消费者环形队列（Vyukov）
+ * 每个槽带序号：序号==位置 可写，序号==位置+1 可读
+ * 生产者/消费者CAS抢占位置后独占该槽，元素在槽内就地构造/析构，不分配内存
+ * 满时TryPush失败且不移动参数，空时TryPop失败
+ * TryPushBatch一次CAS抢占连续的多个槽，批量提交只竞争一次入队位置
+ * 容量为2的幂
+ */
+template<typename T>
+class MpmcRing {
+public:
+    explicit MpmcRing(size_t capacity): cells_(new Cell[capacity]), mask_(capacity - 1) {
+        assert(capacity >= 2 && (capacity & (capacity - 1)) == 0);
+        for(size_t i=0; i<capacity; ++i){
+            cells_[i].sequence.store(i, std::memory_order_relaxed);
+        }
+        enqueue_pos_.store(0, std::memory_order_relaxed);
+        dequeue_pos_.store(0, std::memory_order_relaxed);
+    }
+    ~MpmcRing() {
+        T value;
+        while(TryPop(value)){}
+    }
+    MpmcRing(const MpmcRing&) = delete;
+    MpmcRing &operator=(const MpmcRing&) = delete;
+
+    template<typename U>
+    bool TryPush(U &&value) {
+        Cell *cell;
+        size_t pos = enqueue_pos_.load(std::memory_order_relaxed);
+        while(true){
+            cell = &cells_[pos & mask_];
+            size_t seq = cell->sequence.load(std::memory_order_acquire);
+            auto diff = static_cast<intptr_t>(seq) - static_cast<intptr_t>(pos);
+            if(diff == 0){  // 槽可写，抢占位置
+                if(enqueue_pos_.compare_exchange_weak(pos, pos + 1, std::memory_order_relaxed)){
+                    break;
+                }
+            }else if(diff < 0){  // 满
+                return false;
+            }else{  // 被其他生产者抢先
+                pos = enqueue_pos_.load(std::memory_order_relaxed);
+            }
+        }
+        new (cell->storage) T(std::forward<U>(value));
+        cell->sequence.store(pos + 1, std::memory_order_release);
+        return true;
+    }
+
+    /// 批量入队：一次抢占从当前位置起连续可写的槽（最多count个）
+    /// \param items 成功入队的前若干个元素被移走
+    /// \param count
+    /// \return 入队个数，0表示满
+    size_t TryPushBatch(T *items, size_t count) {
+        size_t pos = enqueue_pos_.load(std::memory_order_relaxed);
+        size_t n;
+        while(true){
+            n = 0;
+            while(n < count && n <= mask_ &&
+                  cells_[(pos + n) & mask_].sequence.load(std::memory_order_acquire) == pos + n){
+                ++n;
+            }
+            if(n == 0){
+                size_t seq = cells_[pos & mask_].sequence.load(std::memory_order_acquire);
+                if(static_cast<intptr_t>(seq) - static_cast<intptr_t>(pos) < 0){  // 满
+                    return 0;
+                }
+                pos = enqueue_pos_.load(std::memory_order_relaxed);  // 被其他生产者抢先
+                continue;
+            }
+            if(enqueue_pos_.compare_exchange_weak(pos, pos + n, std::memory_order_relaxed)){
+                break;
+            }
+        }
+        for(size_t i=0; i<n; ++i){
+            Cell &cell = cells_[(pos + i) & mask_];
+            new (cell.storage) T(std::move(items[i]));
+            cell.sequence.store(pos + i + 1, std::memory_order_release);
+        }
+        return n;
+    }
+
+    bool TryPop(T &value) {
+        Cell *cell;
+        size_t pos = dequeue_pos_.load(std::memory_order_relaxed);
+        while(true){
+            cell = &cells_[pos & mask_];
+            size_t seq = cell->sequence.load(std::memory_order_acquire);
+            auto diff = static_cast<intptr_t>(seq) - static_cast<intptr_t>(pos + 1);
+            if(diff == 0){  // 槽可读，抢占位置
+                if(dequeue_pos_.compare_exchange_weak(pos, pos + 1, std::memory_order_relaxed)){
+                    break;
+                }
+            }else if(diff < 0){  // 空
+                return false;
+            }else{
+                pos = dequeue_pos_.load(std::memory_order_relaxed);
+            }
+        }
+        T *item = std::launder(reinterpret_cast<T*>(cell->storage));
+        value = std::move(*item);
+        item->~T();
+        cell->sequence.store(pos + mask_ + 1, std::memory_order_release);  // 下一轮可写
+        return true;
+    }
+
+    /// 元素个数的近似值，并发修改时只作提示
+    size_t SizeApprox() const {
+        size_t enqueue = enqueue_pos_.load(std::memory_order_seq_cst);
+        size_t dequeue = dequeue_pos_.load(std::memory_order_seq_cst);
+        return enqueue > dequeue ? enqueue - dequeue : 0;
+    }
+    size_t Capacity() const {return mask_ + 1;}
+private:
+    struct alignas(64) Cell{
+        std::atomic<size_t> sequence;
+        alignas(T) unsigned char storage[sizeof(T)];
+    };
+
+    std::unique_ptr<Cell[]> cells_;
+    const size_t mask_;
+    alignas(64) std::atomic<size_t> enqueue_pos_;  // 生产者与消费者位置分属不同cache line
+    alignas(64) std::atomic<size_t> dequeue_pos_;
+};
+
+
+#endif //WEB_SERVER_MPMCRING_H
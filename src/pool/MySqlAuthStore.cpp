@@ -0,0 +1,137 @@
+//
+// Created by 98302 on 2023/10/24.
+//
+
+#include "MySqlAuthStore.h"
+#include <mysql/mysqld_error.h>
+#include "CredCache.h"
+#include "UserBloom.h"
+#include "../log/Log.h"
+
+using namespace std;
+
+MySqlAuthStore::MySqlAuthStore(SqlConnPool *pool, bool batch_insert): pool_(pool) {
+    if(batch_insert){
+        batcher_ = make_unique<RegBatcher>(pool_);
+    }
+}
+
+/// 等待排队的注册提交
+MySqlAuthStore::~MySqlAuthStore() = default;
+
+/// 按用户名查询口令，结果回填凭据缓存
+/// \param name
+/// \return 数据库不可用（取连接超时、查询出错）时为空
+std::optional<UserRecord> MySqlAuthStore::Find(const std::string &name) {
+    CredCache *cache = CredCache::Instance();
+    uint64_t ticket = cache->Ticket(name);
+    MYSQL *sql;
+    SqlConnRAII conn(&sql, pool_);
+    if(!sql){  // 连接池在deadline内没有可用连接
+        return nullopt;
+    }
+    MYSQL_STMT *stmt = pool_->GetStmt(sql, SqlConnPool::kSelectUser);
+    if(!stmt){
+        return nullopt;
+    }
+    MYSQL_BIND param[1]{};
+    unsigned long name_len = name.size();
+    BindString_(param[0], name, &name_len);
+    char password[kMaxFieldLen + 1] = {0};  // user表字段为char(50)
+    unsigned long password_len = 0;
+    MYSQL_BIND result[1]{};
+    result[0].buffer_type = MYSQL_TYPE_STRING;
+    result[0].buffer = password;
+    result[0].buffer_length = sizeof(password) - 1;
+    result[0].length = &password_len;
+    if(mysql_stmt_bind_param(stmt, param) || mysql_stmt_execute(stmt) || mysql_stmt_bind_result(stmt, result)){
+        LOG_ERROR("MySQL select error: %s", mysql_stmt_error(stmt));
+        pool_->ReportError(sql, mysql_stmt_errno(stmt));
+        return nullopt;
+    }
+    UserRecord record;
+    bool truncated = false;
+    int ret;
+    while((ret = mysql_stmt_fetch(stmt)) == 0 || ret == MYSQL_DATA_TRUNCATED){  // 取完结果，连接才能执行下一条
+        record.exists = true;
+        truncated = ret == MYSQL_DATA_TRUNCATED;
+        record.pwd.assign(password, truncated ? 0 : password_len);  // 超长的口令不可能匹配
+    }
+    mysql_stmt_free_result(stmt);
+    if(!truncated){
+        cache->Fill(name, record.exists, record.pwd, ticket);
+    }
+    return record;  // sql&conn 离开作用域自动析构
+}
+
+/// 用户名不存在时插入
+/// 用户名布隆过滤器判定一定不存在的，跳过SELECT直接插入；过滤器只在启动时加载，之后其他进程写入的用户名由唯一键拦下
+/// \param name
+/// \param pwd_hash
+/// \return 数据库不可用时为空
+std::optional<bool> MySqlAuthStore::Register(const std::string &name, const std::string &pwd_hash) {
+    UserBloom *bloom = UserBloom::Instance();
+    if(!bloom->MayContain(name)){
+        bloom->Add(name);  // 插入前加入，并发注册同一用户名的请求不再跳过查询
+    }else{
+        optional<UserRecord> record = Find(name);
+        if(!record){
+            return nullopt;
+        }
+        if(record->exists){
+            LOG_INFO("user used!");
+            return false;
+        }
+        bloom->ReportFalsePositive();
+    }
+    LOG_DEBUG("register!");
+    optional<bool> inserted = batcher_ ? batcher_->Insert(name, pwd_hash) : Insert_(name, pwd_hash);
+    if(inserted){  // 写入或唯一键冲突，缓存中该用户名都可能已过期
+        CredCache::Instance()->Invalidate(name);
+    }
+    if(inserted.value_or(false)){
+        LOG_DEBUG("User verify success!");
+    }
+    return inserted;
+}
+
+/// 不合批时单独插入一行
+/// \param name
+/// \param pwd
+/// \return 用户名已存在（唯一键冲突）时为false，数据库不可用时为空
+std::optional<bool> MySqlAuthStore::Insert_(const std::string &name, const std::string &pwd) {
+    MYSQL *sql;
+    SqlConnRAII conn(&sql, pool_);
+    if(!sql){
+        return nullopt;
+    }
+    MYSQL_STMT *stmt = pool_->GetStmt(sql, SqlConnPool::kInsertUser);
+    if(!stmt){
+        return nullopt;
+    }
+    MYSQL_BIND param[2]{};
+    unsigned long name_len = name.size(), pwd_len = pwd.size();
+    BindString_(param[0], name, &name_len);
+    BindString_(param[1], pwd, &pwd_len);
+    if(mysql_stmt_bind_param(stmt, param) || mysql_stmt_execute(stmt)){
+        if(mysql_stmt_errno(stmt) == ER_DUP_ENTRY){
+            LOG_INFO("user used!");
+            return false;
+        }
+        LOG_ERROR("MySQL insert error: %s", mysql_stmt_error(stmt));
+        pool_->ReportError(sql, mysql_stmt_errno(stmt));
+        return nullopt;
+    }
+    return true;
+}
+
+/// 绑定字符串参数
+/// \param bind
+/// \param value 执行前不可释放
+/// \param length 执行前不可释放
+void MySqlAuthStore::BindString_(MYSQL_BIND &bind, const std::string &value, unsigned long *length) {
+    bind.buffer_type = MYSQL_TYPE_STRING;
+    bind.buffer = const_cast<char*>(value.data());
+    bind.buffer_length = value.size();
+    bind.length = length;
+}
@@ -0,0 +1,34 @@
+//
+// Created by 98302 on 2023/10/24.
+//
+
+#ifndef WEB_SERVER_MYSQLAUTHSTORE_H
+#define WEB_SERVER_MYSQLAUTHSTORE_H
+
+#include "AuthStore.h"
+#include "SqlConnPool.h"
+#include "RegBatcher.h"
+
+/*
+ * user表上的AuthStore，从SqlConnPool取连接，用连接上缓存的预处理语句，参数以二进制协议绑定
+ * 查到的记录回填凭据缓存，注册成功后使其失效；口令列存PasswordHash编码的哈希，比对不在这里进行
+ * 注册时先查UserBloom，用户名一定不存在时不执行SELECT，省一次往返；过滤器启动后的假阴性由username唯一键拦下，INSERT返回false
+ * 查询与插入各自取连接，batch_insert为true时注册的INSERT交给RegBatcher组提交，等待期间不占连接
+ * 取连接超时、语句出错时返回空，调用方响应503
+ */
+class MySqlAuthStore: public AuthStore {
+public:
+    explicit MySqlAuthStore(SqlConnPool *pool, bool batch_insert = true);
+    ~MySqlAuthStore() override;
+    std::optional<UserRecord> Find(const std::string &name) override;
+    std::optional<bool> Register(const std::string &name, const std::string &pwd_hash) override;
+private:
+    std::optional<bool> Insert_(const std::string &name, const std::string &pwd);
+    static void BindString_(MYSQL_BIND &bind, const std::string &value, unsigned long *length);
+
+    SqlConnPool *pool_;
+    std::unique_ptr<RegBatcher> batcher_;  // 为空时每个注册单独INSERT
+};
+
+
+#endif //WEB_SERVER_MYSQLAUTHSTORE_H
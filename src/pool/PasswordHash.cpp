@@ -0,0 +1,66 @@
+//
+// Created by 98302 on 2023/10/28.
+//
+
+#include "PasswordHash.h"
+#include <openssl/evp.h>
+#include <openssl/rand.h>
+#include <openssl/crypto.h>
+#include <cstdio>
+#include <cctype>
+#include "../log/Log.h"
+
+using namespace std;
+
+int PasswordHash::log_n = PasswordHash::kLogN;
+
+/// 随机盐，按log_n计算
+/// \param pwd
+/// \return 编码后的哈希，失败时为空（注册按存储不可用处理）
+std::string PasswordHash::Hash(const std::string &pwd) {
+    unsigned char salt[kSaltLen], key[kKeyLen];
+    if(RAND_bytes(salt, sizeof(salt)) != 1 || !Derive_(pwd, salt, log_n, key)){
+        LOG_ERROR("PasswordHash hash error!");
+        return "";
+    }
+    char encoded[kEncodedLen + 1];
+    int len = snprintf(encoded, sizeof(encoded), "$s$%02x$", log_n);
+    len += EVP_EncodeBlock(reinterpret_cast<unsigned char*>(encoded + len), salt, sizeof(salt));
+    encoded[len++] = '$';
+    len += EVP_EncodeBlock(reinterpret_cast<unsigned char*>(encoded + len), key, sizeof(key));
+    return {encoded, static_cast<size_t>(len)};
+}
+
+/// 比对口令与存储的口令，比较不因第一个不同的字节提前结束
+/// \param pwd
+/// \param stored 编码后的哈希，或明文
+/// \return
+bool PasswordHash::Verify(const std::string &pwd, const std::string &stored) {
+    if(!IsHash(stored)){
+        return pwd.size() == stored.size() && CRYPTO_memcmp(pwd.data(), stored.data(), pwd.size()) == 0;
+    }
+    int n = stoi(stored.substr(3, 2), nullptr, 16);
+    unsigned char salt[kSaltLen + 2], expect[kKeyLen + 2], key[kKeyLen];  // 解码按3字节一组输出
+    const auto *text = reinterpret_cast<const unsigned char*>(stored.data());
+    if(n < kMinLogN || n > kMaxLogN ||
+       EVP_DecodeBlock(salt, text + 6, kSaltLen / 3 * 4) != kSaltLen ||
+       EVP_DecodeBlock(expect, text + 7 + kSaltLen / 3 * 4, kKeyLen / 3 * 4) != kKeyLen ||
+       !Derive_(pwd, salt, n, key)){
+        LOG_ERROR("PasswordHash malformed hash!");
+        return false;
+    }
+    return CRYPTO_memcmp(key, expect, kKeyLen) == 0;
+}
+
+/// 是否为Hash的编码，只检查格式
+bool PasswordHash::IsHash(std::string_view stored) {
+    return stored.size() == kEncodedLen && stored.substr(0, 3) == "$s$" && stored[5] == '$' &&
+           stored[6 + kSaltLen / 3 * 4] == '$' && isxdigit(stored[3]) && isxdigit(stored[4]);
+}
+
+bool PasswordHash::Derive_(const std::string &pwd, const unsigned char *salt, int log_n, unsigned char *key) {
+    uint64_t n = 1ULL << log_n;
+    uint64_t max_mem = 128ULL * kBlockSize * (n + kParallel + 2);  // V与B，默认上限32MB不够log_n > 14
+    return EVP_PBE_scrypt(pwd.data(), pwd.size(), salt, kSaltLen, n, kBlockSize, kParallel, max_mem,
+                          key, kKeyLen) == 1;
+}
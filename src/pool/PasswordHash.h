@@ -0,0 +1,40 @@
+//
+// Created by 98302 on 2023/10/28.
+//
+
+#ifndef WEB_SERVER_PASSWORDHASH_H
+#define WEB_SERVER_PASSWORDHASH_H
+
+#include <string>
+#include <string_view>
+
+/*
+ * 口令哈希：scrypt（OpenSSL EVP_PBE_scrypt），内存困难，一次计算占用128 * r * N字节内存、数十毫秒CPU
+ * 编码：$s$<log2(N)，两位十六进制>$<盐，16字符>$<哈希，24字符>，共kEncodedLen字节，不超过user表的char(50)
+ *      r = 8、p = 1固定；盐12字节随机，哈希取18字节，均为base64（长度为3的倍数，无填充）
+ *      N记在编码中，调整log_n只影响之后的注册，已有的哈希按各自的N校验
+ * 存储的口令不是该编码时按明文比对（引入哈希之前注册的用户）
+ * Hash与Verify耗时，只在hash通道（或没有hash通道时处理请求的线程）中调用
+ */
+class PasswordHash {
+public:
+    static std::string Hash(const std::string &pwd);
+    static bool Verify(const std::string &pwd, const std::string &stored);
+    static bool IsHash(std::string_view stored);
+
+    static int log_n;  // 新哈希的log2(N)
+
+    static constexpr int kLogN = 14;  // 16MB内存
+    static constexpr int kMinLogN = 10;
+    static constexpr int kMaxLogN = 20;
+    static constexpr int kBlockSize = 8;  // r
+    static constexpr int kParallel = 1;  // p
+    static constexpr size_t kSaltLen = 12;
+    static constexpr size_t kKeyLen = 18;
+    static constexpr size_t kEncodedLen = 3 + 2 + 1 + kSaltLen / 3 * 4 + 1 + kKeyLen / 3 * 4;
+private:
+    static bool Derive_(const std::string &pwd, const unsigned char *salt, int log_n, unsigned char *key);
+};
+
+
+#endif //WEB_SERVER_PASSWORDHASH_H
@@ -0,0 +1,194 @@
+//
+// Created by 98302 on 2023/10/26.
+//
+
+#include "RegBatcher.h"
+#include <mysql/mysqld_error.h>
+#include <unordered_set>
+#include <string_view>
+#include <cassert>
+#include "../log/Log.h"
+
+using namespace std;
+
+RegBatcher::RegBatcher(SqlConnPool *pool, int window_us, size_t max_batch): pool_(pool), window_(window_us),
+                                                                            max_batch_(max_batch), closed_(false) {
+    assert(pool_ && window_us >= 0 && max_batch_ > 0);
+    flush_thread_ = thread([this]{ FlushLoop_();});
+}
+
+/// 刷写完已排队的注册后退出
+RegBatcher::~RegBatcher() {
+    {
+        lock_guard<mutex> locker(mtx_);
+        closed_ = true;
+    }
+    flush_cond_.notify_all();
+    if(flush_thread_.joinable()){
+        flush_thread_.join();
+    }
+    LogStats();
+}
+
+/// 排队等待所在批次提交
+/// \param name 用户名，调用方已确认不存在
+/// \param pwd
+/// \return 本行是否写入，数据库不可用时为空
+std::optional<bool> RegBatcher::Insert(const std::string &name, const std::string &pwd) {
+    Pending pending{&name, &pwd, SteadyClock::now(), nullopt, false};
+    unique_lock<mutex> locker(mtx_);
+    if(closed_){
+        return nullopt;
+    }
+    queue_.push_back(&pending);
+    if(queue_.size() == 1 || queue_.size() >= max_batch_){  // 开始一个窗口，或攒满提前刷写
+        flush_cond_.notify_one();
+    }
+    done_cond_.wait(locker, [&pending]{ return pending.done;});
+    return pending.result;
+}
+
+void RegBatcher::LogStats() {
+    lock_guard<mutex> locker(mtx_);
+    LOG_INFO("RegBatcher batches:%zu, rows:%zu, avg batch:%.2f, max batch:%zu, row-by-row fallbacks:%zu",
+             batches_, rows_, batches_ ? static_cast<double>(rows_) / static_cast<double>(batches_) : 0.0,
+             max_rows_, fallbacks_);
+}
+
+/// 队首等待满窗口或攒满一批时取出刷写，结果写回后唤醒等待的请求线程
+void RegBatcher::FlushLoop_() {
+    vector<Pending*> batch;
+    unique_lock<mutex> locker(mtx_);
+    while(true){
+        flush_cond_.wait(locker, [this]{ return closed_ || !queue_.empty();});
+        if(queue_.empty()){  // 已关闭且排空
+            break;
+        }
+        flush_cond_.wait_until(locker, queue_.front()->arrival + window_,
+                               [this]{ return closed_ || queue_.size() >= max_batch_;});
+        size_t n = min(queue_.size(), max_batch_);
+        batch.assign(queue_.begin(), queue_.begin() + static_cast<ptrdiff_t>(n));
+        queue_.erase(queue_.begin(), queue_.begin() + static_cast<ptrdiff_t>(n));
+        ++batches_;
+        rows_ += n;
+        max_rows_ = max(max_rows_, n);
+        locker.unlock();
+        Flush_(batch);
+        locker.lock();
+        for(Pending *pending: batch){
+            pending->done = true;
+        }
+        done_cond_.notify_all();
+    }
+}
+
+/// 一批注册：去掉批内重复的用户名，取一个连接写入
+/// \param batch
+void RegBatcher::Flush_(std::vector<Pending*> &batch) {
+    vector<Pending*> rows;
+    unordered_set<string_view> names;
+    for(Pending *pending: batch){
+        if(names.insert(*pending->name).second){
+            rows.push_back(pending);
+        }else{
+            LOG_INFO("user used!");
+            pending->result = false;
+        }
+    }
+    MYSQL *sql = pool_->GetConn();
+    if(!sql){
+        for(Pending *pending: rows){
+            pending->result = nullopt;
+        }
+        return;
+    }
+    if(!InsertRows_(sql, rows) && !SqlConnPool::IsConnError(mysql_errno(sql))){
+        LOG_WARN("RegBatcher batch of %zu rows failed, retry row by row", rows.size());
+        ++fallbacks_;
+        InsertEach_(sql, rows);
+    }
+    pool_->FreeConn(sql);
+}
+
+/// 多行INSERT，autocommit下为一个事务
+/// \param sql
+/// \param rows
+/// \return 失败时各行结果为空
+bool RegBatcher::InsertRows_(MYSQL *sql, std::vector<Pending*> &rows) {
+    string order = "INSERT INTO user(username, password) VALUES";
+    for(size_t i = 0; i < rows.size(); ++i){
+        order += i ? ",('" : "('";
+        order += Escape_(sql, *rows[i]->name);
+        order += "','";
+        order += Escape_(sql, *rows[i]->pwd);
+        order += "')";
+    }
+    bool ok = mysql_real_query(sql, order.data(), order.size()) == 0;
+    if(!ok && mysql_errno(sql) == ER_DUP_ENTRY){  // 某行用户名已存在，整条语句回滚，逐行重试
+        LOG_INFO("MySQL batch insert duplicate: %s", mysql_error(sql));
+    }else if(!ok){
+        LOG_ERROR("MySQL batch insert error: %s", mysql_error(sql));
+        pool_->ReportError(sql, mysql_errno(sql));
+    }
+    for(Pending *pending: rows){
+        pending->result = ok ? optional<bool>(true) : nullopt;
+    }
+    return ok;
+}
+
+/// 一个事务内逐行INSERT：出错的行为false（语句级回滚），其余行一起提交
+/// \param sql
+/// \param rows
+/// \return 提交失败时各行结果为空
+bool RegBatcher::InsertEach_(MYSQL *sql, std::vector<Pending*> &rows) {
+    MYSQL_STMT *stmt = pool_->GetStmt(sql, SqlConnPool::kInsertUser);
+    if(!stmt || mysql_query(sql, "START TRANSACTION")){
+        return false;
+    }
+    for(Pending *pending: rows){
+        MYSQL_BIND param[2]{};
+        unsigned long name_len = pending->name->size(), pwd_len = pending->pwd->size();
+        param[0].buffer_type = MYSQL_TYPE_STRING;
+        param[0].buffer = const_cast<char*>(pending->name->data());
+        param[0].buffer_length = name_len;
+        param[0].length = &name_len;
+        param[1].buffer_type = MYSQL_TYPE_STRING;
+        param[1].buffer = const_cast<char*>(pending->pwd->data());
+        param[1].buffer_length = pwd_len;
+        param[1].length = &pwd_len;
+        if(mysql_stmt_bind_param(stmt, param) || mysql_stmt_execute(stmt)){
+            unsigned int err = mysql_stmt_errno(stmt);
+            if(err == ER_DUP_ENTRY){
+                LOG_INFO("user used!");
+                pending->result = false;
+                continue;
+            }
+            LOG_ERROR("MySQL insert error: %s", mysql_stmt_error(stmt));
+            if(SqlConnPool::IsConnError(err)){  // 连接断开，事务已丢失，各行为空
+                pool_->ReportError(sql, err);
+                for(Pending *row: rows){
+                    row->result = nullopt;
+                }
+                return false;
+            }
+            pending->result = false;
+            continue;
+        }
+        pending->result = true;
+    }
+    if(mysql_query(sql, "COMMIT")){
+        LOG_ERROR("MySQL commit error: %s", mysql_error(sql));
+        pool_->ReportError(sql, mysql_errno(sql));
+        for(Pending *pending: rows){
+            pending->result = nullopt;
+        }
+        return false;
+    }
+    return true;
+}
+
+string RegBatcher::Escape_(MYSQL *sql, const string &value) {
+    string escaped(value.size() * 2 + 1, '\0');
+    escaped.resize(mysql_real_escape_string(sql, escaped.data(), value.data(), value.size()));
+    return escaped;
+}
@@ -0,0 +1,76 @@
+//
+// Created by 98302 on 2023/10/26.
+//
+
+#ifndef WEB_SERVER_REGBATCHER_H
+#define WEB_SERVER_REGBATCHER_H
+
+#include <deque>
+#include <vector>
+#include <mutex>
+#include <thread>
+#include <chrono>
+#include <optional>
+#include <string>
+#include <condition_variable>
+#include "SqlConnPool.h"
+
+/*
+ * 注册INSERT的组提交
+ * 请求线程Insert放入队列后等待自己那一行的结果，不持有连接；刷写线程把一个窗口内到达的注册合成一条多行INSERT，
+ * 取一个连接、一次提交写入，之后逐个唤醒
+ * 窗口：队首等待满window_us或攒满max_batch行即刷写；刷写期间到达的注册进入下一批，负载越高批越大
+ * 逐行结果：
+ *      多行INSERT成功：全部成功（同一批内重复的用户名只有第一行写入，其余为false）
+ *      语句出错（服务端错误，如某行用户名已被其他批次或进程写入，违反唯一键）：在一个事务内逐行INSERT，
+ *      各行得到自己的结果，重复的行为false
+ *      取连接超时、连接级错误：整批为空，调用方响应503
+ * 统计：批数、行数、平均/最大批大小、回退逐行的批数
+ */
+class RegBatcher {
+public:
+    explicit RegBatcher(SqlConnPool *pool, int window_us = kWindowUs, size_t max_batch = kMaxBatch);
+    ~RegBatcher();
+    RegBatcher(const RegBatcher&) = delete;
+    RegBatcher &operator=(const RegBatcher&) = delete;
+
+    std::optional<bool> Insert(const std::string &name, const std::string &pwd);
+    void LogStats();
+
+    static constexpr int kWindowUs = 1000;
+    static constexpr size_t kMaxBatch = 64;
+private:
+    using SteadyClock = std::chrono::steady_clock;
+    struct Pending{
+        const std::string *name;  // 请求线程等待期间有效
+        const std::string *pwd;
+        SteadyClock::time_point arrival;
+        std::optional<bool> result;
+        bool done = false;
+    };
+
+    void FlushLoop_();
+    void Flush_(std::vector<Pending*> &batch);
+    bool InsertRows_(MYSQL *sql, std::vector<Pending*> &rows);
+    bool InsertEach_(MYSQL *sql, std::vector<Pending*> &rows);
+    static std::string Escape_(MYSQL *sql, const std::string &value);
+
+    SqlConnPool *pool_;
+    std::chrono::microseconds window_;
+    size_t max_batch_;
+
+    std::mutex mtx_;
+    std::condition_variable flush_cond_;  // 唤醒刷写线程
+    std::condition_variable done_cond_;  // 一批完成
+    std::deque<Pending*> queue_;
+    bool closed_;
+    std::thread flush_thread_;
+
+    size_t batches_ = 0;  // 只由刷写线程写，LogStats在关闭后读
+    size_t rows_ = 0;
+    size_t max_rows_ = 0;
+    size_t fallbacks_ = 0;
+};
+
+
+#endif //WEB_SERVER_REGBATCHER_H
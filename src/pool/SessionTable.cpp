@@ -0,0 +1,232 @@
+//
+// Created by 98302 on 2023/10/27.
+//
+
+#include "SessionTable.h"
+#include <random>
+#include <bit>
+#include <cstdio>
+#include <cinttypes>
+#include <cassert>
+#include "../log/Log.h"
+
+using namespace std;
+
+SessionTable::SessionTable(): enabled_(false), ttl_s_(kTtlS), shard_capacity_(kDefaultCapacity / kShardCount),
+                              id_key_{}, mac_key_{}, counter_(0), closed_(true),
+                              size_(0), created_(0), hits_(0), forged_(0), misses_(0), expired_(0), evictions_(0) {}
+
+SessionTable::~SessionTable() {
+    Close();
+}
+
+SessionTable *SessionTable::Instance() {
+    static SessionTable table;
+    return &table;
+}
+
+/// 清空，生成新的密钥并开始签发
+/// \param ttl_s 会话有效期
+/// \param capacity 会话总数上限
+/// \param sweep 是否启动后台扫描线程，为false时由调用方Sweep
+void SessionTable::Init(int ttl_s, size_t capacity, bool sweep) {
+    assert(ttl_s > 0 && capacity > 0);
+    Close();
+    for(auto &shard: shards_){
+        lock_guard<mutex> locker(shard.mtx);
+        shard.sessions.clear();
+        shard.expiry.clear();
+    }
+    size_ = 0;
+    ttl_s_ = ttl_s;
+    shard_capacity_ = max<size_t>(capacity / kShardCount, 1);
+    epoch_ = Clock::now();
+    random_device rd;  // getrandom
+    for(uint64_t *key: {id_key_, mac_key_}){
+        key[0] = (static_cast<uint64_t>(rd()) << 32) | rd();
+        key[1] = (static_cast<uint64_t>(rd()) << 32) | rd();
+    }
+    counter_ = 0;
+    if(sweep){
+        closed_ = false;
+        sweep_thread_ = thread([this]{ SweepLoop_();});
+    }
+    enabled_ = true;
+    LOG_INFO("SessionTable: capacity %zu, ttl %ds", shard_capacity_ * kShardCount, ttl_s);
+}
+
+/// 停止签发与扫描，已签发的令牌全部失效
+void SessionTable::Close() {
+    enabled_ = false;
+    {
+        lock_guard<mutex> locker(sweep_mtx_);
+        closed_ = true;
+    }
+    sweep_cond_.notify_all();
+    if(sweep_thread_.joinable()){
+        sweep_thread_.join();
+    }
+}
+
+/// 为用户签发会话
+/// \param user
+/// \return 令牌，未Init时为空
+std::string SessionTable::Create(const std::string &user) {
+    if(!enabled_.load(memory_order_relaxed)){
+        return "";
+    }
+    uint64_t id = SipHash_(id_key_[0], id_key_[1], counter_.fetch_add(1, memory_order_relaxed));
+    uint64_t mac = SipHash_(mac_key_[0], mac_key_[1], id);
+    Shard &shard = ShardOf_(id);
+    {
+        lock_guard<mutex> locker(shard.mtx);
+        uint32_t now = Now_();  // 在锁内取，分片内到期时刻按入队顺序单调
+        Expire_(shard, now);
+        while(shard.sessions.size() >= shard_capacity_ && !shard.expiry.empty()){  // 淘汰最早签发的
+            if(shard.sessions.erase(shard.expiry.front().id)){
+                size_.fetch_sub(1, memory_order_relaxed);
+                evictions_.fetch_add(1, memory_order_relaxed);
+            }
+            shard.expiry.pop_front();
+        }
+        uint32_t expires = now + static_cast<uint32_t>(ttl_s_);
+        shard.sessions.emplace(id, Session{user, expires});
+        shard.expiry.push_back({expires, id});
+    }
+    size_.fetch_add(1, memory_order_relaxed);
+    created_.fetch_add(1, memory_order_relaxed);
+    char token[kTokenLen + 1];
+    snprintf(token, sizeof(token), "%016" PRIx64 "%016" PRIx64, id, mac);
+    return {token, kTokenLen};
+}
+
+/// 校验令牌
+/// \param token
+/// \param user 有效时写入会话所属的用户，可为空
+/// \return 签名正确且会话未过期
+bool SessionTable::Validate(std::string_view token, std::string *user) {
+    uint64_t id, mac;
+    if(!enabled_.load(memory_order_relaxed) || token.size() != kTokenLen ||
+       !ParseHex_(token.substr(0, 16), &id) || !ParseHex_(token.substr(16), &mac) ||
+       SipHash_(mac_key_[0], mac_key_[1], id) != mac){
+        forged_.fetch_add(1, memory_order_relaxed);
+        return false;
+    }
+    Shard &shard = ShardOf_(id);
+    uint32_t now = Now_();
+    {
+        lock_guard<mutex> locker(shard.mtx);
+        auto it = shard.sessions.find(id);
+        if(it != shard.sessions.end() && it->second.expires > now){
+            if(user){
+                *user = it->second.user;
+            }
+            hits_.fetch_add(1, memory_order_relaxed);
+            return true;
+        }
+    }
+    misses_.fetch_add(1, memory_order_relaxed);
+    return false;
+}
+
+/// 删除所有分片中到期的会话
+/// \return 删除数
+size_t SessionTable::Sweep() {
+    size_t removed = 0;
+    for(auto &shard: shards_){
+        lock_guard<mutex> locker(shard.mtx);
+        removed += Expire_(shard, Now_());
+    }
+    return removed;
+}
+
+void SessionTable::LogStats() {
+    LOG_INFO("SessionTable size:%zu, created:%zu, hits:%zu, misses:%zu, forged:%zu, expired:%zu, evictions:%zu",
+             Size(), created_.load(memory_order_relaxed), hits_.load(memory_order_relaxed),
+             misses_.load(memory_order_relaxed), forged_.load(memory_order_relaxed),
+             expired_.load(memory_order_relaxed), evictions_.load(memory_order_relaxed));
+}
+
+/// 从Cookie请求头中取出会话令牌
+/// \param cookie 形如 a=1; sid=...; b=2
+/// \return 无会话Cookie时为空
+std::string_view SessionTable::FromCookie(std::string_view cookie) {
+    while(!cookie.empty()){
+        size_t end = cookie.find(';');
+        string_view pair = cookie.substr(0, end);
+        cookie = end == string_view::npos ? string_view() : cookie.substr(end + 1);
+        while(!pair.empty() && pair.front() == ' '){
+            pair.remove_prefix(1);
+        }
+        size_t eq = pair.find('=');
+        if(eq != string_view::npos && pair.substr(0, eq) == kCookieName){
+            return pair.substr(eq + 1);
+        }
+    }
+    return {};
+}
+
+uint32_t SessionTable::Now_() const {
+    return static_cast<uint32_t>(chrono::duration_cast<chrono::seconds>(Clock::now() - epoch_).count());
+}
+
+/// 从队首删除到期的会话
+/// \param shard 调用方已加锁
+/// \param now
+/// \return 删除数
+size_t SessionTable::Expire_(SessionTable::Shard &shard, uint32_t now) {
+    size_t removed = 0;
+    while(!shard.expiry.empty() && shard.expiry.front().expires <= now){
+        removed += shard.sessions.erase(shard.expiry.front().id);
+        shard.expiry.pop_front();
+    }
+    size_.fetch_sub(removed, memory_order_relaxed);
+    expired_.fetch_add(removed, memory_order_relaxed);
+    return removed;
+}
+
+/// 每kSweepMs毫秒扫描一次，Close时退出
+void SessionTable::SweepLoop_() {
+    unique_lock<mutex> locker(sweep_mtx_);
+    while(!sweep_cond_.wait_for(locker, MS(kSweepMs), [this]{ return closed_;})){
+        locker.unlock();
+        Sweep();
+        locker.lock();
+    }
+}
+
+/// SipHash-2-4，单个64位消息
+uint64_t SessionTable::SipHash_(uint64_t k0, uint64_t k1, uint64_t m) {
+    uint64_t v0 = k0 ^ 0x736f6d6570736575ULL, v1 = k1 ^ 0x646f72616e646f6dULL;
+    uint64_t v2 = k0 ^ 0x6c7967656e657261ULL, v3 = k1 ^ 0x7465646279746573ULL;
+    auto rounds = [&](int n){
+        for(int i = 0; i < n; ++i){
+            v0 += v1; v1 = rotl(v1, 13); v1 ^= v0; v0 = rotl(v0, 32);
+            v2 += v3; v3 = rotl(v3, 16); v3 ^= v2;
+            v0 += v3; v3 = rotl(v3, 21); v3 ^= v0;
+            v2 += v1; v1 = rotl(v1, 17); v1 ^= v2; v2 = rotl(v2, 32);
+        }
+    };
+    const uint64_t last = 8ULL << 56;  // 消息长度8字节，无剩余字节
+    v3 ^= m; rounds(2); v0 ^= m;
+    v3 ^= last; rounds(2); v0 ^= last;
+    v2 ^= 0xff; rounds(4);
+    return v0 ^ v1 ^ v2 ^ v3;
+}
+
+bool SessionTable::ParseHex_(std::string_view hex, uint64_t *value) {
+    uint64_t v = 0;
+    for(char ch: hex){
+        int digit;
+        if(ch >= '0' && ch <= '9'){
+            digit = ch - '0';
+        }else if(ch >= 'a' && ch <= 'f'){
+            digit = ch - 'a' + 10;
+        }else{
+            return false;
+        }
+        v = v << 4 | static_cast<uint64_t>(digit);
+    }
+    *value = v;
+    return true;
+}
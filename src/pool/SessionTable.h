@@ -0,0 +1,104 @@
+//
+// Created by 98302 on 2023/10/27.
+//
+
+#ifndef WEB_SERVER_SESSIONTABLE_H
+#define WEB_SERVER_SESSIONTABLE_H
+
+#include <string>
+#include <string_view>
+#include <deque>
+#include <mutex>
+#include <atomic>
+#include <thread>
+#include <cstdint>
+#include <unordered_map>
+#include <condition_variable>
+#include "../timer/Timer.h"
+
+/*
+ * 进程级会话表：登录/注册成功后签发会话，之后的请求凭Cookie中的令牌识别用户，不再查询数据库
+ * 单例模式
+ * 令牌：32位十六进制 = 会话id(64位) + MAC(64位)
+ *      会话id = SipHash-2-4(id_key, 递增计数)，不可预测
+ *      MAC = SipHash-2-4(mac_key, 会话id)，两个密钥在Init时随机生成，重启后之前的令牌全部失效
+ *      校验先验MAC，伪造的令牌不加锁、不查表即拒绝
+ * 按会话id分为kShardCount个分片，每个分片独立加锁（锁分段）
+ * 过期：有效期固定为ttl_s秒，不续期，每个分片按签发顺序记录(到期时刻, id)，即按到期时刻有序
+ *      后台线程每kSweepMs毫秒扫描各分片队首，删除到期的会话；Validate同时检查到期时刻，扫描间隔内到期的会话同样无效
+ * 每个分片最多capacity / kShardCount个会话，满时淘汰最早签发的
+ * Init之前不签发，Validate总是false
+ */
+class SessionTable {
+public:
+    static SessionTable *Instance();
+
+    void Init(int ttl_s = kTtlS, size_t capacity = kDefaultCapacity, bool sweep = true);
+    void Close();
+
+    std::string Create(const std::string &user);
+    bool Validate(std::string_view token, std::string *user = nullptr);
+    size_t Sweep();
+    int TtlSeconds() const {return ttl_s_;}
+
+    size_t Size() const {return size_.load(std::memory_order_relaxed);}
+    void LogStats();
+
+    static std::string_view FromCookie(std::string_view cookie);
+
+    static constexpr char kCookieName[] = "sid";
+    static constexpr size_t kTokenLen = 32;
+    static constexpr int kTtlS = 1800;
+    static constexpr size_t kDefaultCapacity = 1 << 20;
+    static constexpr size_t kShardCount = 64;
+    static constexpr int kSweepMs = 1000;
+private:
+    SessionTable();
+    ~SessionTable();
+
+    struct Session{
+        std::string user;
+        uint32_t expires;  // Init之后的秒数
+    };
+    struct Expiry{
+        uint32_t expires;
+        uint64_t id;
+    };
+    struct alignas(64) Shard{
+        std::mutex mtx;
+        std::unordered_map<uint64_t, Session> sessions;
+        std::deque<Expiry> expiry;  // 按到期时刻有序
+    };
+
+    Shard &ShardOf_(uint64_t id) {return shards_[id % kShardCount];}
+    uint32_t Now_() const;
+    size_t Expire_(Shard &shard, uint32_t now);
+    void SweepLoop_();
+    static uint64_t SipHash_(uint64_t k0, uint64_t k1, uint64_t m);
+    static bool ParseHex_(std::string_view hex, uint64_t *value);
+
+    Shard shards_[kShardCount];
+    std::atomic<bool> enabled_;
+    int ttl_s_;
+    size_t shard_capacity_;
+    TimeStamp epoch_;
+    uint64_t id_key_[2];
+    uint64_t mac_key_[2];
+    std::atomic<uint64_t> counter_;
+
+    std::mutex sweep_mtx_;
+    std::condition_variable sweep_cond_;
+    bool closed_;
+    std::thread sweep_thread_;
+
+    std::atomic<size_t> size_;
+    std::atomic<size_t> created_;
+    std::atomic<size_t> hits_;
+    std::atomic<size_t> forged_;  // MAC不符
+    std::atomic<size_t> misses_;  // MAC正确但已过期、已淘汰或来自重启前
+    std::atomic<size_t> expired_;  // 到期删除
+    std::atomic<size_t> evictions_;
+};
+
+
+#endif //WEB_SERVER_SESSIONTABLE_H
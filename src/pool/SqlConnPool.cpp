@@ -3,6 +3,15 @@
 //
 
 #include "SqlConnPool.h"
+#include <cstring>
+#include <mysql/errmsg.h>
+
+using namespace std;
+
+const char *const SqlConnPool::STMT_SQL[kStmtCount] = {
+        "SELECT password FROM user WHERE username=? LIMIT 1",
+        "INSERT INTO user(username, password) VALUES(?,?)",
+};
 
 /// 获取单例，懒汉模式
 /// \return
@@ -11,69 +20,372 @@ SqlConnPool *SqlConnPool::Instance() {
     return &pool;
 }
 
-/// 连接池取用连接
-/// \return
-MYSQL *SqlConnPool::GetConn() {
+/// 连接池取用连接，没有空闲连接时等待，未达上限则请后台线程新建
+/// \param timeout_ms 等待上限，-1取acquire_timeout_ms
+/// \return 超时或连接池已关闭时nullptr
+MYSQL *SqlConnPool::GetConn(int timeout_ms) {
+    auto begin = SteadyClock::now();
+    auto deadline = begin + chrono::milliseconds(timeout_ms < 0 ? acquire_timeout_ms_ : timeout_ms);
+    unique_lock<mutex> locker(mtx_);
     MYSQL *conn = nullptr;
-    if(conn_queue_.empty()){  // 连接池已耗尽
+    while(!closed_){
+        if(!idle_.empty()){
+            conn = idle_.back();
+            idle_.pop_back();
+            break;
+        }
+        if(total_ < max_conn_){  // 预留名额，由后台线程建立
+            ++total_;
+            ++to_open_;
+            maintain_cond_.notify_one();
+        }
+        if(cond_.wait_until(locker, deadline) == cv_status::timeout && idle_.empty()){
+            break;
+        }
+    }
+    auto now = SteadyClock::now();
+    if(!conn){
+        ++timeouts_;
         LOG_WARN("SqlConnPool busy!");
         return nullptr;
     }
-    sem_wait(&sem_id_);  // -1
-    lock_guard<mutex> locker(mtx_);
-    conn = conn_queue_.front();
-    conn_queue_.pop();
+    ConnInfo &info = conns_[conn];
+    info.since = now;
+    info.in_use = true;
+    ++acquired_;
+    ++in_use_;
+    peak_in_use_ = max(peak_in_use_, in_use_);
+    wait_total_ += now - begin;
+    wait_max_ = max(wait_max_, now - begin);
     return conn;
 }
 
-/// 释放连接回连接池
+/// 释放连接回连接池，使用中发现断开的连接关闭
 /// \param conn
 void SqlConnPool::FreeConn(MYSQL *conn) {
     assert(conn);
-    lock_guard<mutex> locker(mtx_);
-    conn_queue_.push(conn);
-    sem_post(&sem_id_);  // +1
+    unique_lock<mutex> locker(mtx_);
+    auto now = SteadyClock::now();
+    ConnInfo &info = conns_[conn];
+    busy_total_ += now - info.since;
+    info.since = now;
+    info.in_use = false;
+    --in_use_;
+    if(info.broken || closed_){
+        broken_ += info.broken;
+        locker.unlock();
+        Close_(conn);
+        return;
+    }
+    idle_.push_back(conn);
+    cond_.notify_one();
 }
 
 int SqlConnPool::GetFreeConnCount() {
     lock_guard<mutex> locker(mtx_);
-    return static_cast<int>(conn_queue_.size());
+    return static_cast<int>(idle_.size());
 }
 
-/// 初始化连接池
+/// 初始化连接池，建立min_size个连接，失败的不放入池中，由后台线程补足
 /// \param host
 /// \param port
 /// \param user
 /// \param pwd
 /// \param db_name
-/// \param conn_size
+/// \param min_size
+/// \param max_size 0为与min_size相同
+/// \param acquire_timeout_ms GetConn的默认等待上限
+/// \param idle_timeout_ms 空闲超过该时长且总数超过min_size的连接关闭
+/// \param health_interval_ms 健康检查周期
 void
-SqlConnPool::Init(const char *host, int port, const char *user, const char *pwd, const char *db_name, int conn_size) {
-    assert(conn_size > 0);
-    for(int i=0; i<conn_size; ++i){  // 创建连接
-        MYSQL *conn = nullptr;
-        conn = mysql_init(conn);
+SqlConnPool::Init(const char *host, int port, const char *user, const char *pwd, const char *db_name,
+                  int min_size, int max_size, int acquire_timeout_ms, int idle_timeout_ms, int health_interval_ms) {
+    assert(min_size >= 0 && (max_size == 0 ? min_size > 0 : max_size >= min_size));
+    assert(acquire_timeout_ms >= 0 && idle_timeout_ms > 0 && health_interval_ms > 0);
+    mysql_library_init(0, nullptr, nullptr);  // 多线程建立连接之前初始化
+    host_ = host;
+    user_ = user;
+    pwd_ = pwd;
+    db_name_ = db_name;
+    port_ = port;
+    min_conn_ = min_size;
+    max_conn_ = max_size == 0 ? min_size : max_size;
+    acquire_timeout_ms_ = acquire_timeout_ms;
+    idle_timeout_ms_ = idle_timeout_ms;
+    health_interval_ms_ = health_interval_ms;
+    start_ = SteadyClock::now();
+    closed_ = false;
+    for(int i=0; i<min_conn_; ++i){  // 创建连接
+        MYSQL *conn = Connect_();
         if(!conn){
-            LOG_ERROR("MySQL Init error!");
-            assert(conn);
+            break;  // 数据库不可用，剩余的由后台线程重试
         }
-        conn = mysql_real_connect(conn, host, user, pwd, db_name, port, nullptr, 0);
-        if(!conn){
-            LOG_ERROR("MySQL connect error!");
-        }
-        conn_queue_.emplace(conn);
+        lock_guard<mutex> locker(mtx_);
+        ++total_;
+        idle_.push_back(conn);
     }
-    max_conn_ = conn_size;
-    sem_init(&sem_id_, 0, max_conn_);  // 信号量初始化为最大连接数
+    maintain_thread_ = thread([this]{ MaintainLoop_();});
 }
 
-/// 关闭连接池，逐个关闭连接
+/// 关闭连接池，逐个关闭空闲连接，在用的连接归还时关闭
 void SqlConnPool::ClosePool() {
+    {
+        lock_guard<mutex> locker(mtx_);
+        if(closed_){
+            return;
+        }
+        closed_ = true;
+    }
+    maintain_cond_.notify_all();
+    cond_.notify_all();
+    if(maintain_thread_.joinable()){
+        maintain_thread_.join();
+    }
+    deque<MYSQL*> idle;
+    {
+        lock_guard<mutex> locker(mtx_);
+        idle.swap(idle_);
+    }
+    for(MYSQL *conn: idle){
+        Close_(conn);
+    }
+    mysql_library_end();
+}
+
+/// 取连接上已准备的语句，首次使用或重连后准备
+/// \param conn 调用方持有的连接
+/// \param id
+/// \return 准备失败时nullptr
+MYSQL_STMT *SqlConnPool::GetStmt(MYSQL *conn, SqlConnPool::StmtId id) {
+    assert(conn && id < kStmtCount);
+    StmtCache *cache;
+    {
+        lock_guard<mutex> locker(mtx_);
+        auto iter = conns_.find(conn);
+        assert(iter != conns_.end());
+        cache = &iter->second.stmt_cache;
+    }
+    unsigned long thread_id = mysql_thread_id(conn);
+    if(thread_id != cache->thread_id){  // 重连后服务端的语句已不存在
+        CloseStmts_(*cache);
+        cache->thread_id = thread_id;
+    }
+    if(!cache->stmts[id]){
+        MYSQL_STMT *stmt = mysql_stmt_init(conn);
+        if(!stmt || mysql_stmt_prepare(stmt, STMT_SQL[id], strlen(STMT_SQL[id]))){
+            LOG_ERROR("MySQL prepare error: %s", stmt ? mysql_stmt_error(stmt) : mysql_error(conn));
+            if(stmt){
+                ReportError(conn, mysql_stmt_errno(stmt));
+                mysql_stmt_close(stmt);
+            }
+            return nullptr;
+        }
+        cache->stmts[id] = stmt;
+    }
+    return cache->stmts[id];
+}
+
+/// 关闭连接上缓存的语句，下次使用时重新准备
+/// \param conn
+void SqlConnPool::InvalidateStmts(MYSQL *conn) {
+    StmtCache *cache = nullptr;
+    {
+        lock_guard<mutex> locker(mtx_);
+        auto iter = conns_.find(conn);
+        if(iter != conns_.end()){
+            cache = &iter->second.stmt_cache;
+        }
+    }
+    if(cache){
+        CloseStmts_(*cache);
+    }
+}
+
+/// 调用方持有的连接上查询出错：语句缓存失效；客户端错误码（断开、超时等）的连接归还时关闭
+/// \param conn
+/// \param err mysql_errno / mysql_stmt_errno
+void SqlConnPool::ReportError(MYSQL *conn, unsigned int err) {
+    InvalidateStmts(conn);
+    if(IsConnError(err)){
+        lock_guard<mutex> locker(mtx_);
+        conns_[conn].broken = true;
+    }
+}
+
+/// 客户端错误码（CR_*）：连接断开、超时等，连接不可再用；其余为服务端错误，连接可用
+bool SqlConnPool::IsConnError(unsigned int err) {
+    return err >= CR_MIN_ERROR && err <= CR_MAX_ERROR;
+}
+
+SqlConnPool::Stats SqlConnPool::GetStats() {
     lock_guard<mutex> locker(mtx_);
-    while (!conn_queue_.empty()){
-        auto conn = conn_queue_.front();
-        conn_queue_.pop();
+    Stats stats{};
+    stats.total = total_;
+    stats.idle = static_cast<int>(idle_.size());
+    stats.in_use = in_use_;
+    stats.peak_in_use = peak_in_use_;
+    stats.acquired = acquired_;
+    stats.timeouts = timeouts_;
+    stats.connect_errors = connect_errors_;
+    stats.reaped = reaped_;
+    stats.broken = broken_;
+    using MsDouble = chrono::duration<double, milli>;
+    stats.wait_avg_ms = acquired_ ? MsDouble(wait_total_).count() / acquired_ : 0;
+    stats.wait_max_ms = MsDouble(wait_max_).count();
+    auto now = SteadyClock::now();
+    auto busy = busy_total_;
+    for(auto &item: conns_){  // 计入在用连接至今的占用时间
+        if(item.second.in_use){
+            busy += now - item.second.since;
+        }
+    }
+    double capacity = MsDouble(now - start_).count() * max_conn_;
+    stats.utilisation = capacity > 0 ? MsDouble(busy).count() / capacity : 0;
+    return stats;
+}
+
+void SqlConnPool::LogStats() {
+    if(max_conn_ == 0){  // 未初始化
+        return;
+    }
+    Stats stats = GetStats();
+    LOG_INFO("SqlConnPool conns:%d(idle:%d, in use:%d, peak:%d)/[%d, %d], acquired:%zu, timeouts:%zu, "
+             "wait avg:%.3fms max:%.3fms, utilisation:%.1f%%, connect errors:%zu, reaped:%zu, broken:%zu",
+             stats.total, stats.idle, stats.in_use, stats.peak_in_use, min_conn_, max_conn_,
+             stats.acquired, stats.timeouts, stats.wait_avg_ms, stats.wait_max_ms, stats.utilisation * 100,
+             stats.connect_errors, stats.reaped, stats.broken);
+}
+
+/// 建立一个连接，不占用锁
+/// \return 失败时nullptr
+MYSQL *SqlConnPool::Connect_() {
+    MYSQL *conn = mysql_init(nullptr);
+    if(!conn){
+        LOG_ERROR("MySQL Init error!");
+        return nullptr;
+    }
+    unsigned int timeout = kIoTimeoutS;
+    mysql_options(conn, MYSQL_OPT_CONNECT_TIMEOUT, &timeout);
+    mysql_options(conn, MYSQL_OPT_READ_TIMEOUT, &timeout);
+    mysql_options(conn, MYSQL_OPT_WRITE_TIMEOUT, &timeout);
+    if(!mysql_real_connect(conn, host_.c_str(), user_.c_str(), pwd_.c_str(), db_name_.c_str(), port_, nullptr, 0)){
+        LOG_ERROR("MySQL connect error: %s", mysql_error(conn));
         mysql_close(conn);
+        lock_guard<mutex> locker(mtx_);
+        ++connect_errors_;
+        return nullptr;
+    }
+    lock_guard<mutex> locker(mtx_);
+    ConnInfo &info = conns_[conn];
+    info.since = SteadyClock::now();
+    return conn;
+}
+
+/// 关闭一个已从空闲队列取出（或归还时）的连接，释放名额，不足min_size时下次检查补足
+/// \param conn
+void SqlConnPool::Close_(MYSQL *conn) {
+    StmtCache cache;
+    {
+        lock_guard<mutex> locker(mtx_);
+        auto iter = conns_.find(conn);
+        assert(iter != conns_.end());
+        cache = iter->second.stmt_cache;
+        conns_.erase(iter);
+        --total_;
+    }
+    CloseStmts_(cache);
+    mysql_close(conn);
+    cond_.notify_one();  // 名额空出，等待者可请求新建
+    maintain_cond_.notify_one();
+}
+
+/// 后台线程：建立预留的连接；周期性健康检查，之后补足min_size
+void SqlConnPool::MaintainLoop_() {
+    unique_lock<mutex> locker(mtx_);
+    auto next_check = SteadyClock::now() + chrono::milliseconds(health_interval_ms_);
+    while(!closed_){
+        maintain_cond_.wait_until(locker, next_check, [this]{ return closed_ || to_open_ > 0;});
+        if(closed_){
+            break;
+        }
+        if(to_open_ == 0 && SteadyClock::now() >= next_check){
+            locker.unlock();
+            HealthCheck_();
+            locker.lock();
+            next_check = SteadyClock::now() + chrono::milliseconds(health_interval_ms_);
+            while(total_ < min_conn_){  // 补足下限（启动时未建成、断开后关闭的）
+                ++total_;
+                ++to_open_;
+            }
+        }
+        while(!closed_ && to_open_ > 0){
+            --to_open_;
+            locker.unlock();
+            MYSQL *conn = Connect_();
+            locker.lock();
+            if(!conn){  // 数据库不可用，放弃其余预留，等待者超时后响应503，下次检查再重试
+                total_ -= to_open_ + 1;
+                to_open_ = 0;
+                break;
+            }
+            idle_.push_back(conn);
+            cond_.notify_one();
+        }
+    }
+    total_ -= to_open_;
+    to_open_ = 0;
+}
+
+/// 回收空闲超时的连接，ping空闲超过一个检查周期的连接，断开的关闭
+/// idle_按归还时刻从旧到新排列，两类连接都是队首的一段
+void SqlConnPool::HealthCheck_() {
+    vector<MYSQL*> reap, check;
+    {
+        lock_guard<mutex> locker(mtx_);
+        auto now = SteadyClock::now();
+        int open = total_ - to_open_;
+        while(!idle_.empty() && open - static_cast<int>(reap.size()) > min_conn_ &&
+              now - conns_[idle_.front()].since >= chrono::milliseconds(idle_timeout_ms_)){
+            reap.push_back(idle_.front());
+            idle_.pop_front();
+        }
+        auto interval = chrono::milliseconds(health_interval_ms_);
+        while(!idle_.empty() && now - conns_[idle_.front()].since >= interval){  // 最近用过的连接不检查
+            check.push_back(idle_.front());
+            idle_.pop_front();
+        }
+        reaped_ += reap.size();
+    }
+    for(MYSQL *conn: reap){
+        Close_(conn);
+    }
+    vector<MYSQL*> alive;
+    for(MYSQL *conn: check){
+        if(mysql_ping(conn)){
+            LOG_WARN("MySQL ping error: %s", mysql_error(conn));
+            {
+                lock_guard<mutex> locker(mtx_);
+                ++broken_;
+            }
+            Close_(conn);
+        }else{
+            alive.push_back(conn);
+        }
+    }
+    lock_guard<mutex> locker(mtx_);
+    for(auto iter=alive.rbegin(); iter!=alive.rend(); ++iter){  // 按原顺序放回队首
+        idle_.push_front(*iter);
+    }
+    if(!alive.empty()){
+        cond_.notify_all();
+    }
+}
+
+void SqlConnPool::CloseStmts_(SqlConnPool::StmtCache &cache) {
+    for(auto &stmt: cache.stmts){
+        if(stmt){
+            mysql_stmt_close(stmt);
+            stmt = nullptr;
+        }
     }
-    mysql_library_end();
 }
@@ -5,32 +5,132 @@
 #ifndef WEB_SERVER_SQLCONNPOOL_H
 #define WEB_SERVER_SQLCONNPOOL_H
 
-#include <queue>
+#include <deque>
 #include <mutex>
+#include <thread>
+#include <chrono>
+#include <string>
+#include <condition_variable>
+#include <unordered_map>
 #include <mysql/mysql.h>
-#include <semaphore>
 #include <cassert>
 
 #include "../log/Log.h"
 
+/*
+ * 数据库连接池，弹性伸缩，后台健康检查
+ * 连接数在[min_size, max_size]之间：
+ *      GetConn优先取最近归还的空闲连接（栈序），常用的连接保持热、冷的连接留在队首等待回收
+ *      没有空闲连接且未达max_size时预留名额，由后台线程建立连接，请求线程只等待，不在请求路径上阻塞于connect
+ *      等待超过deadline返回nullptr，调用方响应503，数据库故障时工作线程不会挂起
+ * 后台线程：
+ *      建立被请求的连接
+ *      每health_interval_ms检查一次：空闲超过idle_timeout_ms且总数超过min_size的连接关闭（回收），
+ *      空闲超过一个检查周期的连接mysql_ping，失败的关闭；之后补足min_size（启动时未建成的、断开后关闭的）
+ * 连接设置连接/读/写超时kIoTimeoutS，数据库无响应时查询出错返回而不是无限阻塞
+ * 查询出错时调用方ReportError：语句缓存失效，连接级错误（断开、超时）的连接归还时关闭
+ * 统计：获取次数、超时次数、等待时间（平均/最大）、在用/峰值、利用率（连接占用时间 / (运行时间 * max_size)）
+ * 预处理语句缓存：每个连接的登录SELECT与注册INSERT在首次使用时mysql_stmt_prepare一次，MYSQL_STMT句柄缓存在池中，
+ * 之后的请求只绑定参数执行（二进制协议），服务端不再逐次解析、优化SQL文本
+ * 连接的thread id变化（重连）时缓存的句柄已失效，关闭后重新准备
+ * 连接表的增删与查找加锁，表项只由当前持有该连接的线程访问（unordered_map的节点引用在增删其他项时不失效）
+ */
 class SqlConnPool {
 public:
+    enum StmtId {
+        kSelectUser,  // SELECT password FROM user WHERE username=? LIMIT 1
+        kInsertUser,  // INSERT INTO user(username, password) VALUES(?,?)
+        kStmtCount,
+    };
+    struct Stats{
+        int total;  // 已打开与正在建立的连接
+        int idle;
+        int in_use;
+        int peak_in_use;
+        size_t acquired;
+        size_t timeouts;  // 等待超过deadline
+        size_t connect_errors;
+        size_t reaped;  // 空闲回收
+        size_t broken;  // 检查或使用中发现断开而关闭
+        double wait_avg_ms;
+        double wait_max_ms;
+        double utilisation;
+    };
+
     static SqlConnPool *Instance();
-    MYSQL *GetConn();
+    MYSQL *GetConn(int timeout_ms = -1);
     void FreeConn(MYSQL *conn);
     int GetFreeConnCount();
     void Init(const char *host, int port,
               const char *user, const char *pwd,
-              const char *db_name, int conn_size);
+              const char *db_name, int min_size, int max_size = 0,
+              int acquire_timeout_ms = kAcquireTimeoutMs,
+              int idle_timeout_ms = kIdleTimeoutMs,
+              int health_interval_ms = kHealthIntervalMs);
     void ClosePool();
+    MYSQL_STMT *GetStmt(MYSQL *conn, StmtId id);
+    void InvalidateStmts(MYSQL *conn);
+    void ReportError(MYSQL *conn, unsigned int err);
+    static bool IsConnError(unsigned int err);
+    Stats GetStats();
+    void LogStats();
+
+    static constexpr int kAcquireTimeoutMs = 200;
+    static constexpr int kIdleTimeoutMs = 60000;
+    static constexpr int kHealthIntervalMs = 5000;
+    static constexpr unsigned int kIoTimeoutS = 3;
 private:
+    using SteadyClock = std::chrono::steady_clock;
+    struct StmtCache{
+        unsigned long thread_id = 0;  // 准备语句时连接的thread id
+        MYSQL_STMT *stmts[kStmtCount] = {};
+    };
+    struct ConnInfo{
+        StmtCache stmt_cache;
+        SteadyClock::time_point since;  // 在用时为取出时刻，空闲时为归还时刻
+        bool in_use = false;
+        bool broken = false;  // 归还时关闭
+    };
+
     SqlConnPool() = default;
     ~SqlConnPool() {ClosePool();}
+    MYSQL *Connect_();
+    void Close_(MYSQL *conn);
+    void MaintainLoop_();
+    void HealthCheck_();
+    static void CloseStmts_(StmtCache &cache);
+
+    std::string host_, user_, pwd_, db_name_;
+    int port_ = 0;
+    int min_conn_ = 0;
+    int max_conn_ = 0;
+    int acquire_timeout_ms_ = kAcquireTimeoutMs;
+    int idle_timeout_ms_ = kIdleTimeoutMs;
+    int health_interval_ms_ = kHealthIntervalMs;
+
+    std::mutex mtx_;
+    std::condition_variable cond_;  // 有连接可取
+    std::condition_variable maintain_cond_;  // 唤醒后台线程
+    std::thread maintain_thread_;
+    bool closed_ = true;
+    int total_ = 0;  // 已打开的连接 + to_open_
+    int to_open_ = 0;  // 已预留名额、等待后台线程建立的连接
+    int in_use_ = 0;
+    std::deque<MYSQL*> idle_;  // 队尾为最近归还
+    std::unordered_map<MYSQL*, ConnInfo> conns_;  // 所有已打开的连接
+
+    int peak_in_use_ = 0;
+    size_t acquired_ = 0;
+    size_t timeouts_ = 0;
+    size_t connect_errors_ = 0;
+    size_t reaped_ = 0;
+    size_t broken_ = 0;
+    SteadyClock::duration wait_total_{};
+    SteadyClock::duration wait_max_{};
+    SteadyClock::duration busy_total_{};  // 连接被占用的总时长
+    SteadyClock::time_point start_;
 
-    int max_conn_;
-    std::queue<MYSQL*> conn_queue_;
-    std::mutex mtx_;  // 访问connqueue加锁
-    sem_t sem_id_;
+    static const char *const STMT_SQL[kStmtCount];
 };
 class SqlConnRAII{
 public:
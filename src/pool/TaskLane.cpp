@@ -0,0 +1,71 @@
+//
+// Created by 98302 on 2023/10/18.
+//
+
+#include "TaskLane.h"
+#include "../log/Log.h"
+
+using namespace std;
+
+TaskLane::TaskLane(std::string name, int thread_count, size_t max_depth, Overflow overflow, SchedType sched_type,
+                   bool pin_cpu):
+                   name_(std::move(name)), pool_(thread_count, sched_type, pin_cpu), max_depth_(max_depth),
+                   overflow_(overflow) {
+    assert(max_depth_ > 0);
+}
+
+/// 批量提交，深度上限内的前若干个任务被移走
+/// \param tasks
+/// \param keys 亲和key
+/// \param count
+/// \return 已提交的个数，其余任务留在tasks中由调用方处理
+size_t TaskLane::TryAddTasks(ThreadPool::Task *tasks, const size_t *keys, size_t count) {
+    size_t admitted = Admit_(count);
+    pool_.AddTasks(tasks, keys, admitted);
+    return admitted;
+}
+
+TaskLane::Stats TaskLane::GetStats() const {
+    Stats stats;
+    stats.completed = Completed();  // 先读完成数，同Depth
+    stats.submitted = Submitted();
+    stats.depth = stats.submitted > stats.completed ? stats.submitted - stats.completed : 0;
+    stats.peak_depth = PeakDepth();
+    stats.rejected = Rejected();
+    stats.ran_inline = RanInline();
+    stats.run = pool_.GetRunStats();
+    return stats;
+}
+
+/// 累计值
+void TaskLane::LogStats() const {
+    LogStats(Stats());
+}
+
+/// 自since快照以来的增量；深度为当前值，峰值与最大执行耗时为累计值
+/// \param since
+void TaskLane::LogStats(const TaskLane::Stats &since) const {
+    Stats now = GetStats();
+    uint64_t samples = now.run.samples - since.run.samples;
+    double avg_us = samples ? (now.run.total_ns - since.run.total_ns) / 1e3 / samples : 0;
+    LOG_INFO("Lane[%s] threads:%d, depth:%zu/%zu, peak:%zu, submitted:%zu, completed:%zu, rejected:%zu, "
+             "inline:%zu, run avg:%.1fus, max:%.1fus",
+             name_.c_str(), ThreadCount(), now.depth, max_depth_, now.peak_depth, now.submitted - since.submitted,
+             now.completed - since.completed, now.rejected - since.rejected, now.ran_inline - since.ran_inline,
+             avg_us, now.run.max_ns / 1e3);
+}
+
+/// 按当前深度计算可提交个数，更新峰值与拒绝数（或就地执行数）
+/// \param count
+/// \return
+size_t TaskLane::Admit_(size_t count) {
+    size_t depth = pool_.Depth();
+    size_t admitted = depth >= max_depth_ ? 0 : min(count, max_depth_ - depth);
+    if(admitted < count){
+        (overflow_ == Overflow::RunInline ? ran_inline_ : rejected_).fetch_add(count - admitted, memory_order_relaxed);
+    }
+    size_t peak = peak_depth_.load(memory_order_relaxed);
+    while(depth + admitted > peak &&
+          !peak_depth_.compare_exchange_weak(peak, depth + admitted, memory_order_relaxed)){}
+    return admitted;
+}
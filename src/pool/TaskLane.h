@@ -0,0 +1,83 @@
+//
+// Created by 98302 on 2023/10/18.
+//
+
+#ifndef WEB_SERVER_TASKLANE_H
+#define WEB_SERVER_TASKLANE_H
+
+#include <atomic>
+#include <string>
+#include "ThreadPool.h"
+
+/*
+ * 深度达到上限时调用方对未提交任务的处理，决定计入拒绝数还是就地执行数
+ */
+enum class Overflow {
+    Reject,  // 拒绝，如响应503
+    RunInline,  // 调用方线程就地执行
+};
+
+/*
+ * 执行通道（QoS lane）
+ * 一个独立的线程池，加上排队深度上限与计数，不同类别的任务走不同通道，互不挤占工作线程
+ *      static通道：静态文件读写，线程多、上限高，超限时由调用方就地执行（反压到event loop）
+ *      db通道：登录/注册等需要数据库的请求，线程数不超过数据库连接数，超限时拒绝并返回503
+ * 深度 = 已提交未执行完的任务数（排队+执行中）
+ * 上限检查与提交不是原子的，多个loop并发提交时可能短暂超出上限
+ * 计数：提交、完成、拒绝（或超限就地执行）、深度峰值，以及采样的任务执行耗时（ThreadPool::GetRunStats）
+ * GetStats可在运行中任意线程调用，取得累计值的快照，两次快照相减即为区间内的量
+ */
+class TaskLane {
+public:
+    struct Stats{
+        size_t depth = 0;
+        size_t peak_depth = 0;
+        size_t submitted = 0;
+        size_t completed = 0;
+        size_t rejected = 0;
+        size_t ran_inline = 0;
+        ThreadPool::RunStats run;
+    };
+
+    TaskLane(std::string name, int thread_count, size_t max_depth, Overflow overflow = Overflow::Reject,
+             SchedType sched_type = SchedType::Steal, bool pin_cpu = false);
+    ~TaskLane() = default;
+
+    /// 深度未达上限时提交
+    /// \return false：已达上限，任务未提交
+    template<typename T>
+    bool TryAddTask(size_t key, T&& task){
+        if(Admit_(1) == 0){
+            return false;
+        }
+        pool_.AddTask(key, std::forward<T>(task));
+        return true;
+    }
+    size_t TryAddTasks(ThreadPool::Task *tasks, const size_t *keys, size_t count);
+
+    const std::string &Name() const {return name_;}
+    int ThreadCount() const {return pool_.ThreadCount();}
+    size_t MaxDepth() const {return max_depth_;}
+    size_t Depth() const {return pool_.Depth();}
+    size_t PeakDepth() const {return peak_depth_.load(std::memory_order_relaxed);}
+    size_t Submitted() const {return pool_.Submitted();}
+    size_t Completed() const {return pool_.Completed();}
+    size_t Rejected() const {return rejected_.load(std::memory_order_relaxed);}
+    size_t RanInline() const {return ran_inline_.load(std::memory_order_relaxed);}
+    Stats GetStats() const;
+    void LogStats() const;
+    void LogStats(const Stats &since) const;
+private:
+    size_t Admit_(size_t count);
+
+    std::string name_;
+    ThreadPool pool_;
+    size_t max_depth_;
+    Overflow overflow_;
+    std::atomic<size_t> rejected_{0};
+    std::atomic<size_t> ran_inline_{0};  // Overflow::RunInline时超限的任务数
+    std::atomic<size_t> peak_depth_{0};
+};
+
+
+#endif //WEB_SERVER_TASKLANE_H
@@ -0,0 +1,341 @@
+//
+// Created by 98302 on 2023/10/17.
+//
+
+#include "ThreadPool.h"
+#include <linux/futex.h>
+#include <pthread.h>
+#include <sched.h>
+#include <sys/syscall.h>
+#include <unistd.h>
+
+using namespace std;
+
+namespace {
+
+void FutexWait(atomic<uint32_t> *addr, uint32_t expected) {
+    syscall(SYS_futex, reinterpret_cast<uint32_t*>(addr), FUTEX_WAIT_PRIVATE, expected, nullptr, nullptr, 0);
+}
+
+void FutexWake(atomic<uint32_t> *addr, int count) {
+    syscall(SYS_futex, reinterpret_cast<uint32_t*>(addr), FUTEX_WAKE_PRIVATE, count, nullptr, nullptr, 0);
+}
+
+uint64_t NextRand(uint64_t &state) {  // xorshift64
+    state ^= state << 13;
+    state ^= state >> 7;
+    state ^= state << 17;
+    return state;
+}
+
+uint64_t NowNs() {
+    return chrono::duration_cast<chrono::nanoseconds>(chrono::steady_clock::now().time_since_epoch()).count();
+}
+
+/// 只由所属线程写的计数，不需要原子加
+void Bump(atomic<uint64_t> &counter, uint64_t delta) {
+    counter.store(counter.load(memory_order_relaxed) + delta, memory_order_relaxed);
+}
+
+/// 提交线程的轮转起点，各提交线程独立计数，不共享计数器
+size_t NextStart(size_t n) {
+    thread_local size_t next = hash<thread::id>{}(this_thread::get_id());
+    return next++ % n;
+}
+
+}  // namespace
+
+ThreadPool::ThreadPool(int thread_count, SchedType sched_type, bool pin_cpu): pool_(make_unique<Pool>()) {
+    assert(thread_count > 0);
+    pool_->sched_type = sched_type;
+    pool_->steal_threshold = sched_type == SchedType::Affine ? kStealThreshold : 1;
+    for(int i=0; i<thread_count; ++i){
+        pool_->workers.emplace_back(make_unique<Worker>());
+    }
+    for(int i=0; i<thread_count; ++i){  // 队列全部就绪后再启动线程，窃取时可访问所有队列
+        pool_->workers[i]->thread = thread(WorkerLoop_, pool_.get(), i);
+        if(pin_cpu){
+            PinCpu_(pool_->workers[i]->thread, i);
+        }
+    }
+}
+
+ThreadPool::~ThreadPool() {
+    if(!pool_){
+        return;
+    }
+    pool_->is_closed.store(true);
+    for(auto &worker: pool_->workers){  // 唤醒所有线程，执行完剩余任务后退出
+        WakeWorker_(worker.get());
+    }
+    for(auto &worker: pool_->workers){
+        worker->thread.join();
+    }
+}
+
+/// 放入一个工作线程的队列，从提交线程的轮转位置开始找未满的队列
+/// \param task
+void ThreadPool::Submit_(ThreadPool::Task &&task) {
+    Pool *pool = pool_.get();
+    pool->submitted.fetch_add(1, memory_order_relaxed);
+    size_t n = pool->workers.size();
+    size_t start = NextStart(n);
+    bool pushed = false;
+    for(size_t i=0; i<n && !pushed; ++i){
+        pushed = pool->workers[(start + i) % n]->queue.TryPush(std::move(task));
+    }
+    if(!pushed){
+        PushOverflow_(pool, &task, 1);
+    }
+    // 与WorkerLoop_中 登记休眠→检查队列 配对：要么这里看到休眠线程，要么休眠前的检查看到任务
+    atomic_thread_fence(memory_order_seq_cst);
+    WakeIdle_(pool, 1, start);
+}
+
+/// 放入指定线程的队列，满时进入溢出队列
+/// \param index
+/// \param task
+void ThreadPool::SubmitTo_(size_t index, ThreadPool::Task &&task) {
+    Pool *pool = pool_.get();
+    pool->submitted.fetch_add(1, memory_order_relaxed);
+    Worker *worker = pool->workers[index].get();
+    bool pushed = worker->queue.TryPush(std::move(task));
+    if(!pushed){
+        PushOverflow_(pool, &task, 1);
+    }
+    atomic_thread_fence(memory_order_seq_cst);
+    if(worker->sleeping.load()){
+        WakeWorker_(worker);
+    }
+    if(!pushed || worker->queue.SizeApprox() >= pool->steal_threshold){  // 积压，叫一个空闲线程来窃取
+        WakeIdle_(pool, 1, index + 1);
+    }
+}
+
+/// 批量提交，任务被移走
+/// 从提交线程的轮转位置开始，每个队列一次抢占尽可能多的连续槽位，其余的由空闲线程窃取
+/// \param tasks
+/// \param count
+void ThreadPool::AddTasks(ThreadPool::Task *tasks, size_t count) {
+    if(count == 0){
+        return;
+    }
+    Pool *pool = pool_.get();
+    pool->submitted.fetch_add(count, memory_order_relaxed);
+    size_t n = pool->workers.size();
+    size_t start = NextStart(n);
+    size_t pushed = 0;
+    for(size_t i=0; i<n && pushed<count; ++i){
+        pushed += pool->workers[(start + i) % n]->queue.TryPushBatch(tasks + pushed, count - pushed);
+    }
+    if(pushed < count){
+        PushOverflow_(pool, tasks + pushed, count - pushed);
+    }
+    atomic_thread_fence(memory_order_seq_cst);
+    WakeIdle_(pool, count, start);
+}
+
+/// 带亲和key的批量提交，Steal下忽略key
+/// 所有任务入队后只扫描一遍线程：有任务且在休眠的线程被唤醒，出现积压时再唤醒一个空闲线程窃取
+/// \param tasks
+/// \param keys 与tasks一一对应
+/// \param count
+void ThreadPool::AddTasks(ThreadPool::Task *tasks, const size_t *keys, size_t count) {
+    Pool *pool = pool_.get();
+    if(pool->sched_type != SchedType::Affine){
+        AddTasks(tasks, count);
+        return;
+    }
+    if(count == 0){
+        return;
+    }
+    pool->submitted.fetch_add(count, memory_order_relaxed);
+    size_t n = pool->workers.size();
+    bool overflowed = false;
+    for(size_t i=0; i<count; ++i){
+        if(!pool->workers[keys[i] % n]->queue.TryPush(std::move(tasks[i]))){
+            PushOverflow_(pool, tasks + i, 1);
+            overflowed = true;
+        }
+    }
+    atomic_thread_fence(memory_order_seq_cst);
+    if(pool->sleeping.load(memory_order_relaxed) == 0){
+        return;
+    }
+    bool imbalance = overflowed;
+    for(auto &worker: pool->workers){
+        size_t size = worker->queue.SizeApprox();
+        if(size > 0 && worker->sleeping.load(memory_order_acquire)){
+            WakeWorker_(worker.get());
+        }
+        imbalance = imbalance || size >= pool->steal_threshold;
+    }
+    if(imbalance){
+        WakeIdle_(pool, 1, keys[0]);
+    }
+}
+
+/// 放入溢出队列，任务被移走
+void ThreadPool::PushOverflow_(ThreadPool::Pool *pool, ThreadPool::Task *tasks, size_t count) {
+    lock_guard<mutex> locker(pool->overflow_mtx);
+    for(size_t i=0; i<count; ++i){
+        pool->overflow.push(std::move(tasks[i]));
+    }
+    pool->overflow_size.fetch_add(count);
+}
+
+void ThreadPool::WorkerLoop_(ThreadPool::Pool *pool, size_t index) {
+    uint64_t rand_state = index * 0x9E3779B97F4A7C15ULL + 1;
+    Worker *self = pool->workers[index].get();
+    Task task;
+    while(true){
+        bool found = false;
+        for(int spin=0; spin<kSpinCount && !found; ++spin){
+            found = TryGet_(pool, index, rand_state, task);
+            if(!found && spin > 0){
+                this_thread::yield();
+            }
+        }
+        if(found){
+            size_t completed = self->completed.load(memory_order_relaxed);
+            uint64_t begin = completed % kSampleEvery == 0 ? NowNs() : 0;
+            task();  // 执行任务
+            task = nullptr;  // 及时释放捕获的资源
+            if(begin){
+                uint64_t elapsed = NowNs() - begin;
+                Bump(self->run_samples, 1);
+                Bump(self->run_ns, elapsed);
+                if(elapsed > self->max_run_ns.load(memory_order_relaxed)){
+                    self->max_run_ns.store(elapsed, memory_order_relaxed);
+                }
+            }
+            self->completed.store(completed + 1, memory_order_relaxed);
+            continue;
+        }
+        // 休眠：先登记，再检查，避免与提交之间丢失唤醒
+        uint32_t seq = self->wake_seq.load(memory_order_acquire);
+        self->sleeping.store(true);
+        pool->sleeping.fetch_add(1);
+        bool has_work = HasWork_(pool, index);
+        bool closed = pool->is_closed.load();
+        if(!has_work && !closed){
+            FutexWait(&self->wake_seq, seq);
+        }
+        pool->sleeping.fetch_sub(1);
+        self->sleeping.store(false, memory_order_relaxed);
+        if(closed && !has_work){  // 关闭且无剩余任务
+            break;
+        }
+    }
+}
+
+/// 取一个任务：自己的队列 → 随机起点依次窃取其他队列（积压达到steal_threshold的） → 溢出队列
+/// \param pool
+/// \param index 当前工作线程下标
+/// \param rand_state
+/// \param task
+/// \return
+bool ThreadPool::TryGet_(ThreadPool::Pool *pool, size_t index, uint64_t &rand_state, ThreadPool::Task &task) {
+    auto &workers = pool->workers;
+    if(workers[index]->queue.TryPop(task)){
+        return true;
+    }
+    size_t n = workers.size();
+    size_t start = NextRand(rand_state) % n;
+    for(size_t i=0; i<n; ++i){
+        size_t victim = (start + i) % n;
+        if(victim == index){
+            continue;
+        }
+        auto &queue = workers[victim]->queue;
+        if((pool->steal_threshold <= 1 || queue.SizeApprox() >= pool->steal_threshold) && queue.TryPop(task)){
+            return true;
+        }
+    }
+    if(pool->overflow_size.load(memory_order_relaxed) > 0){
+        lock_guard<mutex> locker(pool->overflow_mtx);
+        if(!pool->overflow.empty()){
+            task = std::move(pool->overflow.front());
+            pool->overflow.pop();
+            pool->overflow_size.fetch_sub(1);
+            return true;
+        }
+    }
+    return false;
+}
+
+size_t ThreadPool::Completed() const {
+    size_t completed = 0;
+    for(auto &worker: pool_->workers){
+        completed += worker->completed.load(memory_order_relaxed);
+    }
+    return completed;
+}
+
+ThreadPool::RunStats ThreadPool::GetRunStats() const {
+    RunStats stats;
+    for(auto &worker: pool_->workers){
+        stats.samples += worker->run_samples.load(memory_order_relaxed);
+        stats.total_ns += worker->run_ns.load(memory_order_relaxed);
+        stats.max_ns = max(stats.max_ns, worker->max_run_ns.load(memory_order_relaxed));
+    }
+    return stats;
+}
+
+size_t ThreadPool::Depth() const {
+    size_t completed = Completed();  // 先读完成数，差值不会因并发执行而下溢
+    size_t submitted = Submitted();
+    return submitted > completed ? submitted - completed : 0;
+}
+
+/// 是否有当前线程可取的任务
+bool ThreadPool::HasWork_(ThreadPool::Pool *pool, size_t index) {
+    auto &workers = pool->workers;
+    for(size_t i=0; i<workers.size(); ++i){
+        size_t size = workers[i]->queue.SizeApprox();
+        if(i == index ? size > 0 : size >= pool->steal_threshold){
+            return true;
+        }
+    }
+    return pool->overflow_size.load() > 0;
+}
+
+/// 从start开始唤醒至多count个休眠线程
+void ThreadPool::WakeIdle_(ThreadPool::Pool *pool, size_t count, size_t start) {
+    if(pool->sleeping.load(memory_order_relaxed) == 0){  // 忙时不进入内核
+        return;
+    }
+    auto &workers = pool->workers;
+    size_t n = workers.size();
+    for(size_t i=0; i<n && count>0; ++i){
+        Worker *worker = workers[(start + i) % n].get();
+        if(worker->sleeping.load(memory_order_acquire)){
+            WakeWorker_(worker);
+            --count;
+        }
+    }
+}
+
+void ThreadPool::WakeWorker_(ThreadPool::Worker *worker) {
+    worker->wake_seq.fetch_add(1, memory_order_release);
+    FutexWake(&worker->wake_seq, 1);
+}
+
+/// 绑定到进程可用CPU中的第index个（循环），失败时不绑定
+void ThreadPool::PinCpu_(std::thread &thread, size_t index) {
+    cpu_set_t allowed;
+    CPU_ZERO(&allowed);
+    if(sched_getaffinity(0, sizeof(allowed), &allowed) != 0 || CPU_COUNT(&allowed) == 0){
+        return;
+    }
+    size_t target = index % CPU_COUNT(&allowed);
+    for(int cpu=0; cpu<CPU_SETSIZE; ++cpu){
+        if(CPU_ISSET(cpu, &allowed) && target-- == 0){
+            cpu_set_t set;
+            CPU_ZERO(&set);
+            CPU_SET(cpu, &set);
+            pthread_setaffinity_np(thread.native_handle(), sizeof(set), &set);
+            return;
+        }
+    }
+}
@@ -6,58 +6,113 @@
 #define WEB_SERVER_THREADPOOL_H
 
 #include <mutex>
-#include <condition_variable>
 #include <queue>
-#include <functional>
+#include <vector>
+#include <thread>
+#include <atomic>
+#include <memory>
 #include <cassert>
+#include "MpmcRing.h"
+#include "InlineTask.h"
+
+/*
+ * 工作窃取线程池
+ * 每个工作线程一个有界无锁队列（MpmcRing），AddTask按提交线程各自的轮转序号选择队列，提交之间不竞争同一把锁
+ * 工作线程先取自己的队列，空了随机选一个起点依次窃取其他线程的队列
+ * 仍无任务时短暂自旋后在futex上休眠；提交时只有存在休眠线程才唤醒一个，忙时提交不进入内核
+ * 所有队列都满时任务进入加锁的溢出队列，不阻塞提交者，不丢弃任务
+ * 任务为InlineTask，可调用对象存放在队列槽内，提交与执行不分配内存
+ * AddTasks批量提交：一次抢占目标队列的连续槽位，按任务数一次唤醒休眠线程，适合一批就绪事件一起提交
+ * 析构时执行完已提交的任务后退出
+ * 调度方式：
+ *      SchedType::Steal   不带key的提交，任务可在任意线程执行，空闲线程窃取任何非空队列
+ *      SchedType::Affine  带key的任务固定放入key % 线程数 的队列，同一连接的任务在同一线程（同一核）执行，
+ *                         连接的缓冲区与请求/响应状态留在该核cache中；
+ *                         只有其他队列积压达到kStealThreshold时空闲线程才窃取
+ *      pin_cpu为true时第i个线程绑定到进程可用CPU中的第i个（循环），Affine下同一连接固定在同一核
+ * 每个线程有自己的futex字与休眠标记，Affine下可以只唤醒任务所属线程
+ * 计数：Submitted为已提交任务数，Completed为各线程已执行数之和（各线程只写自己的计数），Depth为两者之差
+ *      每个线程每kSampleEvery个任务计时一次执行耗时，GetRunStats汇总采样数、总耗时与最大耗时
+ */
+enum class SchedType {
+    Steal,
+    Affine,
+};
 
 class ThreadPool {
 public:
-    ThreadPool() = default;
+    using Task = InlineTask;
+    struct RunStats{
+        uint64_t samples = 0;
+        uint64_t total_ns = 0;
+        uint64_t max_ns = 0;
+    };
+
+    explicit ThreadPool(int thread_count = 8, SchedType sched_type = SchedType::Steal, bool pin_cpu = false);
     ThreadPool(ThreadPool&&) = default;
-    explicit ThreadPool(int thread_count = 8): pool_(std::make_shared<Pool>()){
-        assert(thread_count > 0);
-        for(int i=0; i<thread_count; ++i){  // 创建线程
-            std::thread([this](){
-                std::unique_lock<std::mutex> locker(pool_->mtx_);  //访问pool，加锁
-                while(true){  // 子线程主循环
-                    if(!pool_->tasks_.empty()){  // 任务队列非空
-                        auto task = std::move(pool_->tasks_.front());  // 拿取任务
-                        pool_->tasks_.pop();
-                        locker.unlock();  // 解锁
-                        task();  // 执行任务，线程安全
-                        locker.lock();  // 加锁，准备获取下一个任务
-                    }else if(pool_->is_closed_){  // pool关闭，所有子线程执行完任务终止
-                        break;
-                    }else{  // 任务队列为空，等待加入任务，其他线程等待锁
-                        pool_->cv_.wait(locker);
-                    }
-                }
-            }).detach();  // 与主线程分离
-        }
-    }
-    ~ThreadPool(){
-        if(pool_){
-            std::unique_lock<std::mutex> locker(pool_->mtx_);
-            pool_->is_closed_ = true;
-        }
-        pool_->cv_.notify_all();  // 关闭线程池，唤醒所有wait线程依次终止
-    }
+    ~ThreadPool();
 
     template<typename T>
     void AddTask(T&& task){
-        std::unique_lock<std::mutex> locker(pool_->mtx_);
-        pool_->tasks_.emplace(std::forward<T>(task));  // 就地构造任务
-        pool_->cv_.notify_one();  // 唤醒一个线程执行任务
+        Submit_(Task(std::forward<T>(task)));
     }
+    /// 带亲和key提交，Affine下同一key的任务在同一线程执行，Steal下忽略key
+    template<typename T>
+    void AddTask(size_t key, T&& task){
+        if(pool_->sched_type == SchedType::Affine){
+            SubmitTo_(key % pool_->workers.size(), Task(std::forward<T>(task)));
+        }else{
+            Submit_(Task(std::forward<T>(task)));
+        }
+    }
+    void AddTasks(Task *tasks, size_t count);
+    void AddTasks(Task *tasks, const size_t *keys, size_t count);
+    int ThreadCount() const {return static_cast<int>(pool_->workers.size());}
+    SchedType GetSchedType() const {return pool_->sched_type;}
+    size_t Submitted() const {return pool_->submitted.load(std::memory_order_relaxed);}
+    size_t Completed() const;
+    size_t Depth() const;  // 已提交未执行完的任务数（排队+执行中）
+    RunStats GetRunStats() const;
+
+    static constexpr size_t kQueueCapacity = 1024;  // 每个工作线程的队列容量
+    static constexpr int kSpinCount = 16;  // 休眠前的空转次数
+    static constexpr size_t kStealThreshold = 4;  // Affine下队列积压达到该值才允许窃取
+    static constexpr size_t kSampleEvery = 16;  // 执行耗时的采样间隔（任务数）
 private:
+    struct alignas(64) Worker{
+        Worker(): queue(kQueueCapacity) {}
+        MpmcRing<Task> queue;
+        std::thread thread;
+        alignas(64) std::atomic<uint32_t> wake_seq{0};  // futex字，唤醒该线程时递增
+        std::atomic<bool> sleeping{false};
+        std::atomic<size_t> completed{0};  // 只由本线程写
+        std::atomic<uint64_t> run_samples{0};  // 执行耗时采样，只由本线程写
+        std::atomic<uint64_t> run_ns{0};
+        std::atomic<uint64_t> max_run_ns{0};
+    };
     struct Pool{
-        std::mutex mtx_;
-        std::condition_variable cv_;
-        bool is_closed_;
-        std::queue<std::function<void()>> tasks_;
+        std::vector<std::unique_ptr<Worker>> workers;
+        SchedType sched_type = SchedType::Steal;
+        size_t steal_threshold = 1;  // 窃取要求的最小队列长度
+        alignas(64) std::atomic<size_t> submitted{0};
+        alignas(64) std::atomic<int> sleeping{0};  // 休眠中的线程数
+        std::atomic<bool> is_closed{false};
+        std::mutex overflow_mtx;
+        std::queue<Task> overflow;  // 目标队列满时使用，任意线程可取
+        std::atomic<size_t> overflow_size{0};
     };
-    std::shared_ptr<Pool> pool_;
+
+    void Submit_(Task &&task);
+    void SubmitTo_(size_t index, Task &&task);
+    static void PushOverflow_(Pool *pool, Task *tasks, size_t count);
+    static void WorkerLoop_(Pool *pool, size_t index);
+    static bool TryGet_(Pool *pool, size_t index, uint64_t &rand_state, Task &task);
+    static bool HasWork_(Pool *pool, size_t index);
+    static void WakeIdle_(Pool *pool, size_t count, size_t start);
+    static void WakeWorker_(Worker *worker);
+    static void PinCpu_(std::thread &thread, size_t index);
+
+    std::unique_ptr<Pool> pool_;
 };
 
 
@@ -0,0 +1,134 @@
+//
+// Created by 98302 on 2023/10/25.
+//
+
+#include "UserBloom.h"
+#include <mysql/mysql.h>
+#include <cassert>
+#include "../log/Log.h"
+
+using namespace std;
+
+UserBloom::UserBloom(): bits_(0), enabled_(false), loaded_(0), checks_(0), negatives_(0), false_positives_(0) {}
+
+UserBloom *UserBloom::Instance() {
+    static UserBloom bloom;
+    return &bloom;
+}
+
+/// 读取user表的全部用户名，成功后启用，在loop启动前调用
+/// \param host
+/// \param port
+/// \param user
+/// \param pwd
+/// \param db_name
+/// \param min_capacity 最少按多少个用户名分配
+/// \return 失败时不启用
+bool UserBloom::Load(const char *host, int port, const char *user, const char *pwd, const char *db_name,
+                     size_t min_capacity) {
+    enabled_ = false;
+    MYSQL *sql = mysql_init(nullptr);
+    if(!sql || !mysql_real_connect(sql, host, user, pwd, db_name, port, nullptr, 0)){
+        LOG_ERROR("UserBloom connect error: %s", sql ? mysql_error(sql) : "mysql_init");
+        if(sql){
+            mysql_close(sql);
+        }
+        return false;
+    }
+    vector<string> names;
+    MYSQL_RES *res = nullptr;
+    if(mysql_query(sql, "SELECT username FROM user") == 0 && (res = mysql_use_result(sql))){
+        while(MYSQL_ROW row = mysql_fetch_row(res)){  // 逐行从socket读取，不在客户端缓存整个结果集
+            if(row[0]){
+                names.emplace_back(row[0]);
+            }
+        }
+    }
+    bool ok = res && mysql_errno(sql) == 0;
+    if(!ok){
+        LOG_ERROR("UserBloom load error: %s", mysql_error(sql));
+    }
+    if(res){
+        mysql_free_result(res);
+    }
+    mysql_close(sql);
+    if(!ok){
+        return false;
+    }
+    Reset(max(names.size() * 2, min_capacity));
+    for(auto &name: names){
+        Add(name);
+    }
+    loaded_ = names.size();
+    enabled_ = true;
+    LOG_INFO("UserBloom: %zu usernames loaded, %lu bits", names.size(), bits_);
+    return true;
+}
+
+/// 清空并按容量重新分配位数组，在未启用时调用
+/// \param capacity
+void UserBloom::Reset(size_t capacity) {
+    assert(!enabled_ && capacity > 0);
+    size_t words = (capacity * kBitsPerKey + 63) / 64;
+    words_ = make_unique<atomic<uint64_t>[]>(words);
+    for(size_t i = 0; i < words; ++i){
+        words_[i].store(0, memory_order_relaxed);
+    }
+    bits_ = words * 64;
+    checks_ = 0;
+    negatives_ = 0;
+    false_positives_ = 0;
+}
+
+/// \param name
+/// \return false：一定不存在；未启用时总是true
+bool UserBloom::MayContain(const std::string &name) {
+    if(!enabled_.load(memory_order_acquire)){
+        return true;
+    }
+    checks_.fetch_add(1, memory_order_relaxed);
+    uint64_t h1, h2;
+    Hash_(name, &h1, &h2);
+    for(int i = 0; i < kHashCount; ++i){
+        uint64_t bit = (h1 + i * h2) % bits_;
+        if(!(words_[bit / 64].load(memory_order_relaxed) & (1ULL << (bit % 64)))){
+            negatives_.fetch_add(1, memory_order_relaxed);
+            return false;
+        }
+    }
+    return true;
+}
+
+void UserBloom::Add(const std::string &name) {
+    if(!words_){
+        return;
+    }
+    uint64_t h1, h2;
+    Hash_(name, &h1, &h2);
+    for(int i = 0; i < kHashCount; ++i){
+        uint64_t bit = (h1 + i * h2) % bits_;
+        words_[bit / 64].fetch_or(1ULL << (bit % 64), memory_order_relaxed);
+    }
+}
+
+void UserBloom::LogStats() {
+    if(!enabled_){
+        return;
+    }
+    size_t checks = checks_.load(memory_order_relaxed), negatives = negatives_.load(memory_order_relaxed);
+    size_t false_positives = false_positives_.load(memory_order_relaxed);
+    LOG_INFO("UserBloom loaded:%zu, checks:%zu, skipped selects:%zu, false positives:%zu, fp rate:%.4f",
+             loaded_.load(memory_order_relaxed), checks, negatives, false_positives,
+             negatives + false_positives ?
+             static_cast<double>(false_positives) / static_cast<double>(negatives + false_positives) : 0.0);
+}
+
+/// 双重哈希：第i个位置为h1 + i * h2，h2为奇数
+void UserBloom::Hash_(const std::string &name, uint64_t *h1, uint64_t *h2) {
+    uint64_t hash = std::hash<std::string>{}(name);
+    *h1 = hash;
+    hash += 0x9e3779b97f4a7c15ULL;  // splitmix64，由同一哈希派生第二个独立的哈希
+    hash = (hash ^ (hash >> 30)) * 0xbf58476d1ce4e5b9ULL;
+    hash = (hash ^ (hash >> 27)) * 0x94d049bb133111ebULL;
+    *h2 = (hash ^ (hash >> 31)) | 1;
+}
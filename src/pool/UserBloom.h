@@ -0,0 +1,57 @@
+//
+// Created by 98302 on 2023/10/25.
+//
+
+#ifndef WEB_SERVER_USERBLOOM_H
+#define WEB_SERVER_USERBLOOM_H
+
+#include <string>
+#include <vector>
+#include <atomic>
+#include <memory>
+#include <cstdint>
+
+/*
+ * 已存在用户名的布隆过滤器，注册时跳过存在性查询
+ * 单例模式
+ * 启动时Load以一个阻塞连接流式读取user表的全部用户名，按max(2 * 已有数, min_capacity)个用户名、kBitsPerKey位/键
+ * 分配位数组（约1%误判），读完后启用；未启用（加载失败）时MayContain总是true，所有注册照常查询
+ * MayContain为false：用户名一定不存在，注册直接INSERT；为true：可能存在，照常SELECT
+ * 注册在INSERT之前Add，并发注册同一用户名的请求看到true，落到SELECT；INSERT失败留下的位只是多一次误判
+ * 位数组不可扩容、不删除，用户数超过容量后误判率上升，只影响跳过的比例
+ * 只覆盖本服务写入的用户，外部直接写入user表的用户名在重启前不可见
+ * 位以原子fetch_or置位，读写均无锁
+ */
+class UserBloom {
+public:
+    static UserBloom *Instance();
+
+    bool Load(const char *host, int port,
+              const char *user, const char *pwd,
+              const char *db_name, size_t min_capacity = kDefaultCapacity);
+    void Reset(size_t capacity);
+    bool MayContain(const std::string &name);
+    void Add(const std::string &name);
+    void ReportFalsePositive() {false_positives_.fetch_add(1, std::memory_order_relaxed);}
+    void LogStats();
+
+    static constexpr size_t kDefaultCapacity = 1 << 20;
+    static constexpr size_t kBitsPerKey = 10;
+    static constexpr int kHashCount = 7;  // kBitsPerKey * ln2
+private:
+    UserBloom();
+    ~UserBloom() = default;
+
+    static void Hash_(const std::string &name, uint64_t *h1, uint64_t *h2);
+
+    std::unique_ptr<std::atomic<uint64_t>[]> words_;
+    uint64_t bits_;
+    std::atomic<bool> enabled_;
+    std::atomic<size_t> loaded_;
+    std::atomic<size_t> checks_;
+    std::atomic<size_t> negatives_;  // 跳过的SELECT
+    std::atomic<size_t> false_positives_;  // 判定可能存在、查询后不存在
+};
+
+
+#endif //WEB_SERVER_USERBLOOM_H
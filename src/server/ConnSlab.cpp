@@ -0,0 +1,63 @@
+//
+// Created by 98302 on 2023/10/12.
+//
+
+#include "ConnSlab.h"
+#include <sys/mman.h>
+#include <sys/resource.h>
+#include <cstring>
+#include <cerrno>
+#include "../log/Log.h"
+
+ConnSlab::ConnSlab(size_t capacity): capacity_(capacity) {
+    assert(capacity_ > 0);
+    static_assert(sizeof(void*) == 8, "tagged slot pointer needs 64-bit address space");
+    map_size_ = capacity_ * sizeof(ConnSlot);
+    // 匿名映射全零，generation=0 constructed=false，MAP_NORESERVE只预留地址空间
+    void *ptr = mmap(nullptr, map_size_, PROT_READ | PROT_WRITE,
+                     MAP_PRIVATE | MAP_ANONYMOUS | MAP_NORESERVE, -1, 0);
+    if(ptr == MAP_FAILED){
+        LOG_ERROR("ConnSlab mmap %zu bytes error: %s", map_size_, strerror(errno));
+        slots_ = nullptr;
+        capacity_ = map_size_ = 0;  // Get总是返回nullptr
+        return;
+    }
+    slots_ = static_cast<ConnSlot*>(ptr);
+    assert((reinterpret_cast<uintptr_t>(slots_ + capacity_) & ~kPtrMask) == 0);
+}
+
+ConnSlab::~ConnSlab() {
+    if(!slots_){
+        return;
+    }
+    for(size_t i=0; i<capacity_; ++i){
+        if(slots_[i].constructed){
+            slots_[i].Conn()->~HttpConn();
+            slots_[i].TimerNode()->~WheelNode();
+        }
+    }
+    munmap(slots_, map_size_);
+}
+
+/// 取fd对应的槽，首次使用时构造连接
+/// \param fd
+/// \return 超出容量返回nullptr
+ConnSlot *ConnSlab::Acquire(int fd) {
+    ConnSlot *slot = Get(fd);
+    if(slot && !slot->constructed){
+        new (slot->storage) HttpConn();
+        new (slot->timer_storage) WheelNode{{nullptr, nullptr}, 0, nullptr};
+        slot->constructed = true;
+    }
+    return slot;
+}
+
+/// 默认容量：进程可打开的fd数
+/// \return
+size_t ConnSlab::DefaultCapacity() {
+    struct rlimit limit{};
+    if(getrlimit(RLIMIT_NOFILE, &limit) != 0 || limit.rlim_cur == RLIM_INFINITY){
+        return kMaxCapacity;
+    }
+    return std::min(static_cast<size_t>(limit.rlim_cur), kMaxCapacity);
+}
@@ -0,0 +1,81 @@
+//
+// Created by 98302 on 2023/10/12.
+//
+
+#ifndef WEB_SERVER_CONNSLAB_H
+#define WEB_SERVER_CONNSLAB_H
+
+#include <atomic>
+#include <new>
+#include <cstdint>
+#include "../http/HttpConn.h"
+#include "../timer/WheelTimer.h"
+
+/*
+ * 连接槽：按cache line对齐，避免相邻fd的连接伪共享
+ * generation在连接关闭时递增，事件携带的代数与槽内不一致即为过期事件
+ * conn与时间轮节点在fd首次使用时就地构造，之后随fd复用
+ * db_hold：数据库/口令哈希步骤进行中为kDbHeld，期间定时器到期只置为kDbExpired，由结束该步骤的线程断连
+ */
+struct alignas(64) ConnSlot{
+    static constexpr uint8_t kDbIdle = 0;
+    static constexpr uint8_t kDbHeld = 1;
+    static constexpr uint8_t kDbExpired = 2;
+
+    std::atomic<uint32_t> generation;
+    std::atomic<uint8_t> db_hold;
+    bool constructed;
+    alignas(HttpConn) unsigned char storage[sizeof(HttpConn)];
+    alignas(WheelNode) unsigned char timer_storage[sizeof(WheelNode)];
+
+    HttpConn *Conn() {return std::launder(reinterpret_cast<HttpConn*>(storage));}
+    WheelNode *TimerNode() {return std::launder(reinterpret_cast<WheelNode*>(timer_storage));}
+};
+
+/*
+ * 以fd为下标的连接表
+ * 容量取RLIMIT_NOFILE软限制，启动时一次性mmap预留，页在首次使用时才分配；映射失败时IsValid为false
+ * fd全进程唯一，所有loop共用一张表，每个槽只由accept该fd的loop使用
+ * epoll data / io_uring user_data 存放带代数标记的槽指针：
+ * |63..48: generation低16位|47..0: ConnSlot*|
+ * 事件分发直接解出槽指针，无哈希查找、无内存分配
+ */
+class ConnSlab {
+public:
+    explicit ConnSlab(size_t capacity = DefaultCapacity());
+    ~ConnSlab();
+    ConnSlab(const ConnSlab&) = delete;
+    ConnSlab &operator=(const ConnSlab&) = delete;
+
+    ConnSlot *Acquire(int fd);
+    ConnSlot *Get(int fd) {
+        return (fd >= 0 && static_cast<size_t>(fd) < capacity_) ? &slots_[fd] : nullptr;
+    }
+    bool IsValid() const {return slots_ != nullptr;}
+    size_t Capacity() const {return capacity_;}
+
+    static size_t DefaultCapacity();
+    static uint64_t Tag(const ConnSlot *slot) {
+        return reinterpret_cast<uintptr_t>(slot) |
+               static_cast<uint64_t>(slot->generation.load(std::memory_order_acquire) & kGenMask) << kGenShift;
+    }
+    static ConnSlot *Untag(uint64_t data) {
+        return reinterpret_cast<ConnSlot*>(data & kPtrMask);
+    }
+    static bool IsStale(uint64_t data) {
+        ConnSlot *slot = Untag(data);
+        return (slot->generation.load(std::memory_order_acquire) & kGenMask) != (data >> kGenShift);
+    }
+private:
+    static constexpr int kGenShift = 48;
+    static constexpr uint64_t kGenMask = 0xffff;
+    static constexpr uint64_t kPtrMask = (1ULL << kGenShift) - 1;
+    static constexpr size_t kMaxCapacity = 1 << 20;
+
+    ConnSlot *slots_;
+    size_t capacity_;
+    size_t map_size_;
+};
+
+
+#endif //WEB_SERVER_CONNSLAB_H
@@ -12,27 +12,27 @@ Epoller::~Epoller() {
     close(epoll_fd_);
 }
 
-bool Epoller::AddFd(int fd, uint32_t events) const {
+bool Epoller::AddFd(int fd, uint32_t events, uint64_t data) {
     if(fd < 0){
         return false;
     }
     epoll_event ev = {0};
-    ev.data.fd = fd;
+    ev.data.u64 = data;
     ev.events = events;
     return 0 == epoll_ctl(epoll_fd_, EPOLL_CTL_ADD, fd, &ev);
 }
 
-bool Epoller::ModFd(int fd, uint32_t events) const {
+bool Epoller::ModFd(int fd, uint32_t events, uint64_t data) {
     if(fd < 0){
         return false;
     }
     epoll_event ev = {0};
-    ev.data.fd = fd;
+    ev.data.u64 = data;
     ev.events = events;
     return 0 == epoll_ctl(epoll_fd_, EPOLL_CTL_MOD, fd, &ev);
 }
 
-bool Epoller::DelFd(int fd) const {
+bool Epoller::DelFd(int fd) {
     if(fd < 0){
         return false;
     }
@@ -49,9 +49,9 @@ int Epoller::Wait(int time_out_ms) {
                       time_out_ms);  // 从fd中读取触发事件放入events
 }
 
-int Epoller::GetEventFd(size_t i) const {
+uint64_t Epoller::GetEventData(size_t i) const {
     assert(i >= 0 && i < events_.size());
-    return events_[i].data.fd;
+    return events_[i].data.u64;
 }
 
 uint32_t Epoller::GetEvents(size_t i) const {
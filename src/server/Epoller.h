@@ -9,6 +9,7 @@
 #include <vector>
 #include <cassert>
 #include <unistd.h>
+#include "Poller.h"
 
 /*
  * epoll封装类
@@ -31,17 +32,17 @@
  *           发送缓冲区不为空，写事件一直触发
  * ET边沿触发：
  */
-class Epoller {
+class Epoller: public Poller {
 public:
     explicit Epoller(int max_event = 1024);
-    ~Epoller();
+    ~Epoller() override;
 
-    bool AddFd(int fd, uint32_t events) const;
-    bool ModFd(int fd, uint32_t events) const;
-    bool DelFd(int fd) const;
-    int Wait(int time_out_ms = -1);
-    int GetEventFd(size_t i) const;
-    uint32_t GetEvents(size_t i) const;
+    bool AddFd(int fd, uint32_t events, uint64_t data) override;
+    bool ModFd(int fd, uint32_t events, uint64_t data) override;
+    bool DelFd(int fd) override;
+    int Wait(int time_out_ms = -1) override;
+    uint64_t GetEventData(size_t i) const override;
+    uint32_t GetEvents(size_t i) const override;
 private:
     int epoll_fd_;
     std::vector<struct epoll_event> events_;
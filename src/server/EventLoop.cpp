@@ -0,0 +1,727 @@
+//
+// Created by 98302 on 2023/10/8.
+//
+
+#include "EventLoop.h"
+#include <netinet/tcp.h>
+#include <sys/timerfd.h>
+#include <sys/eventfd.h>
+#include "../pool/CredCache.h"
+#include "../pool/PasswordHash.h"
+
+EventLoop::EventLoop(int id, int port, TimerType timer_type, PollerType poller_type, int timeout_ms, bool timer_fd,
+                     bool opt_linger, bool reuse_port,
+                     uint32_t listen_event, uint32_t conn_event, ConnSlab *slab, TaskLane *static_lane, TaskLane *db_lane,
+                     TaskLane *hash_lane, std::unique_ptr<AsyncSql> sql):
+                     id_(id), port_(port), open_linger_(opt_linger), reuse_port_(reuse_port),
+                     timeout_ms_(timeout_ms), is_closed_(false), listen_fd_(-1),
+                     timer_fd_(-1), wakeup_fd_(-1), armed_deadline_(TimeStamp::max()),
+                     listen_event_(listen_event), accept_all_(listen_event & EPOLLET), conn_event_(conn_event),
+                     slab_(slab), static_lane_(static_lane), db_lane_(db_lane), hash_lane_(hash_lane),
+                     sql_(std::move(sql)),
+                     log_lanes_(id == 0 && (static_lane || db_lane || hash_lane)),
+                     next_stats_(Clock::now() + MS(kStatsIntervalMs)){
+    assert(slab_);
+    // 初始化Poller，io_uring不可用时退回epoll
+    if(poller_type == PollerType::Uring){
+        auto uring = make_unique<UringPoller>();
+        if(uring->IsValid()){
+            poller_ = std::move(uring);
+            accept_all_ = true;
+        }else{
+            LOG_WARN("Loop[%d] io_uring unavailable, fall back to epoll", id);
+        }
+    }
+    if(!poller_){
+        poller_ = make_unique<Epoller>();
+    }
+    if(!InitWakeupFd_()){
+        LOG_ERROR("Loop[%d] wakeup eventfd error!", id);
+    }
+    if(timer_fd && timer_type == TimerType::Loop){  // 链表无序，每轮求最近到期时刻需遍历
+        LOG_WARN("Loop[%d] timerfd unsupported by loop timer, fall back to polling timer", id);
+        timer_fd = false;
+    }
+    if(timer_fd && timeout_ms_ > 0 && !InitTimerFd_()){
+        LOG_WARN("Loop[%d] timerfd unavailable, fall back to polling timer", id);
+    }
+    if(sql_ && !sql_->Attach(poller_.get())){
+        LOG_ERROR("Loop[%d] async sql init error!", id);
+        sql_.reset();
+    }
+    if(static_lane_){
+        pending_tasks_.reserve(kMaxPendingTasks);
+        pending_keys_.reserve(kMaxPendingTasks);
+    }
+    // 初始化Timer
+    switch (timer_type) {
+        case TimerType::Heap:
+            timer_ = make_unique<HeapTimer>();
+            break;
+        case TimerType::Wheel:
+            timer_ = make_unique<WheelTimer>([slab](int fd){ return slab->Get(fd)->TimerNode();});
+            break;
+        case TimerType::Loop:
+        default:
+            timer_ = make_unique<LoopTimer>();
+            break;
+    }
+}
+
+EventLoop::~EventLoop() {
+    DrainClosing_();  // 退出前工作线程投递的关闭
+    if(listen_fd_ >= 0){
+        close(listen_fd_);
+    }
+    if(timer_fd_ >= 0){
+        close(timer_fd_);
+    }
+    if(wakeup_fd_ >= 0){
+        close(wakeup_fd_);
+    }
+}
+
+void EventLoop::Loop() {
+    LOG_INFO("================Loop[%d] start================", id_);
+    loop_thread_ = std::this_thread::get_id();
+    while(!is_closed_){
+        int timeout = -1;  // 无事件阻塞
+        if(timeout_ms_ > 0 && timer_fd_ < 0){
+            timeout = timer_->GetNextTick();  // 最近剩余过期时间
+        }
+        if(log_lanes_){
+            timeout = LogLaneStats_(timeout);
+        }
+        int event_cnt = poller_->Wait(timeout);  // 当前就绪队列中事件数
+        for(int i=0; i<event_cnt; ++i){
+            // 处理事件
+            uint64_t data = poller_->GetEventData(i);
+            uint32_t events = poller_->GetEvents(i);
+            if(data == kListenData){  // 收到请求连接socket事件
+                DealListen_();
+            }else if(data == kTimerData){  // 最近的定时器到期
+                OnTimerFd_();
+            }else if(data == kWakeupData){  // 其他线程唤醒
+                OnWakeup_();
+            }else if(AsyncSql::IsEvent(data)){  // 数据库socket或查询收件通知
+                sql_->OnEvent(AsyncSql::EventFd(data), events);
+            }else if(ConnSlab::IsStale(data)){  // 连接已关闭（fd可能已被复用），丢弃
+                LOG_DEBUG("Stale event dropped");
+            }else if(events & (EPOLLRDHUP | EPOLLHUP | EPOLLERR)){
+                CloseConn_(ConnSlab::Untag(data)->Conn());
+            }else if(events & EPOLLIN){  // 收到读事件，客户端发来数据
+                DealRead_(ConnSlab::Untag(data)->Conn());
+            }else if(events & EPOLLOUT){  // 收到写事件，服务端准备好数据
+                DealWrite_(ConnSlab::Untag(data)->Conn());
+            }else{
+                LOG_ERROR("Unexpected event");
+            }
+        }
+        FlushTasks_();  // 本轮就绪事件的任务一次提交
+        if(timer_fd_ >= 0){
+            ArmTimerFd_();  // 最近到期时刻变化时才重新设置
+        }
+    }
+}
+
+/// 可在任意线程调用，唤醒阻塞在Wait中的loop，本轮事件处理完后退出
+void EventLoop::Quit() {
+    is_closed_ = true;
+    Wakeup_();
+}
+
+/// 创建本loop的监听socket，多loop时开启SO_REUSEPORT绑定同一端口
+/// \return
+bool EventLoop::InitSocket() {
+    int ret;
+    if(wakeup_fd_ < 0){
+        return false;
+    }
+    struct sockaddr_in addr{};
+    if(port_ > 65535 || port_ < 1024){
+        LOG_ERROR("Port:%d error!", port_);
+        return false;
+    }
+    addr.sin_family = AF_INET;  // ipv4
+    addr.sin_addr.s_addr = htonl(INADDR_ANY);
+    addr.sin_port = htons(port_);
+
+    {
+        struct linger opt_linger = {0};
+        if(open_linger_){
+            opt_linger.l_onoff = 1;
+            opt_linger.l_linger = 1;
+        }
+//        listen_fd_ = socket(AF_INET, SOCK_STREAM | SOCK_NONBLOCK, 0);
+        listen_fd_ = socket(AF_INET, SOCK_STREAM, 0);
+        if(listen_fd_ < 0){
+            LOG_ERROR("Create socket error!");
+            return false;
+        }
+        ret = setsockopt(listen_fd_,
+                         SOL_SOCKET,
+                         SO_LINGER,
+                         &opt_linger,
+                         sizeof(opt_linger));
+        if(ret < 0){
+            close(listen_fd_);
+            LOG_ERROR("Init linger error!");
+            return false;
+        }
+    }
+    int optval = 1;
+    ret = setsockopt(listen_fd_,
+                     SOL_SOCKET,
+                     SO_REUSEADDR,
+                     (const void*)&optval,
+                     sizeof(int));
+    if(ret < 0){
+        LOG_ERROR("Set port reuse error!");
+        return false;
+    }
+    if(reuse_port_){  // 多个loop各自监听同一端口，由内核负载均衡
+        ret = setsockopt(listen_fd_,
+                         SOL_SOCKET,
+                         SO_REUSEPORT,
+                         (const void*)&optval,
+                         sizeof(int));
+        if(ret < 0){
+            LOG_ERROR("Set SO_REUSEPORT error!");
+            return false;
+        }
+    }
+    ret = bind(listen_fd_, (struct sockaddr*)&addr, sizeof(addr));
+    if(ret < 0){
+        LOG_ERROR("Bind port:%d error!", port_);
+        return false;
+    }
+    ret = listen(listen_fd_, 6);
+    if(ret < 0){
+        LOG_ERROR("Listen port:%d error!", port_);
+        return false;
+    }
+    ret = poller_->AddFd(listen_fd_, listen_event_ | EPOLLIN, kListenData);  // 将接入请求事件加入epoll
+    if(ret == 0){
+        LOG_ERROR("Add listen error!");
+        close(listen_fd_);
+        return false;
+    }
+    SetFdNonblock_(listen_fd_);
+    LOG_INFO("Loop[%d] listen port:%d", id_, port_);
+    return true;
+}
+
+/// 客户端加入
+/// \param fd
+/// \param addr
+void EventLoop::AddClient_(int fd, sockaddr_in addr) {
+    assert(fd > 0);
+    ConnSlot *slot = slab_->Acquire(fd);
+    assert(slot);
+    HttpConn *client = slot->Conn();
+    client->Init(fd, addr);
+    slot->db_hold.store(ConnSlot::kDbIdle, std::memory_order_relaxed);
+    if (timeout_ms_ > 0) {
+        // 绑定超时断连回调，记下连接代数：连接已关闭（fd可能已被其他loop复用）时回调不做任何事
+        // 数据库/口令哈希步骤进行中时其他线程正在使用连接，只做标记，由ReleaseDb_断连
+        timer_->Add(fd,
+                    timeout_ms_,
+                    [this, data = ConnSlab::Tag(slot)] {
+                        if(ConnSlab::IsStale(data)){
+                            return;
+                        }
+                        ConnSlot *slot = ConnSlab::Untag(data);
+                        uint8_t held = ConnSlot::kDbHeld;
+                        if(!slot->db_hold.compare_exchange_strong(held, ConnSlot::kDbExpired,
+                                                                  std::memory_order_acq_rel)){
+                            CloseConn_(slot->Conn());
+                        }
+                    });
+    }
+    poller_->AddFd(fd, EPOLLIN | conn_event_, ConnSlab::Tag(slot));  // 监听客户端fd的写入事件
+    SetFdNonblock_(fd);//todo
+    // 响应的合并由MSG_MORE控制，关闭Nagle，避免sendfile末尾的小段等待对端延迟ACK
+    int optval = 1;
+    setsockopt(fd, IPPROTO_TCP, TCP_NODELAY, &optval, sizeof(optval));
+    LOG_INFO("Client[%d] in loop[%d]!", client->GetFd(), id_);
+}
+
+/// 处理客户端连接请求
+void EventLoop::DealListen_() {
+    struct sockaddr_in addr{};
+    socklen_t len = sizeof(addr);
+    do{
+        int fd = accept(listen_fd_, (struct sockaddr*)&addr, &len);//todo
+//        int fd = accept4(listen_fd_, (struct sockaddr*)&addr, &len, SOCK_NONBLOCK);
+        if(fd <= 0){
+            return;
+        }else if(static_cast<size_t>(fd) >= slab_->Capacity()){
+            SendError_(fd, "Server busy!");
+            LOG_WARN("Clients is too many!");
+            return;
+        }
+        AddClient_(fd, addr);
+    } while (accept_all_);
+}
+
+void EventLoop::DealWrite_(HttpConn *client) {
+    assert(client);
+    ExtentTime_(client);
+    if(static_lane_){
+        PushTask_(client->GetFd(), [this, client]{ OnWrite_(client);});
+    }else{  // 无工作线程，loop线程直接处理
+        OnWrite_(client);
+    }
+}
+
+void EventLoop::DealRead_(HttpConn *client) {
+    assert(client);
+    ExtentTime_(client);
+    if(static_lane_){
+        PushTask_(client->GetFd(), [this, client]{ OnRead_(client);});
+    }else{
+        OnRead_(client);
+    }
+}
+
+/// 创建唤醒用的eventfd并注册到poller
+/// \return
+bool EventLoop::InitWakeupFd_() {
+    wakeup_fd_ = eventfd(0, EFD_NONBLOCK | EFD_CLOEXEC);
+    if(wakeup_fd_ < 0){
+        return false;
+    }
+    if(!poller_->AddFd(wakeup_fd_, EPOLLIN, kWakeupData)){
+        close(wakeup_fd_);
+        wakeup_fd_ = -1;
+        return false;
+    }
+    return true;
+}
+
+/// 清除eventfd的可读状态，处理工作线程投递的关闭
+void EventLoop::OnWakeup_() {
+    uint64_t count;
+    ssize_t ret = read(wakeup_fd_, &count, sizeof(count));
+    (void)ret;
+    DrainClosing_();
+}
+
+void EventLoop::Wakeup_() {
+    if(wakeup_fd_ < 0){
+        return;
+    }
+    uint64_t one = 1;
+    ssize_t ret = write(wakeup_fd_, &one, sizeof(one));
+    (void)ret;
+}
+
+/// 创建timerfd并注册到poller，定时器到期由poller事件驱动
+/// \return
+bool EventLoop::InitTimerFd_() {
+    timer_fd_ = timerfd_create(CLOCK_MONOTONIC, TFD_NONBLOCK | TFD_CLOEXEC);
+    if(timer_fd_ < 0){
+        return false;
+    }
+    if(!poller_->AddFd(timer_fd_, EPOLLIN, kTimerData)){
+        close(timer_fd_);
+        timer_fd_ = -1;
+        return false;
+    }
+    return true;
+}
+
+/// timerfd到期：一次Tick处理所有到期的定时器
+void EventLoop::OnTimerFd_() {
+    uint64_t expirations;
+    ssize_t ret = read(timer_fd_, &expirations, sizeof(expirations));  // 清除可读状态
+    (void)ret;
+    armed_deadline_ = TimeStamp::max();  // 单次定时已触发
+    timer_->Tick();
+}
+
+/// 按定时器最近的到期时刻设置timerfd，与已设置的相同时不做系统调用
+void EventLoop::ArmTimerFd_() {
+    TimeStamp deadline = timer_->NextDeadline();
+    if(deadline == armed_deadline_){
+        return;
+    }
+    armed_deadline_ = deadline;
+    itimerspec spec{};  // 全零为解除
+    if(deadline != TimeStamp::max()){
+        // 定时器的时钟不一定是单调时钟，按相对时间设置
+        auto remain = std::chrono::duration_cast<std::chrono::nanoseconds>(deadline - Clock::now()).count();
+        remain = std::max<int64_t>(remain, 1);  // 已到期的立即触发
+        spec.it_value.tv_sec = remain / 1000000000;
+        spec.it_value.tv_nsec = remain % 1000000000;
+    }
+    timerfd_settime(timer_fd_, 0, &spec, nullptr);
+}
+
+/// 到达输出时刻时输出各通道自上次输出以来的计数
+/// \param timeout 本轮Wait的超时
+/// \return 不晚于下次输出时刻的超时
+int EventLoop::LogLaneStats_(int timeout) {
+    TimeStamp now = Clock::now();
+    if(now >= next_stats_){
+        TaskLane *lanes[] = {static_lane_, db_lane_, hash_lane_};
+        for(size_t i=0; i<lane_stats_.size(); ++i){
+            if(lanes[i]){
+                lanes[i]->LogStats(lane_stats_[i]);
+                lane_stats_[i] = lanes[i]->GetStats();
+            }
+        }
+        next_stats_ = now + MS(kStatsIntervalMs);
+    }
+    auto remain = static_cast<int>(std::chrono::duration_cast<MS>(next_stats_ - now).count()) + 1;
+    return timeout < 0 ? remain : std::min(timeout, remain);
+}
+
+/// 暂存任务，攒满一批时提前提交
+/// \param key 亲和key，取连接fd，Affine调度下同一连接的任务在同一工作线程执行
+/// \param task
+void EventLoop::PushTask_(size_t key, ThreadPool::Task &&task) {
+    pending_tasks_.push_back(std::move(task));
+    pending_keys_.push_back(key);
+    if(pending_tasks_.size() >= kMaxPendingTasks){
+        FlushTasks_();
+    }
+}
+
+void EventLoop::FlushTasks_() {
+    if(!pending_tasks_.empty()){
+        size_t n = static_lane_->TryAddTasks(pending_tasks_.data(), pending_keys_.data(), pending_tasks_.size());
+        for(size_t i=n; i<pending_tasks_.size(); ++i){  // 通道已满，loop线程就地处理，放慢接收新事件
+            pending_tasks_[i]();
+        }
+        pending_tasks_.clear();  // 任务已被移走或执行，只剩空壳
+        pending_keys_.clear();
+    }
+}
+
+void EventLoop::SendError_(int fd, const char *info) {
+    assert(fd > 0);
+    ssize_t ret = send(fd, info, strlen(info), 0);
+    if(ret < 0){
+        LOG_WARN("Send error info to client:%s failed!", fd);
+    }
+    close(fd);
+}
+
+/// 延长客户端连接，防止超时断连
+/// \param client
+void EventLoop::ExtentTime_(HttpConn *client) {
+    assert(client);
+    if(timeout_ms_ > 0){
+        timer_->Adjust(client->GetFd(), timeout_ms_);
+    }
+}
+
+/// 断连：立即注销事件并使旧事件失效；定时器只在loop线程访问，工作线程中的关闭投递给loop完成
+/// fd在close前不会被复用，时间轮节点在此之前摘下
+/// \param client
+void EventLoop::CloseConn_(HttpConn *client) {
+    assert(client);
+    LOG_INFO("Client[%d] disconnect!", client->GetFd());
+    poller_->DelFd(client->GetFd());
+    slab_->Get(client->GetFd())->generation.fetch_add(1, std::memory_order_release);  // 关闭前递增代数，fd复用后旧事件失效
+    if(timeout_ms_ <= 0 || std::this_thread::get_id() == loop_thread_){
+        FinishClose_(client);
+        return;
+    }
+    bool wakeup;
+    {
+        std::lock_guard<std::mutex> locker(closing_mtx_);
+        wakeup = closing_.empty();  // 非空时已有唤醒未处理
+        closing_.push_back(client);
+    }
+    if(wakeup){
+        Wakeup_();
+    }
+}
+
+void EventLoop::FinishClose_(HttpConn *client) {
+    if(timeout_ms_ > 0){
+        timer_->Cancel(client->GetFd());  // 在close前摘下时间轮节点，fd被其他loop复用时节点已空闲
+    }
+    client->Close();
+}
+
+/// 在loop线程中完成工作线程投递的关闭
+void EventLoop::DrainClosing_() {
+    std::vector<HttpConn*> closing;
+    {
+        std::lock_guard<std::mutex> locker(closing_mtx_);
+        closing.swap(closing_);
+    }
+    for(HttpConn *client: closing){
+        FinishClose_(client);
+    }
+}
+
+/// 读任务
+/// \param client
+void EventLoop::OnRead_(HttpConn *client) {
+    assert(client);
+    ssize_t ret = -1;
+    int read_errno = 0;
+    ret = client->Read(&read_errno);
+    if(ret <= 0 && read_errno != EAGAIN){  // 读失败，并且没有后续，断连
+        CloseConn_(client);
+        return;
+    }
+    OnProcess(client);  // 读成功，继续解析
+}
+
+/// 写任务
+/// \param client
+void EventLoop::OnWrite_(HttpConn *client) {
+    assert(client);
+    ssize_t ret = -1;
+    int write_errno = 0;
+    ret = client->Write(&write_errno);
+    if(client->ToWriteBytes() == 0){  // 没有更多内容需要写入
+        if(client->IsKeepAlive()){  // 维持长连接
+            OnProcess(client);  // 处理缓冲区中剩余的流水线请求，没有则监听读事件
+            return;
+        }
+    }else if(ret < 0){  // 此次未写入
+        if(write_errno == EAGAIN){  // 继续传输, 继续监听写事件
+            poller_->ModFd(client->GetFd(), conn_event_ | EPOLLOUT, EventData_(client));
+            return;  // 中断退出，未断连
+        }
+    }
+    CloseConn_(client);  // 未keepalive并且无须继续传输，断连
+}
+
+/// 读入缓冲区完毕，解析内容，并生成响应到缓冲区，生成完毕准备写事件就绪
+/// \param client
+void EventLoop::OnProcess(HttpConn *client) {
+    if(!ReleaseDb_(client)){  // 数据库步骤期间已超时
+        return;
+    }
+    bool processed = client->Process();
+    if(client->DbPending()){  // 停在需要数据库的请求，之前排队的响应随它一起写出
+        DispatchDb_(client);
+        return;
+    }
+    if(processed){
+        poller_->ModFd(client->GetFd(), conn_event_ | EPOLLOUT, EventData_(client));  // 读成功，继续监听读事件
+    }else{  // 无可读内容
+        poller_->ModFd(client->GetFd(), conn_event_ | EPOLLIN, EventData_(client));  // 读取完毕，监听写事件
+    }
+}
+
+/// 需要数据库的请求：
+///     登录：先查凭据缓存，未命中时查询存储，取得存储的口令后交给hash通道比对
+///     注册：缓存中用户名已存在时直接失败，否则先在hash通道计算口令哈希，再写入存储
+/// \param client
+void EventLoop::DispatchDb_(HttpConn *client) {
+    HoldDb_(client);
+    const HttpRequest &request = client->GetRequest();
+    std::optional<UserRecord> cached = CredCache::Instance()->Lookup(request.GetPost("username"), request.IsLogin());
+    if(request.IsLogin()){
+        if(cached){
+            CheckPwd_(client, std::move(*cached));
+        }else{
+            QueryDb_(client);
+        }
+        return;
+    }
+    if(cached){  // 注册只在用户名已存在时命中
+        client->ResolveDb(false);
+        OnProcess(client);
+        return;
+    }
+    auto job = std::make_unique<HashJob>();
+    job->pwd = request.GetPost("password");
+    job->apply = &EventLoop::OnPwdHashed_;
+    RunHash_(client, [this, client, data = EventData_(client), job = std::move(job)]() mutable {
+        job->stored = PasswordHash::Hash(job->pwd);
+        Resume_(client, data, std::move(job));
+    });
+}
+
+/// 查询存储：登录取得存储的口令，注册写入算好的口令哈希
+/// 提交给非阻塞客户端，结果在loop线程到达；或转入db通道；db通道为空时在当前线程查询
+/// \param client
+void EventLoop::QueryDb_(HttpConn *client) {
+    const HttpRequest &request = client->GetRequest();
+    if(sql_){
+        // 记下连接代数：等待结果期间连接可能超时关闭，fd可能已被复用
+        if(sql_->Submit(request.GetPost("username"), request.IsLogin() ? std::string() : request.PwdHash(),
+                        request.IsLogin(),
+                        [this, client, data = EventData_(client)](std::optional<bool> result, std::string pwd){
+                            if(!ConnSlab::IsStale(data)){
+                                OnDbResult_(client, result, std::move(pwd));
+                            }
+                        })){
+            return;
+        }
+        LOG_WARN("Client[%d] async sql full, respond 503", client->GetFd());
+        client->RejectDb();
+        OnProcess(client);
+        return;
+    }
+    if(!db_lane_){
+        QueryStore_(client);
+        return;
+    }
+    if(!db_lane_->TryAddTask(client->GetFd(), [this, client]{ QueryStore_(client);})){
+        LOG_WARN("Client[%d] db lane full, respond 503", client->GetFd());
+        client->RejectDb();
+        OnProcess(client);
+    }
+}
+
+/// 同步查询AuthStore，在db通道（或处理请求的线程）中执行
+/// \param client
+void EventLoop::QueryStore_(HttpConn *client) {
+    const HttpRequest &request = client->GetRequest();
+    AuthStore *store = AuthStore::Instance();
+    if(!store){
+        LOG_ERROR("No auth store installed!");
+    }else if(request.IsLogin()){
+        if(std::optional<UserRecord> record = store->Find(request.GetPost("username"))){
+            CheckPwd_(client, std::move(*record));
+            return;
+        }
+    }else if(std::optional<bool> inserted = store->Register(request.GetPost("username"), request.PwdHash())){
+        client->ResolveDb(*inserted);
+        OnProcess(client);
+        return;
+    }
+    client->RejectDb();  // 取连接超时、查询出错
+    OnProcess(client);
+}
+
+/// 查询结果到达（loop线程）：登录且用户存在时交给hash通道比对，否则继续处理该连接，与读事件相同地交给static通道
+/// \param client
+/// \param result 登录为用户是否存在，注册为是否写入，为空时数据库出错，响应503
+/// \param pwd 登录时为存储的口令
+void EventLoop::OnDbResult_(HttpConn *client, std::optional<bool> result, std::string pwd) {
+    if(!result){
+        client->RejectDb();
+    }else if(client->GetRequest().IsLogin()){
+        if(*result){
+            CheckPwd_(client, UserRecord{true, std::move(pwd)});
+            return;
+        }
+        client->ResolveDb(false);
+    }else{
+        client->ResolveDb(*result);
+    }
+    if(static_lane_){
+        PushTask_(client->GetFd(), [this, client]{ OnProcess(client);});
+    }else{
+        OnProcess(client);
+    }
+}
+
+/// 登录：用户存在时把存储的口令交给hash通道比对
+/// \param client
+/// \param record
+void EventLoop::CheckPwd_(HttpConn *client, UserRecord &&record) {
+    if(!record.exists){
+        LOG_INFO("pwd error!");
+        client->ResolveDb(false);
+        OnProcess(client);
+        return;
+    }
+    auto job = std::make_unique<HashJob>();
+    job->pwd = client->GetRequest().GetPost("password");
+    job->stored = std::move(record.pwd);
+    job->apply = &EventLoop::OnPwdVerified_;
+    RunHash_(client, [this, client, data = EventData_(client), job = std::move(job)]() mutable {
+        job->verified = PasswordHash::Verify(job->pwd, job->stored);
+        Resume_(client, data, std::move(job));
+    });
+}
+
+/// 数据库/口令哈希步骤开始，其他线程将使用连接：定时器到期时不断连，只做标记
+/// \param client
+void EventLoop::HoldDb_(HttpConn *client) {
+    slab_->Get(client->GetFd())->db_hold.store(ConnSlot::kDbHeld, std::memory_order_release);
+}
+
+/// 数据库/口令哈希步骤结束，继续处理连接前调用；步骤期间定时器已到期时断连
+/// \param client
+/// \return false：连接已断开
+bool EventLoop::ReleaseDb_(HttpConn *client) {
+    std::atomic<uint8_t> &hold = slab_->Get(client->GetFd())->db_hold;
+    if(hold.load(std::memory_order_acquire) == ConnSlot::kDbIdle){
+        return true;
+    }
+    if(hold.exchange(ConnSlot::kDbIdle, std::memory_order_acq_rel) == ConnSlot::kDbExpired){
+        CloseConn_(client);
+        return false;
+    }
+    return true;
+}
+
+/// 口令哈希（数十毫秒CPU）交给hash通道，通道满时响应503；hash通道为空时在当前线程计算
+/// \param client
+/// \param task 只读写HashJob，不访问连接
+void EventLoop::RunHash_(HttpConn *client, ThreadPool::Task &&task) {
+    if(!hash_lane_){
+        task();
+        return;
+    }
+    if(!hash_lane_->TryAddTask(client->GetFd(), std::move(task))){
+        LOG_WARN("Client[%d] hash lane full, respond 503", client->GetFd());
+        client->RejectDb();
+        OnProcess(client);
+    }
+}
+
+/// hash通道算完，把结果与后续处理交还static通道，hash线程只做计算；static通道为空或已满时在当前线程继续
+/// \param client
+/// \param data 连接代数，排队期间连接已关闭时丢弃结果
+/// \param job
+void EventLoop::Resume_(HttpConn *client, uint64_t data, std::unique_ptr<HashJob> job) {
+    ThreadPool::Task task([this, client, data, job = std::move(job)]{
+        if(!ConnSlab::IsStale(data)){
+            (this->*job->apply)(client, *job);
+        }
+    });
+    if(hash_lane_ && static_lane_ && static_lane_->TryAddTask(client->GetFd(), std::move(task))){
+        return;
+    }
+    task();
+}
+
+/// 注册：写入算好的口令哈希后查询存储
+/// \param client
+/// \param job
+void EventLoop::OnPwdHashed_(HttpConn *client, HashJob &job) {
+    if(job.stored.empty()){
+        client->RejectDb();
+        OnProcess(client);
+        return;
+    }
+    client->SetPwdHash(std::move(job.stored));
+    QueryDb_(client);
+}
+
+/// 登录：按比对结果确定响应
+/// \param client
+/// \param job
+void EventLoop::OnPwdVerified_(HttpConn *client, HashJob &job) {
+    if(!job.verified){
+        LOG_INFO("pwd error!");
+    }
+    client->ResolveDb(job.verified);
+    OnProcess(client);
+}
+
+/// fd设置非阻塞
+/// \param fd
+/// \return
+int EventLoop::SetFdNonblock_(int fd) {
+    int flag = fcntl(fd, F_GETFL, 0);
+    if (flag == -1) return -1;
+
+    flag |= O_NONBLOCK;
+    if (fcntl(fd, F_SETFL, flag) == -1) return -1;
+    return 0;
+}
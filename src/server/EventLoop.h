@@ -0,0 +1,152 @@
+//
+// Created by 98302 on 2023/10/8.
+//
+
+#ifndef WEB_SERVER_EVENTLOOP_H
+#define WEB_SERVER_EVENTLOOP_H
+
+#include <netinet/in.h>
+#include <atomic>
+#include <array>
+#include <mutex>
+#include <thread>
+#include "../http/HttpConn.h"
+#include "../timer/Timer.h"
+#include "../timer/HeapTimer.h"
+#include "../timer/LoopTimer.h"
+#include "../timer/WheelTimer.h"
+#include "../pool/TaskLane.h"
+#include "../pool/AsyncSql.h"
+#include "../pool/AuthStore.h"
+#include "Epoller.h"
+#include "UringPoller.h"
+#include "ConnSlab.h"
+
+/*
+ * 事件循环 one loop per thread
+ * 每个loop独占：
+ *      监听socket（多loop时SO_REUSEPORT，内核按连接哈希分发到各loop）
+ *      poller（epoll或io_uring）
+ *      timer（timer_fd为true时由注册在poller中的timerfd驱动）
+ *      连接（WebServer持有的ConnSlab中以fd为下标的槽，只有accept该fd的loop会访问）
+ * loop之间不共享任何状态，新连接的accept、分发、超时处理都在所属loop线程内完成
+ * 每个loop一个eventfd注册在poller中，Quit写入以唤醒阻塞在Wait中的loop
+ * 0号loop每kStatsIntervalMs毫秒输出各执行通道在该区间内的计数（深度、拒绝数、执行耗时），Wait超时不超过下次输出时刻
+ * static_lane为空时读写在loop线程内直接处理，否则交给static通道的工作线程，通道满时在loop线程内处理
+ * 需要数据库的请求：
+ *      sql不为空时提交给本loop的非阻塞客户端，请求挂起不占线程，结果在loop线程到达后继续处理该连接
+ *      否则转入db_lane，通道满时响应503；db_lane为空时在当前线程查询
+ *      口令哈希的计算（注册，写入存储之前）与比对（登录，取得存储的口令之后）转入hash_lane，通道满时响应503，
+ *      算完后交还static通道继续处理该连接；hash_lane为空时在当前线程计算
+ */
+class EventLoop {
+public:
+    EventLoop(int id,
+              int port,
+              TimerType timer_type,
+              PollerType poller_type,
+              int timeout_ms,
+              bool timer_fd,
+              bool opt_linger,
+              bool reuse_port,
+              uint32_t listen_event,
+              uint32_t conn_event,
+              ConnSlab *slab,
+              TaskLane *static_lane,
+              TaskLane *db_lane,
+              TaskLane *hash_lane,
+              std::unique_ptr<AsyncSql> sql);
+    ~EventLoop();
+    bool InitSocket();
+    void Loop();
+    void Quit();
+    int Id() const {return id_;}
+    const AsyncSql *Sql() const {return sql_.get();}
+private:
+    void AddClient_(int fd, sockaddr_in addr);
+
+    void DealListen_();
+    void DealWrite_(HttpConn *client);
+    void DealRead_(HttpConn *client);
+
+    static void SendError_(int fd, const char* info);
+    void ExtentTime_(HttpConn *client);
+    void CloseConn_(HttpConn *client);
+    void FinishClose_(HttpConn *client);
+    void DrainClosing_();
+
+    void OnRead_(HttpConn *client);
+    void OnWrite_(HttpConn *client);
+    void OnProcess(HttpConn *client);
+    void DispatchDb_(HttpConn *client);
+    void QueryDb_(HttpConn *client);
+    void QueryStore_(HttpConn *client);
+    void OnDbResult_(HttpConn *client, std::optional<bool> result, std::string pwd);
+    void CheckPwd_(HttpConn *client, UserRecord &&record);
+    void HoldDb_(HttpConn *client);
+    bool ReleaseDb_(HttpConn *client);
+
+    struct HashJob{  // 口令哈希的输入与结果按值持有，hash通道只做计算，不访问连接
+        std::string pwd;  // 提交的口令
+        std::string stored;  // 登录：存储的口令哈希；注册：算出的口令哈希
+        bool verified = false;
+        void (EventLoop::*apply)(HttpConn*, HashJob&) = nullptr;  // 回到static通道后把结果写入连接
+    };
+    void RunHash_(HttpConn *client, ThreadPool::Task &&task);
+    void Resume_(HttpConn *client, uint64_t data, std::unique_ptr<HashJob> job);
+    void OnPwdHashed_(HttpConn *client, HashJob &job);
+    void OnPwdVerified_(HttpConn *client, HashJob &job);
+
+    bool InitWakeupFd_();
+    void OnWakeup_();
+    void Wakeup_();
+    bool InitTimerFd_();
+    void OnTimerFd_();
+    void ArmTimerFd_();
+    int LogLaneStats_(int timeout);
+    void PushTask_(size_t key, ThreadPool::Task &&task);
+    void FlushTasks_();
+
+    uint64_t EventData_(HttpConn *client) {return ConnSlab::Tag(slab_->Get(client->GetFd()));}
+    static int SetFdNonblock_(int fd);
+
+    static constexpr size_t kMaxPendingTasks = 256;  // 一批最多暂存的任务数
+    static constexpr uint64_t kListenData = 0;  // 监听fd的事件数据，连接的事件数据为非空槽指针
+    static constexpr uint64_t kTimerData = 1;  // timerfd的事件数据，槽指针按cache line对齐，不会为1
+    static constexpr uint64_t kWakeupData = 2;  // 唤醒eventfd的事件数据
+    static constexpr int kStatsIntervalMs = 10000;
+
+    int id_;
+    int port_;
+    bool open_linger_;
+    bool reuse_port_;
+    int timeout_ms_;
+    std::atomic<bool> is_closed_;
+    int listen_fd_;
+    int timer_fd_;  // -1为每轮Wait前GetNextTick
+    int wakeup_fd_;  // 其他线程唤醒本loop
+    TimeStamp armed_deadline_;  // timerfd当前设置的到期时刻，max为未设置
+    std::thread::id loop_thread_;  // Loop开始时记下，定时器只在该线程访问
+    std::mutex closing_mtx_;
+    std::vector<HttpConn*> closing_;  // 工作线程中关闭的连接，由loop线程Cancel定时器后close
+
+    uint32_t listen_event_;
+    bool accept_all_;  // 监听fd为ET，或io_uring多次触发的POLL_ADD（合并的唤醒只有一个完成事件）：每次accept到EAGAIN
+    uint32_t conn_event_;  // 是否ET标记位
+
+    ConnSlab *slab_;  // 所有loop共用，WebServer持有
+    TaskLane *static_lane_;  // 所有loop共用，WebServer持有
+    TaskLane *db_lane_;
+    TaskLane *hash_lane_;  // 口令哈希，所有loop共用，WebServer持有
+    std::unique_ptr<AsyncSql> sql_;  // 本loop的非阻塞数据库客户端，为空时用db_lane_
+    std::unique_ptr<Timer> timer_;
+    std::unique_ptr<Poller> poller_;
+    std::vector<ThreadPool::Task> pending_tasks_;  // 一轮Wait中产生的任务，事件处理完后批量提交
+    std::vector<size_t> pending_keys_;  // 与pending_tasks_一一对应的亲和key
+    bool log_lanes_;  // 0号loop且有执行通道时周期输出
+    TimeStamp next_stats_;
+    std::array<TaskLane::Stats, 3> lane_stats_;  // 上次输出时的快照，依次为static、db、hash通道
+};
+
+
+#endif //WEB_SERVER_EVENTLOOP_H
@@ -0,0 +1,35 @@
+//
+// Created by 98302 on 2023/10/10.
+//
+
+#ifndef WEB_SERVER_POLLER_H
+#define WEB_SERVER_POLLER_H
+
+#include <cstdint>
+#include <cstddef>
+
+enum PollerType{
+    Epoll,
+    Uring
+};
+
+/*
+ * IO事件后端接口
+ * 事件位与epoll一致（EPOLLIN EPOLLOUT EPOLLRDHUP EPOLLONESHOT EPOLLET ...）
+ * 每个fd注册时附带64位用户数据（同epoll_event.data），事件就绪时原样返回
+ * Epoller：epoll_ctl/epoll_wait
+ * UringPoller：io_uring poll请求，注册/修改只写入SQ，在Wait时与等待合并为一次系统调用
+ */
+class Poller {
+public:
+    virtual ~Poller() = default;
+    virtual bool AddFd(int fd, uint32_t events, uint64_t data) = 0;
+    virtual bool ModFd(int fd, uint32_t events, uint64_t data) = 0;
+    virtual bool DelFd(int fd) = 0;
+    virtual int Wait(int time_out_ms) = 0;
+    virtual uint64_t GetEventData(size_t i) const = 0;
+    virtual uint32_t GetEvents(size_t i) const = 0;
+};
+
+
+#endif //WEB_SERVER_POLLER_H
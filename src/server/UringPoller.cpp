@@ -0,0 +1,339 @@
+//
+// Created by 98302 on 2023/10/10.
+//
+
+#include "UringPoller.h"
+#include <sys/mman.h>
+#include <sys/syscall.h>
+#include <sys/eventfd.h>
+#include <csignal>
+#include <cstring>
+#include <cerrno>
+
+using namespace std;
+
+UringPoller::UringPoller(int max_event): ring_fd_(-1), params_{}, sq_ring_ptr_(nullptr), cq_ring_ptr_(nullptr),
+                                         sq_ring_size_(0), cq_ring_size_(0), sqes_(nullptr), sqes_size_(0),
+                                         sq_local_tail_(0), to_submit_(0), multishot_(true),
+                                         wake_fd_(-1), waiting_(false), wake_pending_(false),
+                                         max_event_(max_event) {
+    assert(max_event > 0);
+    events_.reserve(max_event);
+    if(!Setup_(4096)){
+        Release_();
+    }
+}
+
+UringPoller::~UringPoller() {
+    Release_();
+}
+
+/// 创建io_uring实例并映射SQ/CQ环
+/// \param entries
+/// \return
+bool UringPoller::Setup_(unsigned entries) {
+    ring_fd_ = static_cast<int>(syscall(__NR_io_uring_setup, entries, &params_));
+    if(ring_fd_ < 0){
+        return false;
+    }
+    if(!(params_.features & IORING_FEAT_EXT_ARG)){  // Wait超时需要EXT_ARG
+        return false;
+    }
+    sq_ring_size_ = params_.sq_off.array + params_.sq_entries * sizeof(unsigned);
+    cq_ring_size_ = params_.cq_off.cqes + params_.cq_entries * sizeof(io_uring_cqe);
+    bool single_mmap = params_.features & IORING_FEAT_SINGLE_MMAP;
+    if(single_mmap){  // SQ CQ共用一次映射
+        sq_ring_size_ = cq_ring_size_ = max(sq_ring_size_, cq_ring_size_);
+    }
+    sq_ring_ptr_ = mmap(nullptr, sq_ring_size_, PROT_READ | PROT_WRITE,
+                        MAP_SHARED | MAP_POPULATE, ring_fd_, IORING_OFF_SQ_RING);
+    if(sq_ring_ptr_ == MAP_FAILED){
+        sq_ring_ptr_ = nullptr;
+        return false;
+    }
+    if(single_mmap){
+        cq_ring_ptr_ = sq_ring_ptr_;
+    }else{
+        cq_ring_ptr_ = mmap(nullptr, cq_ring_size_, PROT_READ | PROT_WRITE,
+                            MAP_SHARED | MAP_POPULATE, ring_fd_, IORING_OFF_CQ_RING);
+        if(cq_ring_ptr_ == MAP_FAILED){
+            cq_ring_ptr_ = nullptr;
+            return false;
+        }
+    }
+    sqes_size_ = params_.sq_entries * sizeof(io_uring_sqe);
+    sqes_ = static_cast<io_uring_sqe*>(mmap(nullptr, sqes_size_, PROT_READ | PROT_WRITE,
+                                            MAP_SHARED | MAP_POPULATE, ring_fd_, IORING_OFF_SQES));
+    if(sqes_ == MAP_FAILED){
+        sqes_ = nullptr;
+        return false;
+    }
+    auto sq = static_cast<char*>(sq_ring_ptr_);
+    sq_head_ = reinterpret_cast<unsigned*>(sq + params_.sq_off.head);
+    sq_tail_ = reinterpret_cast<unsigned*>(sq + params_.sq_off.tail);
+    sq_mask_ = reinterpret_cast<unsigned*>(sq + params_.sq_off.ring_mask);
+    sq_array_ = reinterpret_cast<unsigned*>(sq + params_.sq_off.array);
+    sq_local_tail_ = *sq_tail_;
+    auto cq = static_cast<char*>(cq_ring_ptr_);
+    cq_head_ = reinterpret_cast<unsigned*>(cq + params_.cq_off.head);
+    cq_tail_ = reinterpret_cast<unsigned*>(cq + params_.cq_off.tail);
+    cq_mask_ = reinterpret_cast<unsigned*>(cq + params_.cq_off.ring_mask);
+    cqes_ = reinterpret_cast<io_uring_cqe*>(cq + params_.cq_off.cqes);
+    wake_fd_ = eventfd(0, EFD_NONBLOCK | EFD_CLOEXEC);
+    if(wake_fd_ < 0){
+        return false;
+    }
+    PrepWake_();  // 第一次Wait时提交
+    return true;
+}
+
+void UringPoller::Release_() {
+    if(sqes_){
+        munmap(sqes_, sqes_size_);
+        sqes_ = nullptr;
+    }
+    if(cq_ring_ptr_ && cq_ring_ptr_ != sq_ring_ptr_){
+        munmap(cq_ring_ptr_, cq_ring_size_);
+    }
+    cq_ring_ptr_ = nullptr;
+    if(sq_ring_ptr_){
+        munmap(sq_ring_ptr_, sq_ring_size_);
+        sq_ring_ptr_ = nullptr;
+    }
+    if(ring_fd_ >= 0){
+        close(ring_fd_);
+        ring_fd_ = -1;
+    }
+    if(wake_fd_ >= 0){
+        close(wake_fd_);
+        wake_fd_ = -1;
+    }
+}
+
+int UringPoller::Enter_(unsigned to_submit, unsigned min_complete, unsigned flags, const void *arg, size_t arg_size) {
+    return static_cast<int>(syscall(__NR_io_uring_enter, ring_fd_, to_submit, min_complete, flags, arg, arg_size));
+}
+
+/// 取一个空闲SQE，SQ已满时先提交，调用方持有mtx_
+/// \return
+io_uring_sqe *UringPoller::GetSqe_() {
+    unsigned head = __atomic_load_n(sq_head_, __ATOMIC_ACQUIRE);
+    if(sq_local_tail_ - head >= params_.sq_entries){
+        __atomic_store_n(sq_tail_, sq_local_tail_, __ATOMIC_RELEASE);
+        Enter_(to_submit_, 0, 0, nullptr, 0);
+        to_submit_ = 0;
+        head = __atomic_load_n(sq_head_, __ATOMIC_ACQUIRE);
+        if(sq_local_tail_ - head >= params_.sq_entries){
+            return nullptr;
+        }
+    }
+    unsigned idx = sq_local_tail_ & *sq_mask_;
+    io_uring_sqe *sqe = &sqes_[idx];
+    memset(sqe, 0, sizeof(*sqe));
+    sq_array_[idx] = idx;
+    ++sq_local_tail_;
+    ++to_submit_;
+    return sqe;
+}
+
+void UringPoller::EnsureFd_(int fd) {
+    if(static_cast<size_t>(fd) >= interest_.size()){
+        size_t n = max(static_cast<size_t>(fd) + 1, interest_.size() * 2);
+        registered_.resize(n, 0);
+        interest_.resize(n, 0);
+        gen_.resize(n, 0);
+        data_.resize(n, 0);
+        armed_.resize(n, 0);
+    }
+}
+
+void UringPoller::PrepPoll_(int fd, uint32_t events) {
+    io_uring_sqe *sqe = GetSqe_();
+    if(!sqe){
+        return;
+    }
+    sqe->opcode = IORING_OP_POLL_ADD;
+    sqe->fd = fd;
+    sqe->poll32_events = events & ~kUnsupportedEvents;
+    sqe->user_data = PollData_(fd);
+    if(!(events & EPOLLONESHOT) && multishot_){
+        sqe->len = IORING_POLL_ADD_MULTI;
+    }
+    armed_[fd] = 1;
+}
+
+void UringPoller::PrepRemove_(int fd) {
+    io_uring_sqe *sqe = GetSqe_();
+    if(!sqe){
+        return;
+    }
+    sqe->opcode = IORING_OP_POLL_REMOVE;
+    sqe->fd = -1;
+    sqe->addr = PollData_(fd);
+    sqe->user_data = RemoveData_(fd);
+    armed_[fd] = 0;
+}
+
+/// 单次poll内部的eventfd，每次触发后在Wait中重新注册
+void UringPoller::PrepWake_() {
+    io_uring_sqe *sqe = GetSqe_();
+    if(!sqe){
+        return;
+    }
+    sqe->opcode = IORING_OP_POLL_ADD;
+    sqe->fd = wake_fd_;
+    sqe->poll32_events = EPOLLIN;
+    sqe->user_data = kWakeData;
+}
+
+/// 请求都留在SQ中由loop线程在Wait时批量提交；loop正阻塞在Wait时，非loop线程唤醒它，调用方持有mtx_
+void UringPoller::WakeIfForeign_() {
+    if(!waiting_ || wake_pending_ || to_submit_ == 0 || this_thread::get_id() == owner_){
+        return;
+    }
+    wake_pending_ = true;
+    uint64_t one = 1;
+    ssize_t ret = write(wake_fd_, &one, sizeof(one));
+    (void)ret;
+}
+
+bool UringPoller::AddFd(int fd, uint32_t events, uint64_t data) {
+    if(fd < 0 || !IsValid()){
+        return false;
+    }
+    lock_guard<mutex> locker(mtx_);
+    EnsureFd_(fd);
+    gen_[fd] = (gen_[fd] + 1) & kGenMask;
+    registered_[fd] = 1;
+    interest_[fd] = events;
+    data_[fd] = data;
+    PrepPoll_(fd, events);
+    WakeIfForeign_();
+    return true;
+}
+
+bool UringPoller::ModFd(int fd, uint32_t events, uint64_t data) {
+    if(fd < 0 || !IsValid()){
+        return false;
+    }
+    lock_guard<mutex> locker(mtx_);
+    if(static_cast<size_t>(fd) >= registered_.size() || !registered_[fd]){
+        return false;
+    }
+    if(armed_[fd]){  // 仍有未触发的poll，先撤销，并使其完成事件过期
+        PrepRemove_(fd);
+        gen_[fd] = (gen_[fd] + 1) & kGenMask;
+    }
+    interest_[fd] = events;
+    data_[fd] = data;
+    PrepPoll_(fd, events);
+    WakeIfForeign_();
+    return true;
+}
+
+bool UringPoller::DelFd(int fd) {
+    if(fd < 0 || !IsValid()){
+        return false;
+    }
+    lock_guard<mutex> locker(mtx_);
+    if(static_cast<size_t>(fd) >= registered_.size() || !registered_[fd]){
+        return false;
+    }
+    registered_[fd] = 0;
+    interest_[fd] = 0;
+    if(armed_[fd]){
+        PrepRemove_(fd);
+    }
+    WakeIfForeign_();
+    return true;
+}
+
+/// 提交SQ中积攒的请求并等待完成事件，一次io_uring_enter
+/// \param time_out_ms
+/// \return 就绪事件数
+int UringPoller::Wait(int time_out_ms) {
+    unsigned to_submit;
+    {
+        lock_guard<mutex> locker(mtx_);
+        if(owner_ == thread::id()){  // WakeIfForeign_在锁内读取
+            owner_ = this_thread::get_id();
+        }
+        __atomic_store_n(sq_tail_, sq_local_tail_, __ATOMIC_RELEASE);
+        to_submit = to_submit_;
+        to_submit_ = 0;
+        waiting_ = true;  // 之后其他线程写入SQ的请求需要唤醒
+    }
+    bool ready = __atomic_load_n(cq_tail_, __ATOMIC_ACQUIRE) != *cq_head_;
+    if(!ready || to_submit){
+        struct __kernel_timespec ts{};
+        io_uring_getevents_arg arg{};
+        arg.sigmask_sz = _NSIG / 8;
+        if(time_out_ms >= 0){
+            ts.tv_sec = time_out_ms / 1000;
+            ts.tv_nsec = (time_out_ms % 1000) * 1000000LL;
+            arg.ts = reinterpret_cast<uint64_t>(&ts);
+        }
+        int ret = Enter_(to_submit, ready ? 0 : 1, IORING_ENTER_GETEVENTS | IORING_ENTER_EXT_ARG, &arg, sizeof(arg));
+        if(ret < 0 && errno != ETIME && errno != EINTR && errno != EAGAIN && errno != EBUSY){
+            lock_guard<mutex> locker(mtx_);
+            waiting_ = false;
+            return -1;
+        }
+    }
+    // 收割完成事件
+    events_.clear();
+    lock_guard<mutex> locker(mtx_);
+    waiting_ = false;
+    unsigned head = *cq_head_;
+    unsigned tail = __atomic_load_n(cq_tail_, __ATOMIC_ACQUIRE);
+    while(head != tail && events_.size() < max_event_){
+        const io_uring_cqe *cqe = &cqes_[head & *cq_mask_];
+        ++head;
+        if(cqe->user_data == kWakeData){  // 其他线程的唤醒，请求已在SQ中，下次Wait提交
+            uint64_t count;
+            ssize_t ret = read(wake_fd_, &count, sizeof(count));
+            (void)ret;
+            wake_pending_ = false;
+            PrepWake_();
+            continue;
+        }
+        if(cqe->user_data & kRemoveTag){  // 撤销请求的完成事件
+            continue;
+        }
+        int fd = static_cast<int>(cqe->user_data & 0xffffffff);
+        uint32_t gen = static_cast<uint32_t>(cqe->user_data >> 32) & kGenMask;
+        if(static_cast<size_t>(fd) >= interest_.size() || gen != gen_[fd]){  // 过期注册的事件
+            continue;
+        }
+        bool more = cqe->flags & IORING_CQE_F_MORE;
+        if(!more){
+            armed_[fd] = 0;
+        }
+        if(!registered_[fd]){  // 已DelFd
+            continue;
+        }
+        if(cqe->res < 0){
+            if(cqe->res == -EINVAL && multishot_ && !(interest_[fd] & EPOLLONESHOT)){  // 内核不支持multishot
+                multishot_ = false;
+                PrepPoll_(fd, interest_[fd]);
+            }
+            continue;
+        }
+        events_.push_back({data_[fd], static_cast<uint32_t>(cqe->res)});
+        if(!more && !(interest_[fd] & EPOLLONESHOT) && !armed_[fd]){  // 非oneshot的fd重新注册
+            PrepPoll_(fd, interest_[fd]);
+        }
+    }
+    __atomic_store_n(cq_head_, head, __ATOMIC_RELEASE);
+    return static_cast<int>(events_.size());
+}
+
+uint64_t UringPoller::GetEventData(size_t i) const {
+    assert(i < events_.size());
+    return events_[i].data;
+}
+
+uint32_t UringPoller::GetEvents(size_t i) const {
+    assert(i < events_.size());
+    return events_[i].events;
+}
@@ -0,0 +1,107 @@
+//
+// Created by 98302 on 2023/10/10.
+//
+
+#ifndef WEB_SERVER_URINGPOLLER_H
+#define WEB_SERVER_URINGPOLLER_H
+
+#include <linux/io_uring.h>
+#include <sys/epoll.h>
+#include <atomic>
+#include <mutex>
+#include <thread>
+#include <vector>
+#include <cassert>
+#include <unistd.h>
+#include "Poller.h"
+
+/*
+ * io_uring事件后端
+ * 直接使用io_uring_setup/io_uring_enter系统调用，不依赖liburing
+ * AddFd/ModFd => IORING_OP_POLL_ADD
+ *      EPOLLONESHOT的连接fd使用单次poll，触发后需ModFd重新注册，与epoll oneshot语义一致
+ *      监听fd使用multishot poll（内核不支持时退化为每次触发后自动重新注册）
+ * DelFd => IORING_OP_POLL_REMOVE
+ * 批量提交：
+ *      所有线程的注册请求都只写入SQ，在loop线程下一次Wait时与等待合并为一次io_uring_enter
+ *      loop正阻塞在Wait时，工作线程写内部的eventfd唤醒它；一次Wait至多唤醒一次，之后的请求不再有系统调用
+ * 超时依赖IORING_FEAT_EXT_ARG（5.11+），不支持时IsValid返回false，由调用方退回epoll
+ */
+class UringPoller: public Poller {
+public:
+    explicit UringPoller(int max_event = 1024);
+    ~UringPoller() override;
+
+    bool IsValid() const {return ring_fd_ >= 0;}
+    bool AddFd(int fd, uint32_t events, uint64_t data) override;
+    bool ModFd(int fd, uint32_t events, uint64_t data) override;
+    bool DelFd(int fd) override;
+    int Wait(int time_out_ms = -1) override;
+    uint64_t GetEventData(size_t i) const override;
+    uint32_t GetEvents(size_t i) const override;
+private:
+    struct Event{
+        uint64_t data;
+        uint32_t events;
+    };
+    bool Setup_(unsigned entries);
+    void Release_();
+    io_uring_sqe *GetSqe_();
+    void EnsureFd_(int fd);
+    void PrepPoll_(int fd, uint32_t events);
+    void PrepRemove_(int fd);
+    void WakeIfForeign_();
+    int Enter_(unsigned to_submit, unsigned min_complete, unsigned flags, const void *arg, size_t arg_size);
+
+    /*
+     * user_data布局：
+     * |63: remove标记|62..32: fd注册代数|31..0: fd|
+     * 代数在每次AddFd时递增，fd关闭复用后旧poll的完成事件因代数不符被丢弃
+     */
+    uint64_t PollData_(int fd) const {return static_cast<uint64_t>(gen_[fd]) << 32 | static_cast<uint32_t>(fd);}
+    uint64_t RemoveData_(int fd) const {return kRemoveTag | PollData_(fd);}
+    void PrepWake_();
+
+    static const uint64_t kRemoveTag = 1ULL << 63;
+    static const uint64_t kWakeData = kRemoveTag - 1;  // 内部eventfd的poll，fd部分为-1，不会与PollData_相同
+    static const uint32_t kGenMask = 0x7fffffff;
+    static const uint32_t kUnsupportedEvents = EPOLLET | EPOLLONESHOT | EPOLLEXCLUSIVE | EPOLLWAKEUP;
+
+    int ring_fd_;
+    io_uring_params params_;
+    void *sq_ring_ptr_;
+    void *cq_ring_ptr_;
+    size_t sq_ring_size_;
+    size_t cq_ring_size_;
+    io_uring_sqe *sqes_;
+    size_t sqes_size_;
+    // SQ环
+    unsigned *sq_head_;
+    unsigned *sq_tail_;
+    unsigned *sq_mask_;
+    unsigned *sq_array_;
+    unsigned sq_local_tail_;
+    unsigned to_submit_;  // 已写入SQ尚未提交的数量
+    // CQ环
+    unsigned *cq_head_;
+    unsigned *cq_tail_;
+    unsigned *cq_mask_;
+    io_uring_cqe *cqes_;
+
+    bool multishot_;
+    std::thread::id owner_;  // 调用Wait的loop线程
+    std::mutex mtx_;  // SQ与interest_为多线程访问，加锁
+    int wake_fd_;  // 唤醒阻塞在Wait中的loop线程
+    bool waiting_;  // loop线程正阻塞在io_uring_enter中
+    bool wake_pending_;  // 已写wake_fd_，完成事件尚未收割
+    std::vector<uint8_t> registered_;  // fd => 是否已AddFd，events可以为0
+    std::vector<uint32_t> interest_;  // fd => 注册的事件
+    std::vector<uint32_t> gen_;  // fd => 注册代数
+    std::vector<uint64_t> data_;  // fd => 用户数据
+    std::vector<uint8_t> armed_;  // fd => 是否有未完成的poll请求
+    std::vector<Event> events_;
+    size_t max_event_;
+};
+
+
+#endif //WEB_SERVER_URINGPOLLER_H
@@ -4,12 +4,13 @@
 
 #include "WebServer.h"
 
-WebServer::WebServer(int port, int trigger_mode, TimerType timer_type, int timeout_ms, bool opt_linger, int sql_port,
+WebServer::WebServer(int port, int trigger_mode, TimerType timer_type, PollerType poller_type,
+                     SendStrategy send_strategy, int timeout_ms, bool timer_fd, bool opt_linger, int sql_port,
                      const char *sql_username, const char *sql_password, const char *db_name, int conn_pool_num,
-                     int thread_num, bool open_log, int log_level, int log_queue_size):
-                     port_(port), open_linger_(opt_linger), timeout_ms_(timeout_ms), is_closed_(false),
-                     thread_pool_(new ThreadPool(thread_num)),
-                     epoller_(new Epoller()){
+                     SqlMode sql_mode, int thread_num, SchedType sched_type, bool pin_cpu, int db_thread_num,
+                     int db_queue_depth, int hash_thread_num, int hash_queue_depth, int loop_num, bool open_log, int log_level, int log_queue_size):
+                     port_(port), open_linger_(opt_linger), is_closed_(false){
+    assert(thread_num >= 0 && db_thread_num >= 0 && hash_thread_num >= 0 && loop_num > 0);
     src_dir_ = getcwd(nullptr, 256);  // 当前工作目录
     assert(src_dir_);
     strcat(src_dir_, "/resources/");
@@ -23,28 +24,90 @@ WebServer::WebServer(int port, int trigger_mode, TimerType timer_type, int timeo
     // 初始化HttpConn静态变量
     HttpConn::user_count = 0;
     HttpConn::src_dir = src_dir_;
-    // 初始化SqlPool
-    SqlConnPool::Instance()->Init("localhost",
-                                  sql_port,
-                                  sql_username,
-                                  sql_password,
-                                  db_name,
-                                  conn_pool_num);
-    // 初始化Timer
-    switch (timer_type) {
-        case TimerType::Heap:
-            timer_ = make_unique<HeapTimer>();
-            break;
-        case TimerType::Loop:
-        default:
-            timer_ = make_unique<LoopTimer>();
-            break;
+    HttpConn::send_strategy = send_strategy;
+    FileCache::Instance()->Init(src_dir_);  // 静态文件缓存，inotify监视资源目录
+    SessionTable::Instance()->Init();  // 登录后的会话，需要登录的页面凭Cookie访问，不查询数据库
+    if(sql_mode != SqlMode::Embedded){
+        CredCache::Instance()->Init();  // 用户凭据缓存，登录/注册先查缓存；嵌入式存储的查找本身与缓存同量级，不再缓存
+    }
+    if(sql_mode == SqlMode::Async && !AsyncMySql::kSupported){
+        LOG_WARN("MySQL client library has no non-blocking API, fall back to blocking sql");
+        sql_mode = SqlMode::Blocking;
+    }
+    // 初始化SqlPool，非阻塞模式下每个loop自建连接
+    if(sql_mode == SqlMode::Blocking){
+        SqlConnPool::Instance()->Init("localhost",
+                                      sql_port,
+                                      sql_username,
+                                      sql_password,
+                                      db_name,
+                                      max(1, conn_pool_num / 4),
+                                      conn_pool_num);
+        AuthStore::Install(make_unique<MySqlAuthStore>(SqlConnPool::Instance()));
+    }
+    if(sql_mode == SqlMode::Blocking || sql_mode == SqlMode::Async){
+        // 已有用户名的布隆过滤器，注册时跳过一定不存在的用户名的SELECT；加载失败时照常查询
+        UserBloom::Instance()->Load("localhost", sql_port, sql_username, sql_password, db_name);
+    }else if(sql_mode == SqlMode::Embedded){
+        auto store = make_unique<MmapAuthStore>("./data");
+        if(store->Open()){
+            AuthStore::Install(std::move(store));
+        }else{
+            is_closed_ = true;
+        }
     }
-    // 初始化事件 socket
-    InitEventMode_(trigger_mode);
-    if(!InitSocket_()){
+    // 初始化执行通道，0个线程时由loop线程直接读写
+    if(thread_num > 0){
+        static_lane_ = make_unique<TaskLane>("static", thread_num, thread_num * ThreadPool::kQueueCapacity,
+                                             Overflow::RunInline, sched_type, pin_cpu);
+    }
+    if(db_thread_num > 0 && sql_mode == SqlMode::Blocking){
+        assert(db_queue_depth > 0);
+        if(db_thread_num > conn_pool_num){
+            LOG_WARN("db lane threads(%d) > sql conn pool num(%d)", db_thread_num, conn_pool_num);
+        }
+        db_lane_ = make_unique<TaskLane>("db", db_thread_num, db_queue_depth);
+    }
+    if(hash_thread_num > 0){
+        assert(hash_queue_depth > 0);
+        hash_lane_ = make_unique<TaskLane>("hash", hash_thread_num, hash_queue_depth);
+    }
+    // 初始化连接表，容量取RLIMIT_NOFILE
+    slab_ = make_unique<ConnSlab>();
+    if(!slab_->IsValid()){
         is_closed_ = true;
     }
+    // 初始化事件 loop
+    InitEventMode_(trigger_mode);
+    for(int i=0; i<loop_num && !is_closed_; ++i){
+        unique_ptr<AsyncSql> sql;
+        if(sql_mode == SqlMode::Async){
+            sql = make_unique<AsyncMySql>("localhost", sql_port, sql_username, sql_password, db_name,
+                                          conn_pool_num, db_queue_depth);
+        }else if(sql_mode == SqlMode::Local){
+            sql = make_unique<LocalSql>(db_queue_depth);
+        }
+        loops_.emplace_back(make_unique<EventLoop>(i,
+                                                   port_,
+                                                   timer_type,
+                                                   poller_type,
+                                                   timeout_ms,
+                                                   timer_fd,
+                                                   open_linger_,
+                                                   loop_num > 1,
+                                                   listen_event_,
+                                                   conn_event_,
+                                                   slab_.get(),
+                                                   static_lane_.get(),
+                                                   db_lane_.get(),
+                                                   hash_lane_.get(),
+                                                   std::move(sql)));
+        if((sql_mode != SqlMode::Blocking && sql_mode != SqlMode::Embedded && !loops_.back()->Sql()) ||
+           !loops_.back()->InitSocket()){
+            is_closed_ = true;
+            break;
+        }
+    }
 
     if(is_closed_){
         LOG_ERROR("================Server init error!================");
@@ -55,114 +118,85 @@ WebServer::WebServer(int port, int trigger_mode, TimerType timer_type, int timeo
                  (listen_event_ & EPOLLET?"ET":"LT"),
                  (conn_event_ & EPOLLET?"ET":"LT"));
         LOG_INFO("Log level:%d", log_level);
+        LOG_INFO("Timeout:%dms, timer type:%d, timerfd:%s", timeout_ms, timer_type, timer_fd ? "true" : "false");
         LOG_INFO("Src Dir:%s", HttpConn::src_dir);
-        LOG_INFO("Sql Conn Pool num:%d, thread-pool num:%d", conn_pool_num, thread_num);
+        LOG_INFO("Send strategy:%s", send_strategy == SendStrategy::Sendfile ? "sendfile" : "mmap");
+        LOG_INFO("Sql Conn Pool num:%d, thread-pool num:%d, loop num:%d", conn_pool_num, thread_num, loop_num);
+        LOG_INFO("Thread-pool sched:%s, pin cpu:%s",
+                 sched_type == SchedType::Affine ? "affine" : "steal", pin_cpu ? "true" : "false");
+        LOG_INFO("Sql mode:%s", sql_mode == SqlMode::Async ? "async" : sql_mode == SqlMode::Local ? "local" :
+                                sql_mode == SqlMode::Embedded ? "embedded" : "blocking");
+        LOG_INFO("Db lane threads:%d, queue depth:%d", db_lane_ ? db_thread_num : 0, db_queue_depth);
+        LOG_INFO("Hash lane threads:%d, queue depth:%d, scrypt log2(N):%d",
+                 hash_thread_num, hash_queue_depth, PasswordHash::log_n);
+        LOG_INFO("Conn slab capacity:%zu", slab_->Capacity());
     }
 }
 
 WebServer::~WebServer() {
-    close(listen_fd_);
     is_closed_ = true;
+    for(auto &loop: loops_){
+        loop->Quit();
+    }
+    for(auto &t: loop_threads_){  // Quit已唤醒阻塞在Wait中的loop
+        if(t.joinable()){
+            t.join();
+        }
+    }
+    loop_threads_.clear();
+    DrainLanes_();
+    for(auto *lane: {static_lane_.get(), db_lane_.get(), hash_lane_.get()}){
+        if(lane){
+            lane->LogStats();
+        }
+    }
+    for(auto &loop: loops_){
+        if(const AsyncSql *sql = loop->Sql()){
+            LOG_INFO("Loop[%d] sql in flight:%zu, completed:%zu, failed:%zu",
+                     loop->Id(), sql->InFlight(), sql->Completed(), sql->Failed());
+        }
+    }
+    SqlConnPool::Instance()->LogStats();
+    CredCache::Instance()->LogStats();
+    UserBloom::Instance()->LogStats();
+    SessionTable::Instance()->LogStats();
+    SessionTable::Instance()->Close();
+    FileCache::Instance()->Close();
     free(src_dir_);
+    AuthStore::Install(nullptr);
     SqlConnPool::Instance()->ClosePool();
 }
 
+/// 启动所有loop，1号及之后的loop各占一个线程，0号loop运行在当前线程
 void WebServer::Start() {
-    int timeout = -1;  // 无事件阻塞
-    if(!is_closed_){
-        LOG_INFO("================Server start================");
+    if(is_closed_){
+        return;
     }
-    while(!is_closed_){
-        if(timeout_ms_ > 0){
-            timeout = timer_->GetNextTick();  // 最近剩余过期时间
-        }
-        int event_cnt = epoller_->Wait(timeout);  // 当前就绪队列中事件数
-        for(int i=0; i<event_cnt; ++i){
-            // 处理事件
-            int fd = epoller_->GetEventFd(i);
-            uint32_t events = epoller_->GetEvents(i);
-            if(fd == listen_fd_){  // 收到请求连接socket事件
-                DealListen_();
-            }else if(events & (EPOLLRDHUP | EPOLLHUP | EPOLLERR)){
-                assert(users_.count(fd) > 0);
-                CloseConn_(&users_[fd]);
-            }else if(events & EPOLLIN){  // 收到读事件，客户端发来数据
-                assert(users_.count(fd) > 0);
-                DealRead_(&users_[fd]);
-            }else if(events & EPOLLOUT){  // 收到写事件，服务端准备好数据
-                assert(users_.count(fd) > 0);
-                DealWrite_(&users_[fd]);
-            }else{
-                LOG_ERROR("Unexpected event");
-            }
+    LOG_INFO("================Server start================");
+    for(size_t i=1; i<loops_.size(); ++i){
+        loop_threads_.emplace_back([loop = loops_[i].get()]{ loop->Loop(); });
+    }
+    loops_[0]->Loop();
+    for(auto &t: loop_threads_){
+        if(t.joinable()){
+            t.join();
         }
-
     }
+    loop_threads_.clear();
 }
 
-bool WebServer::InitSocket_() {
-    int ret;
-    struct sockaddr_in addr{};
-    if(port_ > 65535 || port_ < 1024){
-        LOG_ERROR("Port:%d error!", port_);
-        return false;
-    }
-    addr.sin_family = AF_INET;  // ipv4
-    addr.sin_addr.s_addr = htonl(INADDR_ANY);
-    addr.sin_port = htons(port_);
-
-    {
-        struct linger opt_linger = {0};
-        if(open_linger_){
-            opt_linger.l_onoff = 1;
-            opt_linger.l_linger = 1;
-        }
-//        listen_fd_ = socket(AF_INET, SOCK_STREAM | SOCK_NONBLOCK, 0);
-        listen_fd_ = socket(AF_INET, SOCK_STREAM, 0);
-        if(listen_fd_ < 0){
-            LOG_ERROR("Create socket error!");
-            return false;
+/// 等待各通道中剩余的任务执行完，任务会访问loop与连接，须在loops_析构前完成
+/// 任务之间会相互提交（static→hash→static），连续两轮各通道均为空才算结束
+void WebServer::DrainLanes_() {
+    int idle_rounds = 0;
+    while(idle_rounds < 2){
+        bool idle = true;
+        for(auto *lane: {static_lane_.get(), db_lane_.get(), hash_lane_.get()}){
+            idle = idle && (!lane || lane->Depth() == 0);
         }
-        ret = setsockopt(listen_fd_,
-                         SOL_SOCKET,
-                         SO_LINGER,
-                         &opt_linger,
-                         sizeof(opt_linger));
-        if(ret < 0){
-            close(listen_fd_);
-            LOG_ERROR("Init linger error!");
-            return false;
-        }
-    }
-    int optval = 1;
-    ret = setsockopt(listen_fd_,
-                     SOL_SOCKET,
-                     SO_REUSEADDR,
-                     (const void*)&optval,
-                     sizeof(int));
-    if(ret < 0){
-        LOG_ERROR("Set port reuse error!");
-        return false;
-    }
-    ret = bind(listen_fd_, (struct sockaddr*)&addr, sizeof(addr));
-    if(ret < 0){
-        LOG_ERROR("Bind port:%d error!", port_);
-        return false;
-    }
-    ret = listen(listen_fd_, 6);
-    if(ret < 0){
-        LOG_ERROR("Listen port:%d error!", port_);
-        return false;
+        idle_rounds = idle ? idle_rounds + 1 : 0;
+        this_thread::sleep_for(chrono::milliseconds(1));
     }
-    ret = epoller_->AddFd(listen_fd_, listen_event_ | EPOLLIN);  // 将接入请求事件加入epoll
-    if(ret == 0){
-        LOG_ERROR("Add listen error!");
-        close(listen_fd_);
-        return false;
-    }
-    SetFdNonblock_(listen_fd_);
-    LOG_INFO("Server port:%d", port_);
-    return true;
 }
 
 /// 初始化fd触发方式标志位（ET LT）
@@ -187,135 +221,3 @@ void WebServer::InitEventMode_(int trigger_mode) {
     }
     HttpConn::is_et = (conn_event_ & EPOLLET);
 }
-
-/// 客户端加入
-/// \param fd
-/// \param addr
-void WebServer::AddClient_(int fd, sockaddr_in addr) {
-    assert(fd > 0);
-    users_[fd].Init(fd, addr);
-    if (timeout_ms_ > 0) {
-        timer_->Add(fd,
-                    timeout_ms_,
-                    [this, conn = &users_[fd]] { CloseConn_(conn); });  // 绑定超时断连回调
-    }
-    epoller_->AddFd(fd, EPOLLIN | conn_event_);  // 监听客户端fd的写入事件
-    SetFdNonblock_(fd);//todo
-    LOG_INFO("Client[%d] in!", users_[fd].GetFd());
-}
-
-/// 处理客户端连接请求
-void WebServer::DealListen_() {
-    struct sockaddr_in addr{};
-    socklen_t len = sizeof(addr);
-    do{
-        int fd = accept(listen_fd_, (struct sockaddr*)&addr, &len);//todo
-//        int fd = accept4(listen_fd_, (struct sockaddr*)&addr, &len, SOCK_NONBLOCK);
-        if(fd <= 0){
-            return;
-        }else if(HttpConn::user_count >= MAX_FD){
-            SendError_(fd, "Server busy!");
-            LOG_WARN("Clients is too many!");
-            return;
-        }
-        AddClient_(fd, addr);
-    } while (listen_event_ & EPOLLET);
-}
-
-void WebServer::DealWrite_(HttpConn *client) {
-    assert(client);
-    ExtentTime_(client);
-    thread_pool_->AddTask([this, client]{ OnWrite_(client);});
-}
-
-void WebServer::DealRead_(HttpConn *client) {
-    assert(client);
-    ExtentTime_(client);
-    thread_pool_->AddTask([this, client]{ OnRead_(client);});
-}
-
-void WebServer::SendError_(int fd, const char *info) {
-    assert(fd > 0);
-    ssize_t ret = send(fd, info, strlen(info), 0);
-    if(ret < 0){
-        LOG_WARN("Send error info to client:%s failed!", fd);
-    }
-    close(fd);
-}
-
-/// 延长客户端连接，防止超时断连
-/// \param client
-void WebServer::ExtentTime_(HttpConn *client) {
-    assert(client);
-    if(timeout_ms_ > 0){
-        timer_->Adjust(client->GetFd(), timeout_ms_);
-    }
-}
-
-void WebServer::CloseConn_(HttpConn *client) {
-    assert(client);
-    LOG_INFO("Client[%d] disconnect!", client->GetFd());
-    epoller_->DelFd(client->GetFd());
-    client->Close();
-}
-
-/// 子线程读任务
-/// \param client
-void WebServer::OnRead_(HttpConn *client) {
-    assert(client);
-    ssize_t ret = -1;
-    int read_errno = 0;
-    ret = client->Read(&read_errno);
-    if(ret <= 0 && read_errno != EAGAIN){  // 读失败，并且没有后续，断连
-        CloseConn_(client);
-        return;
-    }
-    OnProcess(client);  // 读成功，继续解析
-}
-
-/// 子线程写任务
-/// \param client
-void WebServer::OnWrite_(HttpConn *client) {
-    assert(client);
-    ssize_t ret = -1;
-    int write_errno = 0;
-    ret = client->Write(&write_errno);
-    if(client->ToWriteBytes() == 0){  // 没有更多内容需要写入
-        if(client->IsKeepAlive()){  // 维持长连接
-            epoller_->ModFd(client->GetFd(), conn_event_ | EPOLLIN);  // 监听读事件
-            return;
-        }
-    }else if(ret < 0){  // 此次未写入
-        if(write_errno == EAGAIN){  // 继续传输, 继续监听写事件
-            epoller_->ModFd(client->GetFd(), conn_event_ | EPOLLOUT);
-            return;  // 中断退出，未断连
-        }
-    }
-    CloseConn_(client);  // 未keepalive并且无须继续传输，断连
-}
-
-/// 读入缓冲区完毕，解析内容，并生成响应到缓冲区，生成完毕准备写事件就绪
-/// \param client
-void WebServer::OnProcess(HttpConn *client) {
-    if(client->Process()){
-        epoller_->ModFd(client->GetFd(), conn_event_ | EPOLLOUT);  // 读成功，继续监听读事件
-    }else{  // 无可读内容
-        epoller_->ModFd(client->GetFd(), conn_event_ | EPOLLIN);  // 读取完毕，监听写事件
-    }
-}
-
-/// fd设置非阻塞
-/// \param fd
-/// \return
-//int WebServer::SetFdNonblock_(int fd) {
-//    assert(fd > 0);
-//    return fcntl(fd, F_SETFL, fcntl(fd, F_GETFL, 0) | O_NONBLOCK);
-//}
-int WebServer::SetFdNonblock_(int fd) {
-    int flag = fcntl(fd, F_GETFL, 0);
-    if (flag == -1) return -1;
-
-    flag |= O_NONBLOCK;
-    if (fcntl(fd, F_SETFL, flag) == -1) return -1;
-    return 0;
-}
\ No newline at end of file
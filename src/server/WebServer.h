@@ -5,13 +5,19 @@
 #ifndef WEB_SERVER_WEBSERVER_H
 #define WEB_SERVER_WEBSERVER_H
 
-#include <netinet/in.h>
+#include <thread>
+#include <vector>
 #include "../http/HttpConn.h"
-#include "../timer/Timer.h"
-#include "../timer/HeapTimer.h"
-#include "../timer/LoopTimer.h"
-#include "../pool/ThreadPool.h"
-#include "Epoller.h"
+#include "../pool/TaskLane.h"
+#include "../pool/AsyncMySql.h"
+#include "../pool/LocalSql.h"
+#include "../pool/CredCache.h"
+#include "../pool/UserBloom.h"
+#include "../pool/MySqlAuthStore.h"
+#include "../pool/MmapAuthStore.h"
+#include "../pool/SessionTable.h"
+#include "../pool/PasswordHash.h"
+#include "EventLoop.h"
 
 /*
  * web server主类
@@ -33,59 +39,96 @@
  *      生成response，放入写缓冲区
  *      事件改为EPOLLOUT，将写缓冲区内容写入fd
  *      置回EPOLLIN监听读事件
+ * 多reactor：
+ *      loop_num > 1时每个loop一个线程，各自SO_REUSEPORT监听同一端口
+ *      Start所在线程运行0号loop
+ *      thread_num为0时不创建线程池，读写在loop线程内完成
+ * 事件后端：
+ *      PollerType::Epoll  epoll
+ *      PollerType::Uring  io_uring，事件注册与等待合并提交
+ * 超时定时器：
+ *      TimerType::Heap   小根堆
+ *      TimerType::Loop   链表
+ *      TimerType::Wheel  分层时间轮，节点在连接槽内，增删改O(1)无分配，epoll超时取下一个到期时刻
+ *      timer_fd为true时每个loop一个timerfd注册在poller中，按最近到期时刻设置，到期时批量处理，
+ *      loop每轮不再读时钟、不再Tick；最近到期时刻不变时不做系统调用
+ *      TimerType::Loop不支持timerfd，退回每轮Tick
+ * 工作线程调度：
+ *      SchedType::Steal   任务可在任意工作线程执行，空闲线程窃取
+ *      SchedType::Affine  按连接fd固定工作线程，积压时才窃取；pin_cpu为true时工作线程绑核
+ * 执行通道（QoS）：
+ *      static通道  thread_num个线程，深度上限thread_num * ThreadPool::kQueueCapacity，满时loop线程就地处理
+ *      db通道      db_thread_num个线程，深度上限db_queue_depth，满时登录/注册响应503
+ *                  db_thread_num为0时在static通道线程内查询（原行为）
+ *      hash通道    hash_thread_num个线程，深度上限hash_queue_depth，满时登录/注册响应503
+ *                  登录校验与注册哈希（PasswordHash，scrypt）在此执行，完成后交回static通道生成响应，
+ *                  不占static通道线程；hash_thread_num为0时在处理请求的线程内计算
+ *      析构时输出各通道计数
+ * 数据库访问：
+ *      SqlMode::Blocking  SqlConnPool同步查询，在db通道（或static通道）线程中执行，
+ *                         连接池常驻conn_pool_num / 4个连接，按需增长到conn_pool_num，
+ *                         取连接超过SqlConnPool::kAcquireTimeoutMs或数据库出错时响应503
+ *      SqlMode::Async     每个loop一个AsyncMySql，conn_pool_num个非阻塞连接注册在loop的poller中，
+ *                         查询期间请求挂起不占线程，每个loop至多db_queue_depth个在途查询，超出响应503；
+ *                         不建db通道与SqlConnPool；客户端库不是MariaDB时退回Blocking
+ *      SqlMode::Local     同Async，后端为进程内替身LocalSql（内存用户表），无需mysqld
+ *      SqlMode::Embedded  MmapAuthStore（./data下的映射哈希表与注册日志），在处理请求的线程内同步校验，
+ *                         不建db通道、SqlConnPool与CredCache
+ *      Embedded以外的模式登录/注册先查CredCache，命中时在当前线程完成，不取连接、不提交查询
+ *      Blocking、Async启动时加载UserBloom，注册的用户名一定不存在时不执行SELECT，直接INSERT
+ *      存储与CredCache只保存口令哈希（引入哈希之前的明文口令仍可登录），比对在hash通道
+ *      登录/注册成功后在SessionTable签发会话（Cookie），之后访问需要登录的页面只查会话表
+ * 响应体发送：
+ *      SendStrategy::Mmap      mmap + writev
+ *      SendStrategy::Sendfile  响应头writev，文件sendfile
  */
 class WebServer {
 public:
     WebServer(int port,
               int trigger_mode,
               TimerType timer_type,
+              PollerType poller_type,
+              SendStrategy send_strategy,
               int timeout_ms,
+              bool timer_fd,
               bool opt_linger,
               int sql_port,
               const char* sql_username,
               const char* sql_password,
               const char* db_name,
               int conn_pool_num,
+              SqlMode sql_mode,
               int thread_num,
+              SchedType sched_type,
+              bool pin_cpu,
+              int db_thread_num,
+              int db_queue_depth,
+              int hash_thread_num,
+              int hash_queue_depth,
+              int loop_num,
               bool open_log,
               int log_level,
               int log_queue_size);
     ~WebServer();
     void Start();
 private:
-    bool InitSocket_();
     void InitEventMode_(int trigger_mode);
-    void AddClient_(int fd, sockaddr_in addr);
-
-    void DealListen_();
-    void DealWrite_(HttpConn *client);
-    void DealRead_(HttpConn *client);
-
-    static void SendError_(int fd, const char* info);
-    void ExtentTime_(HttpConn *client);
-    void CloseConn_(HttpConn *client);
-
-    void OnRead_(HttpConn *client);
-    void OnWrite_(HttpConn *client);
-    void OnProcess(HttpConn *client);
-
-    static const int MAX_FD = 65536;
-    static int SetFdNonblock_(int fd);
+    void DrainLanes_();
 
     int port_;
     bool open_linger_;
-    int timeout_ms_;
     bool is_closed_;
-    int listen_fd_;
     char* src_dir_;  // 申请时malloc，手动free
 
     uint32_t listen_event_;
     uint32_t conn_event_;  // 是否ET标记位
 
-    std::unique_ptr<Timer> timer_;
-    std::unique_ptr<ThreadPool> thread_pool_;
-    std::unique_ptr<Epoller> epoller_;
-    std::unordered_map<int, HttpConn> users_;
+    std::unique_ptr<ConnSlab> slab_;  // 所有loop共用，以fd为下标
+    std::unique_ptr<TaskLane> static_lane_;  // 所有loop共用
+    std::unique_ptr<TaskLane> db_lane_;
+    std::unique_ptr<TaskLane> hash_lane_;  // 口令哈希
+    std::vector<std::unique_ptr<EventLoop>> loops_;
+    std::vector<std::thread> loop_threads_;
 };
 
 
@@ -9,8 +9,11 @@ using namespace std;
 
 void HeapTimer::Adjust(int id, int new_expire) {
     assert(!heap_.empty() && ref_.count(id));
-    heap_[ref_[id]].expire = Clock::now() + MS(new_expire);
-    ShiftDown_(ref_[id], heap_.size());
+    size_t i = ref_[id];
+    heap_[i].expire = Clock::now() + MS(new_expire);
+    if(!ShiftDown_(i, heap_.size())){
+        ShiftUp_(i);
+    }
 }
 
 void HeapTimer::Add(int id, int time_out, const TimeoutCallback &callback) {
@@ -63,11 +66,15 @@ void HeapTimer::Pop() {
 
 int HeapTimer::GetNextTick() {
     Tick();
-    size_t res = -1;
+    int res = -1;
     if(!heap_.empty()){
-        res = chrono::duration_cast<MS>(heap_.front().expire-Clock::now()).count();  // res never < 0??????
+        res = static_cast<int>(max<int64_t>(chrono::duration_cast<MS>(heap_.front().expire-Clock::now()).count(), 0));
     }
-    return static_cast<int>(res);
+    return res;
+}
+
+TimeStamp HeapTimer::NextDeadline() {
+    return heap_.empty() ? TimeStamp::max() : heap_.front().expire;
 }
 
 void HeapTimer::Del_(size_t i) {
@@ -85,16 +92,15 @@ void HeapTimer::Del_(size_t i) {
     heap_.pop_back();
 }
 
-/// todo
+/// 上移节点
 /// \param i
 void HeapTimer::ShiftUp_(size_t i) {
     check_range(i);
-    size_t parent = (i-1) / 2;
-    while (parent >= 0){
+    while (i > 0){
+        size_t parent = (i-1) / 2;
         if(heap_[parent] > heap_[i]){
             SwapNode_(i, parent);
             i = parent;
-            parent = (i-1) / 2;
         }else{
             break;
         }
@@ -118,8 +124,9 @@ bool HeapTimer::ShiftDown_(size_t i, size_t n) {
             SwapNode_(child, index);
             index = child;
             child = 2*child+1;
+        }else{
+            break;
         }
-        break;
     }
     return index > i;
 }
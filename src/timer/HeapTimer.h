@@ -47,6 +47,7 @@ public:
     void Clear();
     void Pop();
     int GetNextTick() override;
+    TimeStamp NextDeadline() override;
 private:
     void Del_(size_t i);
     void ShiftUp_(size_t i);
@@ -47,6 +47,15 @@ void LoopTimer::Clear() {
     map_.clear();
 }
 
+/// 链表不按到期时间排序，遍历取最小值，O(n)；因此LoopTimer不与timerfd一起使用
+TimeStamp LoopTimer::NextDeadline() {
+    TimeStamp deadline = TimeStamp::max();
+    for(const auto &node: list_){
+        deadline = min(deadline, node->expire);
+    }
+    return deadline;
+}
+
 int LoopTimer::GetNextTick() {
     Tick();
     return -1;
@@ -40,6 +40,7 @@ public:
     void Tick() override;
     void Clear();
     int GetNextTick() override;
+    TimeStamp NextDeadline() override;
 private:
     std::list<std::shared_ptr<LoopTimerNode>> list_;
     std::list<std::shared_ptr<LoopTimerNode>>::iterator cur_;
@@ -15,15 +15,21 @@ typedef Clock::time_point TimeStamp;
 
 enum TimerType{
     Heap,
-    Loop
+    Loop,
+    Wheel
 };
 
 class Timer {
 public:
+    virtual ~Timer() = default;
     virtual void Adjust(int id, int new_expire) = 0;
     virtual void Add(int id, int time_out, const TimeoutCallback& callback) = 0;
+    /// 取消定时器；默认不做任何事，已关闭连接的回调由调用方自行识别忽略
+    virtual void Cancel(int /*id*/) {}
     virtual void Tick() = 0;
     virtual int GetNextTick() = 0;
+    /// 最近一次需要Tick的时刻，不处理到期、不读时钟；无定时器时为TimeStamp::max()
+    virtual TimeStamp NextDeadline() = 0;
 };
 
 
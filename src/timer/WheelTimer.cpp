@@ -0,0 +1,232 @@
+//
+// Created by 98302 on 2023/10/19.
+//
+
+#include "WheelTimer.h"
+#include <bit>
+
+using namespace std;
+
+WheelTimer::WheelTimer(NodeOf node_of): node_of_(std::move(node_of)), start_(Clock::now()), now_(0), size_(0) {
+    assert(node_of_);
+    for(int level=0; level<kLevels; ++level){
+        occupied_[level] = 0;
+        for(auto &head: slots_[level]){
+            head.prev = head.next = &head;
+        }
+    }
+}
+
+/// 摘下所有节点，节点属于使用方，不执行回调
+WheelTimer::~WheelTimer() {
+    for(auto &level: slots_){
+        for(auto &head: level){
+            while(head.next != &head){
+                Unlink_(static_cast<WheelNode*>(head.next));
+            }
+        }
+    }
+}
+
+void WheelTimer::Adjust(int id, int new_expire) {
+    WheelNode *node = node_of_(id);
+    assert(node);
+    if(!node->prev){  // 已到期或已取消
+        return;
+    }
+    uint64_t expire = ExpireTick_(new_expire);
+    if(expire >= node->expire){  // 推迟：留在原槽，到槽时重新挂入
+        node->expire = expire;
+    }else{
+        Unlink_(node);
+        node->expire = expire;
+        Link_(node);
+    }
+}
+
+void WheelTimer::Add(int id, int time_out, const TimeoutCallback &callback) {
+    assert(id >= 0);
+    WheelNode *node = node_of_(id);
+    assert(node);
+    if(node->prev){  // 同一id重复添加，覆盖
+        Unlink_(node);
+    }
+    node->expire = ExpireTick_(time_out);
+    node->callback = callback;
+    Link_(node);
+}
+
+void WheelTimer::Cancel(int id) {
+    WheelNode *node = node_of_(id);
+    if(node && node->prev){
+        Unlink_(node);
+        node->callback = nullptr;
+    }
+}
+
+void WheelTimer::Tick() {
+    Advance_(NowTick_());
+}
+
+/// 处理到期定时器，返回距下一个需要处理的tick的毫秒数
+/// \return 无定时器时-1
+int WheelTimer::GetNextTick() {
+    Advance_(NowTick_());
+    if(size_ == 0){
+        return -1;
+    }
+    TimeStamp deadline = start_ + MS(NextEventTick_() * kTickMs);
+    auto remain = chrono::duration_cast<chrono::microseconds>(deadline - Clock::now()).count();
+    return remain <= 0 ? 0 : static_cast<int>((remain + 999) / 1000);  // 向上取整，不提前醒来
+}
+
+TimeStamp WheelTimer::NextDeadline() {
+    if(size_ == 0){
+        return TimeStamp::max();
+    }
+    return start_ + MS(NextEventTick_() * kTickMs);
+}
+
+uint64_t WheelTimer::NowTick_() const {
+    return chrono::duration_cast<MS>(Clock::now() - start_).count() / kTickMs;
+}
+
+/// time_out毫秒后的tick，向上取整，不提前到期
+/// \param time_out
+/// \return
+uint64_t WheelTimer::ExpireTick_(int time_out) const {
+    auto elapsed = chrono::duration_cast<chrono::microseconds>(Clock::now() - start_).count() +
+                   static_cast<int64_t>(max(time_out, 0)) * 1000;
+    constexpr int64_t tick_us = kTickMs * 1000;
+    return static_cast<uint64_t>((elapsed + tick_us - 1) / tick_us);
+}
+
+/// 按到期tick与now_的距离选层，槽号取到期tick在该层的位
+/// \param node
+void WheelTimer::Link_(WheelNode *node) {
+    uint64_t expire = max(node->expire, now_ + 1);  // 已过期的下一个tick处理
+    uint64_t delta = expire - now_;
+    int level = 0;
+    while(level < kLevels - 1 && delta >= (1ULL << (kSlotBits * (level + 1)))){
+        ++level;
+    }
+    size_t slot = (expire >> (kSlotBits * level)) & (kSlots - 1);
+    WheelLink *head = &slots_[level][slot];
+    node->prev = head->prev;
+    node->next = head;
+    head->prev->next = node;
+    head->prev = node;
+    occupied_[level] |= 1ULL << slot;
+    ++size_;
+}
+
+void WheelTimer::Unlink_(WheelNode *node) {
+    WheelLink *next = node->next;
+    node->prev->next = next;
+    next->prev = node->prev;
+    if(next == node->prev){  // 槽已空，next与prev都是哨兵
+        auto *head = static_cast<WheelLink*>(next);
+        size_t index = head - &slots_[0][0];
+        occupied_[index / kSlots] &= ~(1ULL << (index % kSlots));
+    }
+    node->prev = node->next = nullptr;
+    --size_;
+}
+
+/// 推进到target，跳过第0层的空槽
+/// \param target
+void WheelTimer::Advance_(uint64_t target) {
+    while(now_ < target){
+        if(size_ == 0){
+            now_ = target;
+            break;
+        }
+        // 本轮内第0层下一个非空槽，没有则跳到层边界（需要下放高层的槽）
+        size_t index = now_ & (kSlots - 1);
+        uint64_t pending = index == kSlots - 1 ? 0 : occupied_[0] >> (index + 1) << (index + 1);
+        uint64_t next = pending ? (now_ & ~(kSlots - 1)) + countr_zero(pending)
+                                : (now_ | (kSlots - 1)) + 1;
+        if(next > target){
+            now_ = target;
+            break;
+        }
+        now_ = next;
+        index = now_ & (kSlots - 1);
+        if(index == 0){
+            Cascade_(1);
+        }
+        Expire_(index);
+    }
+}
+
+/// 到达第level层的边界，该层当前槽的节点按到期时间重新挂入下层
+/// \param level
+void WheelTimer::Cascade_(int level) {
+    if(level >= kLevels){
+        return;
+    }
+    size_t index = (now_ >> (kSlotBits * level)) & (kSlots - 1);
+    if(index == 0){  // 上一层同时到达边界，先下放上一层
+        Cascade_(level + 1);
+    }
+    WheelLink *head = &slots_[level][index];
+    if(head->next == head){
+        return;
+    }
+    // 整槽摘下再逐个挂入，顶层超出范围的节点可能挂回同一槽
+    WheelLink *link = head->next;
+    head->prev->next = nullptr;
+    head->prev = head->next = head;
+    occupied_[level] &= ~(1ULL << index);
+    while(link){
+        auto *node = static_cast<WheelNode*>(link);
+        link = link->next;
+        --size_;
+        Link_(node);
+    }
+}
+
+/// 第0层槽到期：未到期的（被Adjust推迟的）重新挂入，到期的摘下后执行回调
+/// \param slot
+void WheelTimer::Expire_(size_t slot) {
+    WheelLink *head = &slots_[0][slot];
+    while(head->next != head){
+        auto *node = static_cast<WheelNode*>(head->next);
+        Unlink_(node);
+        if(node->expire > now_){
+            Link_(node);
+            continue;
+        }
+        TimeoutCallback callback = std::move(node->callback);
+        node->callback = nullptr;
+        if(callback){  // 回调可能关闭连接并Cancel，节点已摘下
+            callback();
+        }
+    }
+}
+
+/// 下一个需要处理的tick：第0层本轮的非空槽，或第0层下一轮的槽，或高层非空槽下放的边界
+/// \return
+uint64_t WheelTimer::NextEventTick_() const {
+    size_t index = now_ & (kSlots - 1);
+    uint64_t pending = index == kSlots - 1 ? 0 : occupied_[0] >> (index + 1) << (index + 1);
+    if(pending){
+        return (now_ & ~(kSlots - 1)) + countr_zero(pending);
+    }
+    uint64_t next = UINT64_MAX;
+    if(occupied_[0]){  // 下一轮
+        next = (now_ & ~(kSlots - 1)) + kSlots + countr_zero(occupied_[0]);
+    }
+    for(int level=1; level<kLevels; ++level){
+        if(!occupied_[level]){
+            continue;
+        }
+        int shift = kSlotBits * level;
+        size_t current = (now_ >> shift) & (kSlots - 1);
+        // 从当前槽的下一个起循环查找，距离1~kSlots，当前槽本身要等一整轮
+        uint64_t rotated = rotr(occupied_[level], static_cast<int>((current + 1) & (kSlots - 1)));
+        uint64_t distance = countr_zero(rotated) + 1;
+        next = min(next, ((now_ >> shift) + distance) << shift);
+    }
+    return next;
+}
@@ -0,0 +1,77 @@
+//
+// Created by 98302 on 2023/10/19.
+//
+
+#ifndef WEB_SERVER_WHEELTIMER_H
+#define WEB_SERVER_WHEELTIMER_H
+
+#include <functional>
+#include <chrono>
+#include <cassert>
+#include <cstdint>
+#include "Timer.h"
+
+struct WheelLink{
+    WheelLink *prev;
+    WheelLink *next;
+};
+
+/*
+ * 时间轮定时器节点，侵入式，存放在使用方（连接槽）中，定时器不分配内存
+ * prev为空表示未挂在轮上
+ */
+struct WheelNode: WheelLink{
+    uint64_t expire;  // 到期tick
+    TimeoutCallback callback;
+};
+
+/*
+ * 分层时间轮定时器
+ * kLevels层，每层kSlots个槽，第l层每槽跨 kSlots^l 个tick，tick为kTickMs毫秒，覆盖约4.6小时，更远的到期在顶层循环重排
+ * 节点由node_of按id取得（连接槽内的WheelNode），Add/Adjust/Cancel为链表摘挂，O(1)无分配
+ * Adjust只推迟到期时间时只改expire，节点留在原槽，到槽时发现未到期再重新挂入（惰性调整），每个请求只写一个字段
+ * 每层一个占用位图，GetNextTick由位图算出下一个需要处理的tick：第0层的到期槽，或高层非空槽的下放时刻，
+ * 没有定时器时返回-1，epoll无限等待；空闲时只在这些时刻醒来；NextDeadline给出同一时刻，供timerfd设置
+ * 惰性调整不改变NextDeadline，timerfd不需要因每个请求重新设置
+ * 推进时跳过空槽，长时间阻塞后一次推进只访问非空槽与层边界
+ * 只在所属loop线程中使用，不加锁；连接在工作线程中关闭时由loop线程代为Cancel
+ */
+class WheelTimer: public Timer {
+public:
+    using NodeOf = std::function<WheelNode*(int id)>;
+
+    explicit WheelTimer(NodeOf node_of);
+    ~WheelTimer() override;
+
+    void Adjust(int id, int new_expire) override;
+    void Add(int id, int time_out, const TimeoutCallback& callback) override;
+    void Cancel(int id) override;
+    void Tick() override;
+    int GetNextTick() override;
+    TimeStamp NextDeadline() override;
+    size_t Size() const {return size_;}
+
+    static constexpr int kTickMs = 1;
+    static constexpr int kSlotBits = 6;
+    static constexpr size_t kSlots = 1 << kSlotBits;
+    static constexpr int kLevels = 4;
+private:
+    uint64_t NowTick_() const;
+    uint64_t ExpireTick_(int time_out) const;
+    void Link_(WheelNode *node);
+    void Unlink_(WheelNode *node);
+    void Advance_(uint64_t target);
+    void Cascade_(int level);
+    void Expire_(size_t slot);
+    uint64_t NextEventTick_() const;
+
+    NodeOf node_of_;
+    TimeStamp start_;
+    uint64_t now_;  // 已处理到的tick
+    size_t size_;
+    uint64_t occupied_[kLevels];  // 非空槽位图
+    WheelLink slots_[kLevels][kSlots];  // 循环链表哨兵
+};
+
+
+#endif //WEB_SERVER_WHEELTIMER_H